@@ -0,0 +1,26 @@
+# Writes INPUT into OUTPUT as a byte array named NAME plus NAME_size. A zero byte is appended that isn't
+# counted in the size, so embedded text can be used as a C string.
+#   cmake -DINPUT=... -DOUTPUT=... -DNAME=... -P embed.cmake
+file(READ ${INPUT} content HEX)
+string(LENGTH "${content}" hex_length)
+math(EXPR size "${hex_length} / 2")
+
+# 16 bytes per line
+set(lines "")
+set(offset 0)
+while(offset LESS hex_length)
+    string(SUBSTRING "${content}" ${offset} 32 line)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1, " line "${line}")
+    string(STRIP "${line}" line)
+    string(APPEND lines "    ${line}\n")
+    math(EXPR offset "${offset} + 32")
+endwhile()
+
+get_filename_component(source ${INPUT} NAME)
+file(WRITE ${OUTPUT}
+    "// generated from ${source}, do not edit\n"
+    "#pragma once\n\n"
+    "#include <cstddef>\n\n"
+    "static const unsigned char ${NAME}[] = {\n${lines}    0x00\n};\n"
+    "static const size_t ${NAME}_size = ${size};\n"
+)
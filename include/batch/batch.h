@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cpu/cpu.h>
+#include <database/database.h>
+#include <pool/thread_pool.h>
+
+#include <string>
+#include <vector>
+
+struct BatchResult {
+    std::string path;
+    std::string sha1;
+    std::string title;  // empty when the rom is not in the database
+    int system = -1;
+    uint64_t frames = 0;
+    uint64_t instructions = 0;
+    uint64_t invalid_opcodes = 0;
+    uint64_t stack_faults = 0;
+    uint64_t fetch_faults = 0;
+    double seconds = 0;
+    double mips = 0;
+    uint64_t screen_hash = 0;
+    std::string error;  // set if the rom could not be run
+};
+
+// Runs many independent CPU instances for a fixed number of frames across a work-stealing pool.
+// Each instance gets its config from the database (or a forced platform) before the program is placed.
+class BatchRunner {
+   public:
+    BatchRunner(const Database& db, unsigned threads = 0);
+
+    std::vector<BatchResult> run(const std::vector<std::string>& roms, uint64_t frames, int platform = -1);
+
+    unsigned threads();
+
+   private:
+    const Database& db;
+    ThreadPool pool;
+
+    BatchResult run_one(std::string path, uint64_t frames, int platform);
+};
+
+// expand directories (recursively) into the rom files they contain; plain files are kept as given
+std::vector<std::string> collect_roms(const std::vector<std::string>& paths);
+
+bool write_batch_json(std::string filepath, const std::vector<BatchResult>& results);
+bool write_batch_csv(std::string filepath, const std::vector<BatchResult>& results);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cpu/cpu.h>
+#include <database/database.h>
+#include <perf/perf_counters.h>
+
+#include <json.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// one rom run with one config
+struct BenchCase {
+    std::string name;
+    std::string rom;
+    int platform = -1;  // -1 uses the database config
+    uint64_t frames = 600;
+};
+
+struct BenchSummary {
+    double median = 0;
+    double p10 = 0;
+    double p90 = 0;
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double stddev = 0;
+};
+
+struct BenchResult {
+    BenchCase bench;
+    std::string sha1;
+    int system = -1;
+    uint64_t instructions = 0;  // per run
+    std::vector<double> mips;   // one sample per measured run
+    std::vector<double> fps;
+    BenchSummary mips_summary;
+    BenchSummary fps_summary;
+    bool profiled = false;
+    FrameProfiler::Report perf;  // from one extra run, so counter reads never slow the timed runs
+    std::string error;
+};
+
+// Times whole-ROM runs without a window, audio or pacing. Every run starts from a fresh machine and the
+// clock is only read around the frame loop, never inside it.
+class BenchRunner {
+   public:
+    BenchRunner(const Database& db, unsigned warmup = 2, unsigned runs = 10, bool perf = false);
+
+    BenchResult run(const BenchCase& bench);
+
+   private:
+    const Database& db;
+    unsigned warmup;
+    unsigned runs;
+    bool perf;
+};
+
+BenchSummary summarize(std::vector<double> samples);
+
+// suite file: {"frames": N, "cases": [{"rom": PATH, "platform": NAME, "frames": N, "name": NAME}]}
+bool load_bench_suite(std::string filepath, std::vector<BenchCase>& cases);
+std::string bench_case_name(std::string rom, int platform);
+
+json bench_to_json(const std::vector<BenchResult>& results);
+
+// compare median MIPS of every case present in both result sets; a case is a regression when it lost more
+// than threshold (0.05 = 5%). Writes a report and returns the number of regressions
+int compare_bench(const json& current, const json& baseline, double threshold, std::ostream& report);
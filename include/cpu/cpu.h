@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cpu/paged_memory.h>
+#include <perf/guest_profiler.h>
+#include <perf/metrics.h>
+#include <perf/trace_buffer.h>
+#include <perf/perf_counters.h>
 #include <json.hpp>
 #include <mutex>
 #include <atomic>
@@ -25,19 +30,30 @@
 #define NO_PRESS 0
 #define NO_RELEASE 255 
 
+// state shared between threads is kept on separate lines of this size so one thread's writes don't
+// invalidate what another is reading
+#define CACHE_LINE 64
+
+// binary save states: "NCST" little endian, bumped whenever the field list in CPU::state_fields changes
+#define CPU_STATE_MAGIC 0x5453434E
+#define CPU_STATE_VERSION 1
+// the whole address space, so states don't depend on how much of it a program touched
+#define CPU_STATE_MEMORY 0x10000
+
+class Debugger;
+class SharedState;
+
 class CPU {
    public:
     CPU();
 
+    // the framebuffer itself, held still for as long as the lock is; nothing is copied
     struct ScreenLock
     {
-        std::unique_lock<std::mutex> lock{};
-        std::array<std::uint8_t, SCREEN_SIZE> screen{};
+        std::unique_lock<ContendedMutex> lock{};
+        const std::array<std::uint8_t, SCREEN_SIZE>& screen;
     };
 
-    // each bit maps to keypress
-    uint16_t keys = 0;
-
     struct Quirks {
         bool shift = false;
         bool memory_increment_by_X = false;
@@ -84,17 +100,30 @@ class CPU {
 
     Config config; // *
 
-    
+    // running counters for headless drivers and tooling
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t instructions = 0;
+        uint64_t invalid_opcodes = 0;
+        uint64_t stack_faults = 0;
+        uint64_t fetch_faults = 0;
+    };
 
     // IO functionality
 
     int loadProgram(std::string filepath);
-    std::string hash_bin(int fileSize);
+    int load_program_data(const uint8_t* data, size_t size);
+    // load a prepared memory image; instances loaded from one image share its pages until they write
+    int load_image(const PagedMemory& image);
+    static PagedMemory build_image(const uint8_t* data, size_t size, uint16_t start_address);
+    static std::string hash_data(const uint8_t* data, size_t size);
 
     // Main CHIP8 Functionality
     void emulate_cycle();
     void emulate_loop();
+    void run_frame();
     void benchmark();
+    // also waits for a frame emulate_loop is running, so the caller can then load into memory
     void pause();
     void resume();
     void step();
@@ -104,81 +133,167 @@ class CPU {
 
     void press_key(uint8_t key);
     void release_key(uint8_t key);
+    void set_keys(uint16_t mask);
 
     // check for update and return screen if updated else return NULL
     ScreenLock get_screen();
+    const std::array<uint8_t, SCREEN_SIZE>& screen_view();
     bool check_screen();
-    std::array<uint8_t, SAMPLE_SIZE> gen_frame_samples();
-    void set_audio_callback(std::function<void(void)> callback);
+    // one frame of XO-CHIP pattern audio into out (SAMPLE_SIZE bytes)
+    void gen_frame_samples(uint8_t* out);
+    // called on the emulation thread after each frame with the sound timer running; a plain function and
+    // context so the call never goes through an allocating wrapper
+    void set_audio_callback(void (*callback)(void* context), void* context);
 
     bool check_stop();
     bool check_color();
 
     void set_config(Config config);
 
+    // read-only views of the machine state
+    uint16_t get_pc();
+    uint16_t get_index();
+    uint8_t get_register(uint8_t reg);
+    uint8_t get_plane();
+    uint8_t get_delay();
+    uint8_t get_sound();
+    // -1 when the stack is empty
+    int get_sp();
+    uint16_t get_stack(int level);
+    // keypad as a mask, bit n for key n
+    uint16_t get_keys();
+    bool is_lores();
+    uint8_t read_memory(uint16_t addr);
+    Stats get_stats();
+    void reset_stats();
+
+    void seed(uint32_t seed);
+
+    // attribute host counters to frame phases; null (the default) turns profiling off. The profiler must
+    // outlive the CPU or be detached first
+    void set_profiler(FrameProfiler* profiler);
+    // record what the emulated program executes and writes; null (the default) runs the plain loop
+    void set_guest_profiler(GuestProfiler* profiler);
+    // record every executed instruction into a ring; null (the default) runs the plain loop
+    void set_trace(TraceBuffer* trace);
+    // timing of the paced loop (emulate_loop) for the live overlay and metrics export
+    void set_metrics(RuntimeMetrics* metrics);
+    // breakpoints and watchpoints; the plain loop runs until the debugger has something armed
+    void set_debugger(Debugger* debugger);
+    // publish every frame to shared memory and take keypad input from it; null (the default) turns it off
+    void set_shared_state(SharedState* shared);
+    bool is_paused();
+
+    // copy of the whole machine (not the audio callback) sharing memory pages with this one.
+    // Call from the thread running this CPU
+    std::unique_ptr<CPU> fork();
+    const PagedMemory& get_memory();
+    // preallocate private memory pages so guest writes and reloads don't allocate (PagedMemory::reserve)
+    void reserve_pages(size_t count);
+
     void reset();
 
     nlohmann::json gen_save();
     int load_save(std::ifstream& file);
 
+    // Fixed size binary snapshot of the machine (config, registers, timers, input, stats, memory and screen)
+    // in host byte order, for frontends that save every frame (rewind, run-ahead). Not the audio callback
+    size_t state_size();
+    // writes exactly state_size() bytes
+    void save_state(uint8_t* out);
+    // false and the machine untouched when the size, magic or version don't match
+    bool load_state(const uint8_t* data, size_t size);
+
     void dump_reg();
 
    private:
-    std::array<uint8_t, MAX_MEM> memory {}; // *
-    std::array<uint8_t, SCREEN_SIZE> screen {}; // *
-    uint16_t PC; // *
+    // Registers touched by nearly every instruction, packed into one cache line. Only the emulation
+    // thread reads or writes them
+    alignas(CACHE_LINE) uint16_t PC; // *
     uint16_t I; // *
-    std::array<uint16_t, MAX_STACK> stack {}; // *
     int SP = -1; // *
     int delay = 0; // *
     int sound = 0; // *
     std::array<uint8_t, 16> registers {}; // *
+    uint32_t rng_state = 1;
+    uint8_t bit_plane = 0b01; // *
+    bool lores = true; // *
+    bool waiting = false;
+    // set by a draw for the vblank quirk, ends the frame's instruction loop
+    bool draw = false;
+    // copy of config.quirks for decode, refreshed by set_config, fork and load_state
+    Quirks quirks;
+
+    Stats stats;
+    std::array<uint16_t, MAX_STACK> stack {}; // *
+    PagedMemory memory; // *
 
     std::array<uint8_t, 16> flags {}; // *
 
     std::array<uint8_t, 128> audio_pattern {}; // *
     float playback_rate = 4000; // *
     float phase = 0; // *
-    std::function<void(void)> audio_callback;
+    void (*audio_callback)(void* context) = nullptr;
+    void* audio_context = nullptr;
 
-    bool lores = true; // *
+    // written by the emulation thread, read under screen_mtx by the frontend
+    alignas(CACHE_LINE) std::array<uint8_t, SCREEN_SIZE> screen {}; // *
 
-    uint8_t bit_plane = 0b01; // *
+    // Screen handoff: the emulation thread publishes a frame, the render thread polls for it every frame.
+    // Contention is counted for the metrics overlay
+    alignas(CACHE_LINE) ContendedMutex screen_mtx;
+    // bool if screen updated
+    std::atomic<bool> screen_update = false;
 
+    // Input mailbox: written from the key callback, read by the key instructions
+    alignas(CACHE_LINE) ContendedMutex key_mtx;
+    // each bit maps to keypress
+    uint16_t keys = 0;
     //keys currently pressed
     uint16_t pressed = NO_PRESS;
     //last released
     uint8_t released = NO_RELEASE;
 
-    bool waiting = false;
-
-    Quirks quirks;
-
-    std::mutex screen_mtx;
-    std::mutex key_mtx;
-
-    // flags
+    // Controls set from the frontend and read by the emulation thread every instruction or frame; they
+    // rarely change, so the line stays shared in every core's cache
 
     // flag to stop emulation
-    std::atomic<bool> stop = false;
-    // bool to notify if we drew
-    std::atomic<bool> draw = false;
-    // bool if screen updated
-    std::atomic<bool> screen_update = false;
+    alignas(CACHE_LINE) std::atomic<bool> stop = false;
+    std::atomic<bool> paused = false;
+    // emulate_loop is inside run_frame
+    std::atomic<bool> in_frame = false;
     //if colors updated in config
     std::atomic<bool> color_update = false;
 
-    std::atomic<bool> paused = false;
+    std::atomic<FrameProfiler*> profiler = nullptr;
+    std::atomic<GuestProfiler*> guest_profiler = nullptr;
+    std::atomic<TraceBuffer*> trace = nullptr;
+    std::atomic<RuntimeMetrics*> metrics = nullptr;
+    std::atomic<Debugger*> debugger = nullptr;
+    std::atomic<SharedState*> shared_state = nullptr;
+
+    // calls field(pointer, bytes) for every fixed size field of a binary state, in file order
+    template <typename Field>
+    void state_fields(Field&& field);
 
     // stack operations
     void push(uint16_t x);
     uint16_t pop();
     uint16_t peek();
 
+    void init_memory();
+
+    // keypad edges; called with key_mtx held
+    void key_down(uint8_t key);
+    void key_up(uint8_t key);
+
     // CHIP-8 Functionality
+    void invalid_opcode(uint16_t instruction);
     uint16_t fetch();
     void decode(uint16_t instruction);
     void decrementTimers();
+    void run_instructions();
+    void run_instructions_instrumented(GuestProfiler* guest, TraceBuffer* tracer, Debugger* checks);
 
     //[chip8] opcodes
     void clear();                                        // 00E0 Clear Screen
@@ -278,3 +393,7 @@ class CPU {
     void set_waveform();               // F002 load 16 byte audio pattern pointed by I into audio pattern buffer
     void set_pitch(uint8_t x_reg);                  // FX3A set playback rate to 4000*2^((vX-64)/48)Hz
 };
+
+// config as stored in save files
+void to_json(nlohmann::json& j, const CPU::Config& config);
+void from_json(const nlohmann::json& j, CPU::Config& config);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cpu/cpu.h>
+
+// Routines shared by every execution engine. The framebuffer kernels work on a raw WIDTH x HEIGHT
+// framebuffer of plane bits, so locking is left to the caller.
+
+// empty memory holding the small (0x50) and big (0xA0) fonts, shared by every instance
+const PagedMemory& boot_memory();
+
+// XOR a sprite onto the selected plane. sprite holds height rows of one byte (or two when width is 16).
+// vf is updated with the collision flag or, on systems that count them, the number of collided rows
+void draw_sprite(uint8_t* screen, const uint8_t* sprite, uint8_t plane, uint8_t vx, uint8_t vy, uint8_t width,
+                 uint8_t height, bool lores, const CPU::Quirks& quirks, uint8_t& vf);
+
+// clear the selected planes
+void clear_planes(uint8_t* screen, uint8_t planes);
+
+// scroll the selected planes by a number of hires pixels, filling with 0
+void scroll_planes_down(uint8_t* screen, uint8_t planes, uint8_t rows);
+void scroll_planes_up(uint8_t* screen, uint8_t planes, uint8_t rows);
+void scroll_planes_right(uint8_t* screen, uint8_t planes, uint8_t cols);
+void scroll_planes_left(uint8_t* screen, uint8_t planes, uint8_t cols);
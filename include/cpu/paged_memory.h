@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define PAGE_BITS 8
+#define PAGE_SIZE (1 << PAGE_BITS)
+#define PAGE_COUNT (0x10000 / PAGE_SIZE)
+
+// 64 KB of emulated memory split into pages that copies share until one of them writes (copy on write).
+// Copying a PagedMemory only copies the page table, so every instance of a ROM can point at one set of
+// font and program pages and forking an instance is cheap. Copies may be used from different threads,
+// but a PagedMemory must only be copied from the thread that writes to it.
+class PagedMemory {
+   public:
+    PagedMemory();
+    // copies share the pages but not the spares
+    PagedMemory(const PagedMemory& other);
+    // private pages this memory stops using go back to the spares (up to the reserved count)
+    PagedMemory& operator=(const PagedMemory& other);
+
+    uint8_t read(uint16_t addr) const {
+        return data[addr >> PAGE_BITS][addr & (PAGE_SIZE - 1)];
+    }
+
+    // big endian word, wrapping at the end of memory
+    uint16_t read16(uint16_t addr) const {
+        return (read(addr) << 8) | read(addr + 1);
+    }
+
+    void write(uint16_t addr, uint8_t val) {
+        size_t page = addr >> PAGE_BITS;
+        if (pages[page].use_count() != 1) own(page);
+        data[page][addr & (PAGE_SIZE - 1)] = val;
+    }
+
+    // copy a block in, only taking private copies of pages whose contents actually change
+    void copy_in(uint16_t addr, const uint8_t* src, size_t size);
+    void copy_out(uint16_t addr, uint8_t* dst, size_t size) const;
+
+    // point every page back at the shared zero page
+    void clear();
+
+    // pages only this memory references (what it costs on top of the shared pages)
+    size_t private_pages() const;
+
+    // allocate count pages up front for writes to take instead of the heap; with PAGE_COUNT spares
+    // writes and assignments never allocate, however the program uses memory
+    void reserve(size_t count);
+
+   private:
+    struct Page {
+        std::array<uint8_t, PAGE_SIZE> bytes{};
+    };
+
+    std::array<std::shared_ptr<Page>, PAGE_COUNT> pages;
+    // raw view of pages so reads skip the shared_ptr
+    std::array<uint8_t*, PAGE_COUNT> data;
+    // preallocated private pages, capacity fixed by reserve
+    std::vector<std::shared_ptr<Page>> spare;
+
+    void own(size_t page);
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary game catalog written by nacho-dbc from the JSON database and mapped read-only at runtime. All
+// sections are arrays of the fixed size records below (host byte order) referenced by offset from the
+// start of the file; strings live in one pool and are referenced by offset and length.
+
+#define CATALOG_MAGIC 0x5441434E  // "NCAT" little endian
+#define CATALOG_VERSION 1
+#define CATALOG_FILE "catalog.bin"
+
+// platforms.json, programs.json, quirks.json, sha1-hashes.json, in that order
+#define CATALOG_SOURCES 4
+#define CATALOG_QUIRKS 12
+#define CATALOG_COLORS 16
+
+struct CatalogString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// size and modification time of a JSON source when the catalog was compiled; a mismatch means the JSON
+// changed and the catalog is ignored
+struct CatalogSource {
+    uint64_t size;
+    int64_t mtime;
+};
+
+// a fully resolved CPU::Config
+struct CatalogConfig {
+    int32_t system;
+    int32_t speed;
+    uint16_t start_address;
+    uint8_t quirks[CATALOG_QUIRKS];  // in CPU::Quirks declaration order
+    uint8_t pad[2];
+    float colors[CATALOG_COLORS][3];
+};
+
+struct CatalogPlatform {
+    CatalogString id;  // "originalChip8", ...
+    CatalogString name;
+    CatalogConfig config;
+};
+
+struct CatalogProgram {
+    CatalogString title;
+    CatalogString description;
+    CatalogString release;
+    CatalogString authors;  // joined with ", "
+    uint32_t platforms;     // bit per platform index, over all of the program's roms
+    uint32_t pad;
+};
+
+// sorted by sha1 so lookups are a binary search
+struct CatalogRom {
+    uint8_t sha1[20];
+    uint32_t program;
+    CatalogString file;
+    uint32_t platforms;  // bit per platform index
+    int32_t platform;    // platform index the config was resolved for, -1 if none is supported
+    CatalogConfig config;
+};
+
+struct CatalogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t platform_count;
+    uint32_t program_count;
+    uint32_t rom_count;
+    uint32_t pad;
+    uint64_t platforms_offset;
+    uint64_t programs_offset;
+    uint64_t roms_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    CatalogSource sources[CATALOG_SOURCES];
+};
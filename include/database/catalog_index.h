@@ -0,0 +1,68 @@
+#pragma once
+
+#include <database/database.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// In-memory search index over the programs in the database. Title, authors and description are lowercased
+// into one haystack per program and every trigram of it gets a sorted posting list, so a query only
+// verifies the programs that contain all of its trigrams. Entries are kept in title order and results
+// come out in that order.
+class CatalogIndex {
+   public:
+    struct Entry {
+        std::string title;
+        std::string authors;
+        std::string description;
+        std::string release;
+        int year = 0;          // 0 if the release has no year
+        uint32_t platforms = 0;  // bit per platform index
+        std::string platform_text;  // platform names joined for display
+        std::vector<std::string> roms;
+        std::vector<std::string> files;
+    };
+
+    struct Query {
+        std::string text;        // whitespace separated words, all must appear (case insensitive)
+        uint32_t platforms = 0;  // any of these platforms, 0 for all
+        int min_year = 0;        // 0 for no bound; undated programs are left out once a bound is set
+        int max_year = 0;
+    };
+
+    CatalogIndex() = default;
+    explicit CatalogIndex(const Database& db);
+
+    void build(const Database& db);
+
+    // entry ids in title order; reuses results and the index's scratch buffers, so after the first few
+    // queries it no longer allocates
+    void search(const Query& query, std::vector<uint32_t>& results);
+
+    const Entry& entry(uint32_t id) const;
+    size_t size() const;
+    const std::vector<std::string>& platform_names() const;
+
+   private:
+    struct Gram {
+        uint32_t key;
+        uint32_t start;
+        uint32_t count;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<std::string> haystacks;
+    std::vector<Gram> grams;  // sorted by key
+    std::vector<uint32_t> postings;
+    std::vector<std::string> names;
+
+    // scratch for search
+    std::string lowered;
+    std::vector<std::string_view> words;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> narrowed;
+
+    const Gram* find_gram(uint32_t key) const;
+    bool matches(uint32_t id, const Query& query) const;
+};
@@ -1,25 +1,74 @@
+#pragma once
+
 #include <cpu/cpu.h>
+#include <database/catalog.h>
+#include <io/mapped_file.h>
 
 #include <json.hpp>
 using json = nlohmann::json;
 
+// compiled catalog written by the build (see nacho-dbc); empty means always parse the JSON
+#ifndef NACHO_CATALOG
+#define NACHO_CATALOG ""
+#endif
+
 class Database {
    public:
-    Database(std::string dat_dir);
+    // maps the compiled catalog if it was built from the JSON currently in dat_dir, otherwise parses the JSON
+    Database(std::string dat_dir, std::string catalog_path = NACHO_CATALOG);
+
+    CPU::Config gen_config(std::string hash) const;
+    CPU::Config gen_platform_config(int platform) const;
+    std::string get_title(std::string hash) const;
+    // true if the rom is in the database on a platform the emulator supports
+    bool is_supported(std::string hash) const;
+
+    // program metadata for browsing the catalog
+    struct ProgramInfo {
+        std::string title;
+        std::string description;
+        std::string release;
+        std::string authors;  // joined with ", "
+        uint32_t platforms = 0;  // bit per platform index
+        std::vector<std::string> roms;   // sha1 of each rom
+        std::vector<std::string> files;  // file name of each rom
+    };
+    std::vector<ProgramInfo> list_programs() const;
+    // display name of every platform, by platform index
+    std::vector<std::string> platform_names() const;
 
-    CPU::Config gen_config(std::string hash);
-    CPU::Config gen_platform_config(int platform);
+    // true if lookups go through the mapped catalog
+    bool is_compiled() const;
+
+    // compile the JSON in dat_dir into a catalog at output; false with a message on cerr on failure
+    static bool compile_catalog(std::string dat_dir, std::string output);
 
    private:
+    std::string data_dir;
+
+    // compiled catalog, valid when catalog.is_open()
+    MappedFile catalog;
+    const CatalogHeader* header = nullptr;
+    const CatalogPlatform* catalog_platforms = nullptr;
+    const CatalogProgram* catalog_programs = nullptr;
+    const CatalogRom* catalog_roms = nullptr;
+    const char* strings = nullptr;
+
+    // JSON fallback, only parsed when there is no usable catalog
     json sha1_hashes;
     json programs;
     json quirk_list;
     json platforms;
 
-    int game_index;
-    int platform;
+    bool open_catalog(const std::string& path);
+    void load_json();
+    const CatalogRom* find_rom(const std::string& hash) const;
+    std::string catalog_string(CatalogString s) const;
+
+    // resolves the config for a rom in the JSON; returns the program index or -1, platform -1 if unsupported
+    int resolve_rom(const std::string& hash, CPU::Config& config, int& platform) const;
 
-    void set_platform_quirks(CPU::Config& config, int platform);
-    void set_game_quirks(CPU::Config& config, json& game_rom);
-    std::array<float, 3> hex_to_rgb(std::string hex);
-};
\ No newline at end of file
+    void set_platform_quirks(CPU::Config& config, int platform) const;
+    void set_game_quirks(CPU::Config& config, const json& game_rom) const;
+    std::array<float, 3> hex_to_rgb(std::string hex) const;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <headless/headless.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define DEBUG_NO_PC 0x10000
+
+// PC and condition breakpoints, memory watchpoints, framebuffer-change breaks and run-to-frame.
+//
+// Attaching a debugger costs nothing until something is armed: the CPU picks up the armed state once per
+// frame and only switches to its instrumented loop while a breakpoint, watchpoint or screen break exists.
+// A hit pauses the CPU before a breakpoint's instruction runs, or after the instruction that touched a
+// watched range or changed the screen.
+class Debugger {
+   public:
+    struct Breakpoint {
+        uint32_t pc = DEBUG_NO_PC;  // DEBUG_NO_PC: checked at every instruction
+        bool conditional = false;
+        Headless::Condition condition;
+    };
+
+    // inclusive address range
+    struct Watchpoint {
+        uint16_t first = 0;
+        uint16_t last = 0;
+        bool read = false;
+        bool write = true;
+    };
+
+    struct Hit {
+        enum Type { NONE, BREAKPOINT, READ, WRITE, SCREEN, FRAME };
+        Type type = NONE;
+        uint16_t pc = 0;           // instruction that stopped (or the next one for FRAME)
+        uint16_t instruction = 0;
+        uint16_t addr = 0;         // first watched byte touched
+        uint64_t frame = 0;
+    };
+
+    // Armed state as the emulation thread sees it. Edits publish a new copy so checks never lock
+    struct Armed {
+        std::array<uint64_t, 1024> pcs{};  // one bit per address with a breakpoint
+        std::vector<Breakpoint> breakpoints;
+        std::vector<Watchpoint> watchpoints;
+        bool screen = false;
+        uint64_t frame = 0;  // run-to-frame target, 0 if none
+
+        bool per_instruction() const;
+        bool at(uint16_t pc) const { return (pcs[pc >> 6] >> (pc & 63)) & 1; }
+    };
+
+    // editing, from any thread
+    void add_breakpoint(uint32_t pc);
+    void add_breakpoint(uint32_t pc, Headless::Condition condition);
+    void remove_breakpoint(size_t index);
+    void add_watchpoint(Watchpoint watch);
+    void remove_watchpoint(size_t index);
+    void break_on_screen_change(bool enabled);
+    // pause once the CPU has run this many frames; 0 cancels
+    void run_to_frame(uint64_t frame);
+    void clear();
+
+    std::shared_ptr<const Armed> armed() const;
+    Hit last_hit() const;
+    // bumped on every hit so frontends can notice one
+    uint64_t hits() const;
+
+    // emulation thread. begin_frame returns true when instructions need checking this frame; before and
+    // after return true when the CPU should pause
+    bool begin_frame();
+    bool before(CPU& cpu, uint16_t pc, uint16_t instruction);
+    bool after(CPU& cpu, uint16_t pc, uint16_t instruction);
+    bool end_frame(CPU& cpu, uint64_t frame);
+
+    // "pc=0x2a4" plus an optional condition ("0x2a4 if v3==0x10"), or a condition alone
+    static bool parse_breakpoint(std::string text, Breakpoint& breakpoint);
+    // "0x300", "0x300-0x30f" with an optional ":r", ":w" or ":rw" suffix (default write)
+    static bool parse_watchpoint(std::string text, Watchpoint& watch);
+    static std::string describe(const Hit& hit);
+    static std::string describe(const Breakpoint& breakpoint);
+    static std::string describe(const Watchpoint& watch);
+
+   private:
+    mutable std::mutex mtx;
+    std::shared_ptr<const Armed> published = std::make_shared<Armed>();
+    std::atomic<uint64_t> version{0};
+    Hit hit;
+    std::atomic<uint64_t> hit_count{0};
+
+    // emulation thread only
+    std::shared_ptr<const Armed> current = published;
+    uint64_t seen = 0;
+    uint32_t resume_pc = DEBUG_NO_PC;  // breakpoint we stopped at, skipped once when execution continues
+    std::vector<bool> was_true;       // condition-only breakpoints fire when they become true
+    uint16_t read_first = 0, read_last = 0, write_first = 0, write_last = 0;
+    bool reads = false, writes = false, draws = false;
+    std::array<uint8_t, SCREEN_SIZE> screen_before{};
+
+    void publish(const Armed& armed);
+    void record(Hit::Type type, uint16_t pc, uint16_t instruction, uint16_t addr, uint64_t frame);
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cpu/cpu.h>
+#include <database/database.h>
+#include <pool/thread_pool.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// frames each candidate runs for
+#define DETECT_FRAMES 300
+// synthetic input: one key held for DETECT_HOLD frames every DETECT_PERIOD frames
+#define DETECT_PERIOD 20
+#define DETECT_HOLD 6
+
+// Picks a config for ROMs the database doesn't know. Every platform profile and a few quirk variants of
+// each run the ROM headless at the same time on a thread pool with synthetic input, and each run is
+// scored on how plausible it looked: faults and a PC outside the program count against it, a screen
+// that changes counts for it and a screen of noise against it. The winner is cached by SHA-1.
+class QuirkDetector {
+   public:
+    struct Candidate {
+        std::string name;  // "schip", "chip8 +shift", ...
+        CPU::Config config;
+    };
+
+    struct Result {
+        Candidate candidate;
+        double score = 0;
+        uint64_t instructions = 0;
+        uint64_t invalid_opcodes = 0;
+        uint64_t stack_faults = 0;
+        uint64_t fetch_faults = 0;
+        uint64_t stray_frames = 0;    // frames that ended with PC outside the program
+        uint64_t changed_frames = 0;  // frames that changed the screen
+        double lit = 0;               // mean fraction of lit pixels
+        bool halted = false;
+    };
+
+    // an empty cache path keeps detections in memory only
+    QuirkDetector(const Database& db, std::string cache_path, unsigned threads = 0);
+
+    // the cached config for sha1, or the best candidate (which is then cached)
+    CPU::Config detect(const uint8_t* data, size_t size, const std::string& sha1);
+    // every candidate run and scored, best first; not cached
+    std::vector<Result> rank(const uint8_t* data, size_t size);
+    bool cached(const std::string& sha1, CPU::Config& config);
+
+    void set_frames(uint64_t frames);
+
+   private:
+    const Database& db;
+    std::string cache_path;
+    ThreadPool pool;
+    uint64_t frames = DETECT_FRAMES;
+    std::vector<Candidate> candidates;
+
+    std::unordered_map<std::string, CPU::Config> cache;
+    std::mutex cache_mtx;
+
+    Result run(const Candidate& candidate, const uint8_t* data, size_t size);
+    void save_cache();
+};
+
+std::string detect_result_to_text(const QuirkDetector::Result& result);
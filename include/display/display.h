@@ -3,8 +3,15 @@
 #include <GLFW/glfw3.h>
 #include <gui/gui.h>
 #include <miniaudio.h>
+#include <perf/alloc_counter.h>
+#include <perf/metrics.h>
+#include <perf/startup.h>
 #include <shaders/shader.h>
 
+#include <array>
+#include <memory>
+#include <string>
+
 #define DEVICE_FORMAT ma_format_u8
 #define DEVICE_CHANNELS 1 
 #define WAVEFORM_TYPE ma_waveform_type_square
@@ -13,6 +20,12 @@
 #define SCALE 10
 #define OFFSET 2 
 
+// timer queries in flight; results are read a few frames late so the GPU is never waited on
+#define GPU_QUERIES 3
+
+// linked shader program kept between runs; see Shader::fromSource
+#define SHADER_CACHE "shader.cache"
+
 class Display {
    public:
     Display(CPU& cpu);
@@ -23,17 +36,32 @@ class Display {
 
     void terminate();
 
+    // publish runtime metrics to a file or "unix:PATH" socket in Prometheus text format
+    void export_metrics(std::string target);
+
    private:
     CPU& core;
 
-    GUI gui;
+    // constructed first so it times the whole of startup
+    StartupTimeline startup;
+
+    // created once the window exists and the database has loaded
+    std::unique_ptr<GUI> gui;
+
+    RuntimeMetrics metrics;
+    std::unique_ptr<MetricsExporter> exporter;
+    std::array<unsigned int, GPU_QUERIES> gpu_queries {};
+    uint64_t presented = 0;
 
     GLFWwindow* window = NULL;
     Shader shader;
+    std::array<int, 16> color_locations {};
 
     ma_device device;
     ma_pcm_rb rb;
     ma_waveform beepWF;
+    // one frame of samples, filled on the emulation thread before it goes into the ring buffer
+    std::array<uint8_t, SAMPLE_SIZE> samples {};
 
     unsigned int VAO;
     unsigned int VBO;
@@ -45,6 +73,8 @@ class Display {
 
     void init_audio();
 
+    double read_gpu_time();
+
     void write_samples_callback(); 
 
     static void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cpu/cpu.h>
+#include <headless/headless.h>
+#include <pool/thread_pool.h>
+
+#include <memory>
+#include <vector>
+
+// Vectorized environment for training agents: N independent instances of one ROM that are reset and
+// stepped together across a thread pool. Observations for every instance are written into one
+// contiguous caller provided buffer. Once constructed, reset() and step() never allocate: each instance
+// has a full set of spare memory pages (64 KB) that guest writes take and resets hand back.
+class VecEnv {
+   public:
+    enum FrameFormat {
+        PACKED,      // 128x64, one bit per lit pixel, MSB first (1024 bytes)
+        LORES_BYTES, // 64x32, one byte per pixel holding the plane bits
+        HIRES_BYTES, // 128x64, one byte per pixel holding the plane bits
+    };
+
+    // reward read from emulated memory after each step
+    struct RewardHook {
+        enum Kind { VALUE, DELTA };
+        uint16_t addr = 0;
+        uint8_t width = 1;  // 1 or 2 bytes, big endian like the CHIP-8 itself
+        Kind kind = DELTA;  // DELTA rewards the change since the previous step (score counters)
+        float scale = 1.0f;
+    };
+
+    VecEnv(std::vector<uint8_t> rom, CPU::Config config, size_t num_envs, FrameFormat format = PACKED,
+           unsigned threads = 0, uint32_t seed = 1);
+
+    // must be set up before the first reset
+    void add_reward_hook(RewardHook hook);
+    void add_done_condition(Headless::Condition condition);
+
+    size_t size();
+    size_t frame_bytes();
+
+    // reset the instances selected by mask (all if mask is null) and write their observations
+    void reset(uint8_t* frames_out, const uint8_t* mask = nullptr);
+
+    // hold actions[i] (keypad bitmask) for frame_skips[i] frames (at least one) on every instance.
+    // frames_out holds size() * frame_bytes() bytes; rewards and dones may be null
+    void step(const uint16_t* actions, const uint32_t* frame_skips, uint8_t* frames_out, float* rewards,
+              uint8_t* dones);
+
+   private:
+    std::vector<uint8_t> rom;
+    // fonts + rom; every reset points the instance back at these shared pages
+    PagedMemory image;
+    CPU::Config config;
+    FrameFormat format;
+    uint32_t seed;
+
+    std::vector<std::unique_ptr<CPU>> envs;
+    std::vector<RewardHook> hooks;
+    std::vector<Headless::Condition> done_conditions;
+    // previous value of every hook per instance, hooks.size() entries per instance
+    std::vector<uint16_t> hook_values;
+    // per instance episode counter so reseeded instances don't replay the same random stream
+    std::vector<uint32_t> episodes;
+
+    ThreadPool pool;
+
+    void reset_one(size_t env, uint8_t* frame_out);
+    void step_one(size_t env, uint16_t action, uint32_t frame_skip, uint8_t* frame_out, float* reward,
+                  uint8_t* done);
+    uint16_t read_hook(CPU& cpu, const RewardHook& hook);
+    void write_frame(CPU& cpu, uint8_t* out);
+};
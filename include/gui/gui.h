@@ -1,22 +1,99 @@
 #include <cpu/cpu.h>
+#include <database/catalog_index.h>
 #include <database/database.h>
+#include <debug/debugger.h>
+#include <detect/detector.h>
+#include <library/library.h>
 #include <GLFW/glfw3.h>
 
+#include <future>
+#include <memory>
+
+// seconds between rebuilds of the trace and guest profile views
+#define VIEW_REFRESH 0.25
+// guest profile heatmap cell, in bytes
+#define PROFILE_BLOCK 16
+#define HOT_PCS 32
+
 class GUI {
    public:
-    GUI(CPU& cpu);
+    // the database is loaded by the caller, off the thread that creates the window
+    GUI(CPU& cpu, Database&& database);
+    ~GUI();
 
     void init_gui(GLFWwindow* window);
     void update();
     void render();
 
+    // live numbers for the performance overlay, owned by the frontend
+    void set_metrics(RuntimeMetrics* metrics);
+
    private:
     CPU& core;
     Database db;
+    // roms under games/, identified in the background and rescanned every few seconds
+    RomLibrary library;
+    // configs for roms the database doesn't support; detection runs off the UI thread and the
+    // program is loaded once it finishes
+    QuirkDetector detector;
+    std::future<CPU::Config> detecting;
+    std::vector<uint8_t> detecting_rom;
+    // detections replaced by a later load; destroying an async future blocks, so they are kept until done
+    std::vector<std::future<CPU::Config>> superseded;
+    FrameProfiler profiler;
+    // allocated the first time the guest profile window opens
+    std::unique_ptr<GuestProfiler> guest_profiler;
+    // guest profile views, rebuilt every VIEW_REFRESH seconds rather than every frame
+    double profile_refreshed = -VIEW_REFRESH;
+    std::array<uint64_t, 0x10000 / PROFILE_BLOCK> profile_executed{};
+    std::array<bool, 0x10000 / PROFILE_BLOCK> profile_written{};
+    uint64_t profile_hottest = 1;
+    std::vector<std::pair<uint64_t, uint16_t>> hot_pcs;
+    std::array<uint64_t, OPCODE_CLASSES> class_histogram{};
+    std::array<int, OPCODE_CLASSES> class_order{};
+    std::vector<GuestProfiler::Subroutine> profile_subroutines;
+    RuntimeMetrics* metrics = nullptr;
+    std::unique_ptr<TraceBuffer> trace;
+    // newest entries shown by the trace window, refreshed like the profile views
+    std::vector<TraceEntry> trace_entries;
+    double trace_refreshed = -VIEW_REFRESH;
+    // attached for the whole session; costs nothing until something is armed
+    Debugger debugger;
+    std::array<char, 48> breakpoint_text{};
+    std::array<char, 48> watch_text{};
+    bool break_screen {false};
+    uint64_t target_frame = 0;
+
+    // catalog browser; the index is built on a worker thread at startup
+    std::future<std::unique_ptr<CatalogIndex>> catalog_future;
+    std::unique_ptr<CatalogIndex> catalog;
+    CatalogIndex::Query catalog_query;
+    std::array<char, 128> search_text{};
+    std::vector<uint32_t> catalog_results;
+    bool catalog_dirty {true};
+    double search_us = 0;
+    int selected_program = -1;
 
     CPU::Config curr_config = core.config;
 
     //Imgui flags
     
     bool show_config {false};
+    bool show_perf {false};
+    bool perf_per_minstr {false};
+    bool show_guest_profile {false};
+    bool show_overlay {false};
+    bool show_trace {false};
+    bool show_breakpoints {false};
+    bool show_catalog {false};
+
+    void perf_window();
+    void guest_profile_window();
+    void refresh_profile(const GuestProfiler& guest);
+    void overlay_window();
+    void trace_window();
+    void breakpoint_window();
+    void catalog_window();
+
+    void load_game(const std::string& path);
 };
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cpu/cpu.h>
+#include <database/database.h>
+#include <detect/detector.h>
+
+#include <string>
+#include <vector>
+
+// Drives a CPU without a window, audio device or pacing. Frames run back to back
+// with scripted keypad input, stopping after a frame budget or a stop condition.
+class Headless {
+   public:
+    Headless(CPU& cpu);
+
+    struct InputEvent {
+        uint64_t frame = 0;
+        uint8_t key = 0;
+        bool pressed = true;
+    };
+
+    // conditions are checked at frame boundaries
+    struct Condition {
+        enum Type { PC, HALT, REG, MEM };
+        Type type = HALT;
+        uint16_t addr = 0;  // PC value, register index or memory address
+        uint8_t val = 0;
+    };
+
+    // loads a program and resolves its config from the database (or the given platform when >= 0)
+    int load(std::string filepath, Database& db, int platform = -1);
+    // the same for a program already in memory
+    int load_data(const uint8_t* data, size_t size, Database& db, int platform = -1);
+    // the same with the hash already known
+    int load_data(const uint8_t* data, size_t size, Database& db, int platform, std::string sha1);
+
+    // roms the database doesn't support get their config from the detector instead of the defaults
+    void set_detector(QuirkDetector* detector);
+
+    void add_input(InputEvent event);
+    int load_input_script(std::string filepath);
+    void add_condition(Condition condition);
+
+    // run until max_frames have passed, a condition is met or the core pauses; returns frames run
+    uint64_t run(uint64_t max_frames);
+    bool condition_met();
+
+    std::string get_hash();
+
+   private:
+    CPU& core;
+
+    std::vector<InputEvent> inputs;
+    size_t next_input = 0;
+    std::vector<Condition> conditions;
+    uint64_t frame = 0;
+
+    std::string hash;
+    QuirkDetector* detector = nullptr;
+
+    void apply_inputs();
+};
+
+bool check_condition(CPU& cpu, const Headless::Condition& condition);
+
+// read a script of "<frame> press|release <key>" lines in file order; returns -1 on error
+int read_input_script(std::string filepath, std::vector<Headless::InputEvent>& events);
+
+// chip8, schip, schip1.1 or xochip to the platform id; -1 if unknown
+int parse_platform(std::string name);
+std::string platform_name(int platform);
+
+// parse "pc=0x2a4", "halt", "v3=0x10" (or "V3 == 0x10") or "mem@0x300=1"; returns false if malformed
+bool parse_condition(std::string text, Headless::Condition& condition);
+
+// FNV-1a hash of the framebuffer, stable across runs and hosts
+uint64_t hash_screen(const std::array<uint8_t, SCREEN_SIZE>& screen);
+std::string hash_to_hex(uint64_t hash);
+
+// write the framebuffer as a binary PPM using the config palette
+bool write_screen_ppm(std::string filepath, const std::array<uint8_t, SCREEN_SIZE>& screen,
+                      const CPU::Config& config);
+
+// render the framebuffer as text, one character per pixel
+std::string screen_to_ascii(const std::array<uint8_t, SCREEN_SIZE>& screen);
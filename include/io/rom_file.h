@@ -0,0 +1,39 @@
+#pragma once
+
+#include <io/mapped_file.h>
+
+#include <openssl/evp.h>
+
+#include <string>
+
+// Incremental SHA-1 through the EVP interface (the one-shot SHA1() is deprecated in OpenSSL 3)
+class Sha1Stream {
+   public:
+    Sha1Stream();
+    ~Sha1Stream();
+    Sha1Stream(const Sha1Stream&) = delete;
+    Sha1Stream& operator=(const Sha1Stream&) = delete;
+
+    void update(const uint8_t* data, size_t size);
+    // lowercase hex digest; the stream can't be updated afterwards
+    std::string hex();
+
+   private:
+    EVP_MD_CTX* ctx;
+};
+
+// A ROM file mapped read-only and hashed in one pass over the mapping. Loading copies straight from the
+// mapped pages into emulated memory, so the file is never read into an intermediate buffer.
+class RomFile {
+   public:
+    // false with a message on cerr if the file is missing or empty; the size is checked when loading
+    bool open(const std::string& path);
+
+    const uint8_t* data() const { return file.data(); }
+    size_t size() const { return file.size(); }
+    const std::string& sha1() const { return hash; }
+
+   private:
+    MappedFile file;
+    std::string hash;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <database/database.h>
+#include <pool/thread_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define LIBRARY_CACHE_HEADER "nacho-library 1"
+
+struct LibraryRom {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    std::string sha1;
+    std::string title;  // empty when the rom is not in the database
+};
+
+// ROM files under a set of directories, identified against the database. Hashing runs across a thread
+// pool, and hashes are kept in a cache file keyed by path, size and mtime so a rescan only reads files
+// that changed. The cache is loaded up front, so the last known library is available before any scan.
+class RomLibrary {
+   public:
+    struct ScanStats {
+        size_t files = 0;
+        size_t hashed = 0;   // read and hashed this scan
+        size_t cached = 0;   // unchanged since the cache was written
+        size_t removed = 0;  // in the cache but gone from disk
+        size_t matched = 0;  // found in the database
+        double seconds = 0;
+    };
+
+    // an empty cache path keeps the hashes in memory only
+    RomLibrary(const Database& db, std::string cache_path, unsigned threads = 0);
+    ~RomLibrary();
+
+    void add_directory(std::string dir);
+
+    // read the cache file; false if there is none or it is unreadable
+    bool load_cache();
+    // walk the directories now, hash what changed and rewrite the cache if anything did
+    ScanStats scan();
+
+    // rescan on a background thread every interval, starting immediately
+    void watch(std::chrono::milliseconds interval);
+    void stop_watching();
+
+    // sorted by path
+    std::vector<LibraryRom> roms() const;
+    // a path with this hash, or empty
+    std::string find(const std::string& sha1) const;
+    // changes whenever the list of roms does
+    uint64_t generation() const;
+    unsigned threads();
+
+   private:
+    const Database& db;
+    std::string cache_path;
+    ThreadPool pool;
+
+    std::vector<std::string> directories;
+    std::vector<LibraryRom> library;
+    std::unordered_map<std::string, size_t> by_path;
+    std::unordered_map<std::string, size_t> by_sha1;
+    mutable std::mutex library_mtx;
+    std::atomic<uint64_t> changes = 0;
+    // one scan at a time
+    std::mutex scan_mtx;
+
+    std::thread watcher;
+    std::mutex watch_mtx;
+    std::condition_variable watch_wake;
+    bool watching = false;
+
+    void publish(std::vector<LibraryRom> roms);
+    bool save_cache(const std::vector<LibraryRom>& roms);
+};
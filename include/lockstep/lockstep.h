@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cpu/cpu.h>
+
+#include <memory>
+#include <vector>
+
+#define MAX_LANES 64
+
+// Runs up to MAX_LANES instances of one program side by side. Registers, PC, I and timers are stored
+// as structure of arrays (one row of MAX_LANES bytes per register) so that while every running lane
+// sits on the same instruction, register-only opcodes execute once for all lanes with SIMD. Once lanes
+// diverge (different PC or self-modified code) each lane is stepped on its own by a scalar decoder
+// that mirrors CPU::decode, until they meet again.
+class LockstepEngine {
+   public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t vector_steps = 0;         // instructions issued once for every running lane
+        uint64_t vector_instructions = 0;  // lane instructions retired by those steps
+        uint64_t scalar_instructions = 0;  // lane instructions retired one lane at a time
+    };
+
+    LockstepEngine(CPU::Config config, size_t lanes);
+
+    // load the same program into every lane and reset it; returns the program size or < 0 on error
+    int load(const uint8_t* data, size_t size);
+    void seed(size_t lane, uint32_t seed);
+    void set_keys(size_t lane, uint16_t mask);
+
+    // run one 60Hz frame on every lane, same semantics as CPU::run_frame
+    void run_frame();
+
+    size_t size();
+    Stats get_stats();
+    void reset_stats();
+
+    // per lane views of the machine state
+    CPU::Stats get_lane_stats(size_t lane);
+    uint16_t get_pc(size_t lane);
+    uint16_t get_index(size_t lane);
+    uint8_t get_register(size_t lane, uint8_t reg);
+    uint8_t get_delay(size_t lane);
+    uint8_t get_sound(size_t lane);
+    int get_sp(size_t lane);
+    uint16_t get_stack(size_t lane, int level);
+    uint8_t read_memory(size_t lane, uint16_t addr);
+    const std::array<uint8_t, SCREEN_SIZE>& screen_view(size_t lane);
+    const PagedMemory& get_memory(size_t lane);
+
+   private:
+    // state the vector path never touches
+    struct Lane {
+        PagedMemory memory;
+        std::array<uint8_t, SCREEN_SIZE> screen{};
+        std::array<uint16_t, MAX_STACK> stack{};
+        int SP = -1;
+        std::array<uint8_t, 16> flags{};
+        std::array<uint8_t, 128> audio_pattern{};
+        float playback_rate = 4000;
+        float phase = 0;
+        bool lores = true;
+        uint8_t bit_plane = 0b01;
+        uint16_t keys = 0;
+        uint16_t pressed = NO_PRESS;
+        uint8_t released = NO_RELEASE;
+        bool waiting = false;
+        uint32_t rng_state = 1;
+        CPU::Stats stats;
+    };
+
+    CPU::Config config;
+    size_t lanes;
+    std::vector<std::unique_ptr<Lane>> cold;
+
+    // hot state, one row per register
+    alignas(32) uint8_t V[16][MAX_LANES] = {};
+    alignas(32) uint8_t delay[MAX_LANES] = {};
+    alignas(32) uint8_t sound[MAX_LANES] = {};
+    alignas(32) uint16_t PC[MAX_LANES] = {};
+    alignas(32) uint16_t I[MAX_LANES] = {};
+    alignas(32) uint64_t retired[MAX_LANES] = {};
+
+    // 0xFF for lanes still running this frame, rebuilt when the running set changes
+    alignas(32) uint8_t lane_mask[MAX_LANES] = {};
+    uint64_t mask_bits = 0;
+
+    // lanes whose last draw ends the frame (vblank quirk), kept across frames like CPU::draw
+    uint64_t drawn = 0;
+
+    Stats stats;
+
+    uint64_t all_lanes();
+    void set_mask(uint64_t running);
+    uint16_t opcode_at(size_t lane, uint16_t addr);
+    bool vectorizable(uint16_t instruction);
+    uint64_t group_of(uint64_t pending, uint16_t pc, uint16_t instruction);
+
+    void step(uint64_t running);
+    void execute_vector(uint16_t instruction, uint64_t group);
+    void skip_lanes(uint64_t group);
+
+    // scalar path
+    uint16_t fetch(size_t lane);
+    void skip(size_t lane);
+    void execute(size_t lane, uint16_t instruction);
+    void execute_system(size_t lane, uint16_t instruction);
+    void execute_misc(size_t lane, uint16_t instruction);
+    void draw(size_t lane, uint8_t x_reg, uint8_t y_reg, uint8_t height);
+    void write(size_t lane, uint16_t addr, uint8_t val);
+};
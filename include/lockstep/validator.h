@@ -0,0 +1,63 @@
+#pragma once
+
+#include <headless/headless.h>
+#include <lockstep/lockstep.h>
+#include <perf/trace_buffer.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// instructions of the reference trace kept for the divergence report
+#define VALIDATE_TRACE 256
+// differing memory bytes listed before the rest are only counted
+#define VALIDATE_MEMORY_DIFFS 8
+
+// Differential validation of the lockstep engine against the reference interpreter (CPU::decode). Every
+// lane gets its own reference CPU with the same program, config, seed and input; after each frame the two
+// are compared on registers, I, PC, stack, timers, instruction count, memory and screen. The first frame
+// that differs stops the run with only the fields that differ and the reference's instructions in it.
+class LockstepValidator {
+   public:
+    struct Divergence {
+        uint64_t frame = 0;  // frames completed when the difference showed up
+        size_t lane = 0;
+        std::vector<std::string> diffs;  // "field: reference X, engine Y"
+        std::vector<TraceEntry> trace;   // reference instructions of that frame (the newest VALIDATE_TRACE)
+    };
+
+    LockstepValidator(CPU::Config config, size_t lanes);
+
+    // returns the program size or < 0 on error. Lane n is seeded n + 1
+    int load(const uint8_t* data, size_t size);
+    // the same input for every lane
+    void add_input(Headless::InputEvent event);
+
+    // run until max_frames or the first divergence; false if one was found
+    bool run(uint64_t max_frames);
+
+    uint64_t frames();
+    size_t size();
+    const Divergence& divergence();
+    LockstepEngine& engine();
+
+   private:
+    CPU::Config config;
+    LockstepEngine fast;
+    std::vector<std::unique_ptr<CPU>> reference;
+    std::vector<std::unique_ptr<TraceBuffer>> traces;
+
+    std::vector<Headless::InputEvent> inputs;
+    size_t next_input = 0;
+    uint16_t keys = 0;
+    uint64_t frame = 0;
+
+    Divergence found;
+    std::vector<uint8_t> reference_bytes;
+    std::vector<uint8_t> engine_bytes;
+
+    void apply_inputs();
+    bool compare(size_t lane);
+};
+
+std::string divergence_to_text(const LockstepValidator::Divergence& divergence);
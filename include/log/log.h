@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+#define LOG_OFF 4
+
+// messages per call site per second before the rest are only counted
+#define LOG_SITE_RATE 10
+#define LOG_QUEUE_SIZE 1024
+#define LOG_MESSAGE_SIZE 112
+
+// One logging statement. Sites are static objects created on first use and linked into a global list
+// so their counters can be listed.
+struct LogSite {
+    LogSite(const char* file, int line, int level);
+
+    const char* file;
+    int line;
+    int level;
+    std::atomic<uint64_t> count{0};       // every call that passed the level filter
+    std::atomic<uint64_t> suppressed{0};  // calls dropped by the rate limit
+    std::atomic<int64_t> window{-1};      // second the current rate window started
+    std::atomic<uint32_t> in_window{0};
+    std::atomic<uint32_t> pending{0};  // suppressed since the last message that got through
+    LogSite* next = nullptr;
+};
+
+struct LogCounter {
+    std::string file;
+    int line;
+    int level;
+    uint64_t count;
+    uint64_t suppressed;
+};
+
+// Severity filter checked inline, so filtered statements cost one relaxed load. Messages that pass are
+// formatted on the calling thread into a fixed slot of a lock free queue and written to stderr by a
+// background thread; a full queue drops the message and counts it instead of blocking.
+namespace logging {
+extern std::atomic<int> level;
+
+inline bool enabled(int message_level) {
+    return message_level >= level.load(std::memory_order_relaxed);
+}
+
+void write(LogSite& site, const char* format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+// debug, info, warn, error or off; returns false if unknown. NACHO_LOG in the environment sets the
+// initial level (default info)
+bool set_level(std::string name);
+// block until everything queued so far has been written
+void flush();
+uint64_t dropped();
+std::vector<LogCounter> counters();
+}  // namespace logging
+
+#define NACHO_LOG(message_level, ...)                                                \
+    do {                                                                             \
+        if (logging::enabled(message_level)) {                                       \
+            static LogSite nacho_log_site(__FILE__, __LINE__, message_level);        \
+            logging::write(nacho_log_site, __VA_ARGS__);                             \
+        }                                                                            \
+    } while (0)
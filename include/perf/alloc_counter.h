@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocation accounting for finding allocations in per-frame code. Built with NACHO_COUNT_ALLOCS the
+// global operator new and delete are replaced by versions that count per thread before calling malloc
+// and free, and counted_malloc/counted_free can be handed to libraries with their own allocator hooks
+// (ImGui). Other builds replace nothing and every count reads zero.
+namespace alloc_counter {
+struct Counts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+bool enabled();
+// allocations made by the calling thread since it started
+Counts thread_counts();
+// allocations made by every thread
+Counts total_counts();
+
+void* counted_malloc(size_t size, void* user_data);
+void counted_free(void* ptr, void* user_data);
+}  // namespace alloc_counter
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <json.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define OPCODE_CLASSES 54
+#define SHADOW_STACK 64
+
+// Profile of the emulated program: executions per opcode class and per PC, instructions spent in each
+// subroutine and which bytes were executed or written. Recording runs on the emulation thread. Reads
+// from another thread (the GUI) see counters that may be a few instructions stale but never torn.
+class GuestProfiler {
+   public:
+    GuestProfiler();
+
+    struct Subroutine {
+        uint16_t addr = 0;
+        uint64_t calls = 0;
+        uint64_t inclusive = 0;  // instructions from the call to its return, callees included
+        uint64_t self = 0;       // the same without callees
+    };
+
+    // before executing the instruction at pc; index is I at that point
+    void record(uint16_t pc, uint16_t instruction, uint16_t index) {
+        bump(pc_counts[pc]);
+        bump(class_counts[opcode_class(instruction)]);
+        executed_total += 1;
+        uint8_t x = (instruction >> 8) & 0xF;
+        switch (instruction & 0xF0FF) {
+            case 0xF033: mark_written(index, 3); return;
+            case 0xF055: mark_written(index, x + 1); return;
+        }
+        if ((instruction & 0xF00F) == 0x5002) {
+            uint8_t y = (instruction >> 4) & 0xF;
+            mark_written(index, (x > y ? x - y : y - x) + 1);
+        } else if ((instruction & 0xF000) == 0x2000) {
+            enter(instruction & 0x0FFF);
+        } else if (instruction == 0x00EE) {
+            leave();
+        }
+    }
+
+    // clears everything; only while nothing is recording (not attached, or on the recording thread)
+    void reset();
+    // from any thread: the recording thread clears the profile before its next frame, so calls still open
+    // from before the reset are dropped instead of ending against the cleared count
+    void request_reset();
+    // recording thread, between frames
+    void begin_frame() {
+        if (reset_requested.load(std::memory_order_relaxed)) reset();
+    }
+
+    uint64_t instructions() const;
+    uint64_t pc_count(uint16_t pc) const;
+    bool written(uint16_t addr) const;
+    std::array<uint64_t, OPCODE_CLASSES> class_histogram() const;
+    std::vector<Subroutine> subroutines() const;
+
+    static int opcode_class(uint16_t instruction);
+    static const char* class_name(int opcode_class);
+
+    // {"instructions", "opcodes": {class: count}, "pcs": [[pc, count]...] hottest first,
+    //  "subroutines": [{addr, calls, inclusive, self}], "coverage": {"executed", "written" byte counts and
+    //  "executed_ranges", "written_ranges" as [first, last] pairs}}
+    nlohmann::json to_json() const;
+    bool export_json(std::string filepath) const;
+
+   private:
+    // one writer, so a relaxed load and store is enough and avoids a locked add per instruction
+    static void bump(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::unique_ptr<std::atomic<uint64_t>[]> pc_counts;
+    std::unique_ptr<std::atomic<uint8_t>[]> written_bytes;
+    std::array<std::atomic<uint64_t>, OPCODE_CLASSES> class_counts{};
+    std::atomic<uint64_t> executed_total{0};
+    std::atomic<bool> reset_requested{false};
+
+    // calls still open: target, instruction count at the call and instructions spent in callees
+    struct Frame {
+        uint16_t addr;
+        uint64_t start;
+        uint64_t callees;
+    };
+    std::array<Frame, SHADOW_STACK> frames;
+    int depth = 0;
+    mutable std::mutex subroutine_mtx;
+    std::unordered_map<uint16_t, Subroutine> subroutine_stats;
+
+    void mark_written(uint16_t addr, int count) {
+        for (int i = 0; i < count; i++) written_bytes[(uint16_t)(addr + i)].store(1, std::memory_order_relaxed);
+    }
+    void enter(uint16_t addr);
+    void leave();
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// frame time bucket bounds in milliseconds; 16.67 is one 60Hz frame
+#define HISTOGRAM_BUCKETS 16
+#define HISTOGRAM_BOUNDS {0.25, 0.5, 1, 2, 4, 8, 12, 15, 16.2, 16.8, 17.5, 20, 25, 33.4, 50, 100}
+
+// A mutex that counts how often and how long lockers waited. Uncontended locks cost the same as a plain
+// mutex: the clock is only read when try_lock fails.
+class ContendedMutex {
+   public:
+    void lock() {
+        if (mtx.try_lock()) return;
+        auto start = std::chrono::steady_clock::now();
+        mtx.lock();
+        auto waited = std::chrono::steady_clock::now() - start;
+        waits.fetch_add(1, std::memory_order_relaxed);
+        wait_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+                          std::memory_order_relaxed);
+    }
+    bool try_lock() { return mtx.try_lock(); }
+    void unlock() { mtx.unlock(); }
+
+    uint64_t contended() const { return waits.load(std::memory_order_relaxed); }
+    double wait_seconds() const { return wait_ns.load(std::memory_order_relaxed) / 1e9; }
+
+   private:
+    std::mutex mtx;
+    std::atomic<uint64_t> waits{0};
+    std::atomic<uint64_t> wait_ns{0};
+};
+
+// Lock free histogram of durations over the fixed HISTOGRAM_BOUNDS buckets (plus one for anything longer)
+class Histogram {
+   public:
+    void observe(double ms);
+
+    uint64_t count() const;
+    double sum() const;  // milliseconds
+    // upper bound of the bucket holding quantile q; the largest bound when it falls in the overflow bucket
+    double quantile(double q) const;
+    std::array<uint64_t, HISTOGRAM_BUCKETS + 1> counts() const;
+    static double bound(int bucket);
+
+   private:
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS + 1> buckets{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum_us{0};
+};
+
+// Live numbers for diagnosing stutter in the frontend. The emulation thread, the render thread and the
+// audio callback each record into their own fields; the overlay and the exporter only read.
+class RuntimeMetrics {
+   public:
+    // emulation thread, once per paced frame; allocations made by the thread during it (zero unless built
+    // with NACHO_COUNT_ALLOCS)
+    void emulation_frame(double work_ms, double interval_ms, double oversleep_ms, uint64_t instructions, int speed,
+                         uint64_t allocations = 0);
+    void lock_waits(const ContendedMutex& screen, const ContendedMutex& keys);
+    // render thread, once per presented frame; gpu_ms < 0 when no timer query result was ready
+    void render_frame(double work_ms, double interval_ms, double gpu_ms, uint64_t allocations = 0);
+    // audio: fill after each write, underruns from the device callback
+    void audio_fill(uint32_t samples, uint32_t capacity);
+    void audio_underrun();
+
+    Histogram emulation_work;
+    Histogram emulation_interval;
+    Histogram oversleep;  // how late the pacing sleep woke up (scheduler jitter)
+    Histogram render_work;
+    Histogram render_interval;
+    Histogram gpu_time;
+
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> instructions{0};
+    std::atomic<uint64_t> frame_instructions{0};  // last frame
+    std::atomic<int> speed{0};
+    std::atomic<double> mips{0};  // over the last second
+
+    std::atomic<uint64_t> screen_waits{0};
+    std::atomic<double> screen_wait_seconds{0};
+    std::atomic<uint64_t> key_waits{0};
+    std::atomic<double> key_wait_seconds{0};
+
+    // heap allocations in the last frame and in total, per thread
+    std::atomic<uint64_t> emulation_allocations{0};
+    std::atomic<uint64_t> emulation_allocations_total{0};
+    std::atomic<uint64_t> render_allocations{0};
+    std::atomic<uint64_t> render_allocations_total{0};
+
+    std::atomic<uint32_t> audio_samples{0};
+    std::atomic<uint32_t> audio_capacity{0};
+    std::atomic<uint64_t> audio_underruns{0};
+
+    // Prometheus text exposition format (version 0.0.4)
+    std::string to_prometheus() const;
+
+   private:
+    // emulation thread only
+    std::chrono::steady_clock::time_point window_start{};
+    uint64_t window_instructions = 0;
+};
+
+// Publishes RuntimeMetrics in Prometheus text format from a background thread: rewritten atomically to a
+// file every interval, or served to each connection on a Unix socket when the target is "unix:PATH"
+class MetricsExporter {
+   public:
+    MetricsExporter(const RuntimeMetrics& metrics, std::string target, int interval_ms = 1000);
+    ~MetricsExporter();
+
+   private:
+    const RuntimeMetrics& metrics;
+    std::string target;
+    int interval_ms;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stop = false;
+
+    void write_file_loop();
+    void serve_socket_loop(std::string path);
+};
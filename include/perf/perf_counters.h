@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <json.hpp>
+
+#define PERF_EVENTS 5
+#define PERF_PHASES 5
+
+// Host hardware counters of the calling thread, read through perf_event_open as one group so every event
+// covers the same instructions. Elsewhere, or when the kernel refuses (perf_event_paranoid, containers,
+// VMs without a PMU), available() is false and every read is zero. Events the CPU lacks read as zero.
+class PerfCounters {
+   public:
+    enum Event { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, LLC_MISSES };
+    typedef std::array<uint64_t, PERF_EVENTS> Values;
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    // running totals since the counters were opened, scaled up when the kernel multiplexed them
+    Values read();
+
+    static const char* event_name(int event);
+
+   private:
+    int group_fd = -1;
+    std::array<int, PERF_EVENTS> fds;
+    // position of each opened event in the group read, -1 when it could not be opened
+    std::array<int, PERF_EVENTS> slots;
+    int opened = 0;
+};
+
+// Splits host counters over the phases of an emulated frame. Each thread that enters a phase reads its
+// own counters (opened on first use), so phases on the audio or render thread are attributed to the
+// thread that ran them. Draw and scroll run inside execute and are subtracted from it in reports.
+class FrameProfiler {
+   public:
+    enum Phase { EXECUTE, DRAW, SCROLL, AUDIO, HANDOFF };
+
+    struct Report {
+        bool available = false;
+        uint64_t frames = 0;
+        uint64_t instructions = 0;  // emulated
+        std::array<uint64_t, PERF_PHASES> calls{};
+        std::array<PerfCounters::Values, PERF_PHASES> totals{};  // exclusive of nested phases
+    };
+
+    // measures one phase for as long as it lives; does nothing when profiler is null
+    class Scope {
+       public:
+        Scope(FrameProfiler* profiler, Phase phase) : profiler(profiler), phase(phase) {
+            if (profiler) start = thread_counters().read();
+        }
+        ~Scope() {
+            if (profiler) profiler->add(phase, start);
+        }
+
+       private:
+        FrameProfiler* profiler;
+        Phase phase;
+        PerfCounters::Values start;
+    };
+
+    void frame_done(uint64_t instructions);
+    Report report() const;
+    void reset();
+
+    static const char* phase_name(int phase);
+
+   private:
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> instructions{0};
+    std::array<std::atomic<uint64_t>, PERF_PHASES> calls{};
+    std::array<std::array<std::atomic<uint64_t>, PERF_EVENTS>, PERF_PHASES> totals{};
+    std::atomic<bool> available{false};
+
+    static PerfCounters& thread_counters();
+    void add(Phase phase, const PerfCounters::Values& start);
+};
+
+// {"available", "frames", "instructions", "phases": {phase: {"calls", "per_frame": {...},
+// "per_minstr": {...}}}}, counts per emulated frame and per million emulated instructions
+nlohmann::json perf_report_to_json(const FrameProfiler::Report& report);
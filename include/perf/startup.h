@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// milliseconds from launch to the first presented frame the frontend aims for
+#define STARTUP_TARGET_MS 100
+
+// Wall clock milestones from construction to the first presented frame. Phases can be marked from any
+// thread, so work moved onto background tasks still shows up, at the time it finished.
+class StartupTimeline {
+   public:
+    StartupTimeline();
+
+    // records and returns the milliseconds since construction
+    double mark(const std::string& phase);
+    double elapsed() const;
+
+    // "window 31.2 ms, gl 35.0 ms, ..." in the order the phases finished
+    std::string report() const;
+
+   private:
+    std::chrono::steady_clock::time_point start;
+    mutable std::mutex mtx;
+    std::vector<std::pair<std::string, double>> phases;
+};
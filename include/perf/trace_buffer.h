@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define TRACE_MAGIC 0x4352544E  // "NTRC" little endian
+#define TRACE_VERSION 1
+#define TRACE_NO_REG 0xFF
+
+// one executed instruction, 16 bytes
+struct TraceEntry {
+    uint32_t frame;
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t index;  // I after the instruction
+    uint8_t reg;     // register the instruction wrote (the last one for ranges), TRACE_NO_REG if none
+    uint8_t value;   // its new value
+    uint8_t vf;      // VF after the instruction
+    uint8_t pad[3];
+};
+
+// Fixed size ring of the most recent instructions. The emulation thread is the only writer and never
+// allocates or locks; readers copy a window and drop whatever the writer overwrote while they copied.
+class TraceBuffer {
+   public:
+    // capacity is rounded up to a power of two
+    explicit TraceBuffer(size_t capacity = 1 << 16);
+
+    void record(const TraceEntry& entry) {
+        uint64_t at = head.load(std::memory_order_relaxed);
+        entries[at & mask] = entry;
+        head.store(at + 1, std::memory_order_release);
+    }
+
+    size_t capacity() const;
+    // instructions recorded since the last clear (may exceed capacity)
+    uint64_t recorded() const;
+    void clear();
+
+    // up to max_entries of the newest entries, oldest first
+    std::vector<TraceEntry> snapshot(size_t max_entries = SIZE_MAX) const;
+    // the same into out, reusing its storage
+    void snapshot(std::vector<TraceEntry>& out, size_t max_entries) const;
+
+    // binary file: magic, version, entry size and count as uint32, then the entries oldest first
+    bool dump(std::string filepath) const;
+
+    // register VX the opcode writes, or TRACE_NO_REG
+    static uint8_t written_register(uint16_t opcode);
+
+   private:
+    std::unique_ptr<TraceEntry[]> entries;
+    size_t mask;
+    std::atomic<uint64_t> head{0};
+};
+
+// read a dump back; false if the file isn't a trace
+bool load_trace(std::string filepath, std::vector<TraceEntry>& entries);
+// "frame pc opcode I reg=value VF" on one line
+std::string trace_entry_to_text(const TraceEntry& entry);
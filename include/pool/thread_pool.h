@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: it pops its own tasks from the back
+// and, once empty, steals from the front of the other workers' deques.
+class ThreadPool {
+   public:
+    // 0 threads means one per hardware thread
+    ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // tasks submitted from a worker go to that worker's deque, others are spread round robin
+    void submit(std::function<void()> task);
+
+    // block until every submitted task has finished
+    void wait();
+
+    // call fn(i) for every i in [0, count) on the workers and the calling thread, returning when all are done.
+    // indices are handed out one at a time so uneven work balances itself, and nothing is allocated
+    template <typename F>
+    void parallel_for(size_t count, F& fn) {
+        run_bulk(count, [](void* ctx, size_t i) { (*static_cast<F*>(ctx))(i); }, &fn);
+    }
+
+    unsigned size();
+
+   private:
+    struct Queue {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mtx;
+    };
+
+    // a parallel_for in flight; lives on the caller's stack
+    struct Bulk {
+        void (*call)(void*, size_t);
+        void* ctx;
+        size_t count;
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> done = 0;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wake_mtx;
+    std::condition_variable wake;
+    std::condition_variable idle;
+
+    // tasks submitted but not yet finished
+    std::atomic<size_t> pending = 0;
+    // tasks sitting in a deque (guarded by wake_mtx so sleeping workers never miss one)
+    size_t queued = 0;
+    std::atomic<unsigned> next_queue = 0;
+    bool stop = false;
+
+    // guarded by wake_mtx; workers join a bulk job at most once per epoch
+    Bulk* bulk = nullptr;
+    uint64_t bulk_epoch = 0;
+    unsigned bulk_workers = 0;
+    std::mutex bulk_mtx;
+
+    void run_bulk(size_t count, void (*call)(void*, size_t), void* ctx);
+    void work_bulk(Bulk& job);
+    void worker_loop(unsigned index);
+    bool pop_task(unsigned index, std::function<void()>& task);
+};
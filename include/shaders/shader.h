@@ -3,16 +3,32 @@
 #define SHADER_H
 
 #include <glad.h>
+#include <GLFW/glfw3.h>
 
 #include <string>
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <iostream>
+#include <vector>
+
+// program binaries (GL 4.1 / ARB_get_program_binary) aren't in the 3.3 core glad loader; the entry
+// points are looked up at runtime and the cache is skipped when the driver doesn't have them
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+#define SHADER_CACHE_MAGIC "nacho-shader 1"
 
 class Shader
 {
 public:
     unsigned int ID;
+    // true if the program came from the binary cache instead of being compiled
+    bool cached = false;
     Shader() : ID(0) {}
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
@@ -46,29 +62,32 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        compile(vertexCode.c_str(), fragmentCode.c_str(), nullptr);
+    }
+    // shader from sources already in memory (e.g. embedded at build time). With a cache path the linked
+    // program is stored there and reloaded on later runs, skipping compilation; the cache is keyed by
+    // driver and sources, so a driver update or shader change just recompiles
+    // ------------------------------------------------------------------------
+    static Shader fromSource(const char* vShaderCode, const char* fShaderCode, const std::string& cachePath = "")
+    {
+        Shader shader;
+        if (cachePath.empty())
+        {
+            shader.compile(vShaderCode, fShaderCode, nullptr);
+            return shader;
+        }
+        BinaryFunctions gl = binaryFunctions();
+        std::string key = cacheKey(vShaderCode, fShaderCode);
+        if (gl.available && shader.loadBinary(gl, cachePath, key))
+        {
+            shader.cached = true;
+            return shader;
+        }
+        shader.compile(vShaderCode, fShaderCode, gl.available ? &gl : nullptr);
+        if (gl.available)
+            shader.saveBinary(gl, cachePath, key);
+        return shader;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -95,8 +114,116 @@ public:
     void setVec3fv(const std::string &name, float* vec3){
         glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, vec3);
     }
+    // look a location up once and set it by location from then on, so per-frame updates build no names
+    // ------------------------------------------------------------------------
+    int getLocation(const std::string &name) const
+    {
+        return glGetUniformLocation(ID, name.c_str());
+    }
+    void setVec3fv(int location, const float* vec3)
+    {
+        glUniform3fv(location, 1, vec3);
+    }
 
 private:
+    struct BinaryFunctions
+    {
+        PFNGLGETPROGRAMBINARYPROC getProgramBinary = nullptr;
+        PFNGLPROGRAMBINARYPROC programBinary = nullptr;
+        PFNGLPROGRAMPARAMETERIPROC programParameteri = nullptr;
+        bool available = false;
+    };
+    // needs a current context
+    static BinaryFunctions binaryFunctions()
+    {
+        BinaryFunctions gl;
+        gl.getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+        gl.programBinary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+        gl.programParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+        GLint formats = 0;
+        if (gl.getProgramBinary && gl.programBinary && gl.programParameteri)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        // clear the error from drivers that don't know the enum
+        while (glGetError() != GL_NO_ERROR) {}
+        gl.available = formats > 0;
+        return gl;
+    }
+    static std::string cacheKey(const char* vShaderCode, const char* fShaderCode)
+    {
+        std::string key;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const GLubyte* value = glGetString(name);
+            key += value ? (const char*)value : "";
+            key += "|";
+        }
+        key += std::to_string(std::hash<std::string>{}(std::string(vShaderCode) + '\0' + fShaderCode));
+        return key;
+    }
+    // file: magic and key lines, binary format, then the program binary
+    bool loadBinary(const BinaryFunctions& gl, const std::string& cachePath, const std::string& key)
+    {
+        std::ifstream file(cachePath, std::ios::binary);
+        std::string magic, fileKey;
+        if (!std::getline(file, magic) || magic != SHADER_CACHE_MAGIC || !std::getline(file, fileKey) || fileKey != key)
+            return false;
+        GLenum format = 0;
+        file.read((char*)&format, sizeof(format));
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file || binary.empty())
+            return false;
+        ID = glCreateProgram();
+        gl.programBinary(ID, format, binary.data(), (GLsizei)binary.size());
+        int success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(ID);
+            ID = 0;
+        }
+        return success;
+    }
+    void saveBinary(const BinaryFunctions& gl, const std::string& cachePath, const std::string& key)
+    {
+        GLint linked = 0, length = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!linked || length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        gl.getProgramBinary(ID, length, nullptr, &format, binary.data());
+        std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+        file << SHADER_CACHE_MAGIC << "\n" << key << "\n";
+        file.write((const char*)&format, sizeof(format));
+        file.write(binary.data(), binary.size());
+    }
+    // gl is set when the linked program should stay retrievable for the cache
+    void compile(const char* vShaderCode, const char* fShaderCode, const BinaryFunctions* gl)
+    {
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // shader Program
+        ID = glCreateProgram();
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        if (gl)
+            gl->programParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
@@ -0,0 +1,103 @@
+/* Layout of the shared memory region the emulator publishes with --shm NAME (shm_open(NAME)).
+ * Plain C so bots, recorders and spectator tools can map it without linking anything.
+ *
+ * The region is NACHO_SHM_SIZE bytes: a nacho_shm_state at offset 0, which the emulator rewrites after
+ * every frame and which readers may map PROT_READ, and a nacho_shm_input at NACHO_SHM_INPUT_OFFSET on its
+ * own pages, which agents map PROT_READ | PROT_WRITE to drive the keypad.
+ *
+ * Reading a frame (seqlock; the emulator never waits for readers):
+ *
+ *     uint64_t seq;
+ *     do {
+ *         seq = nacho_shm_read_begin(state);
+ *         ... read or copy what you need from state->frame ...
+ *     } while (nacho_shm_read_retry(state, seq));
+ *
+ * Injecting keys: nacho_shm_set_keys(input, mask). The emulator applies the mask before the next frame
+ * runs and reports the sequence it took in input->applied; the local keyboard keeps working in between.
+ * All fields are in host byte order. */
+#ifndef NACHO_SHM_H
+#define NACHO_SHM_H
+
+#include <stdint.h>
+
+#define NACHO_SHM_MAGIC 0x4D48534E /* "NSHM" */
+#define NACHO_SHM_VERSION 1
+
+#define NACHO_SHM_WIDTH 128
+#define NACHO_SHM_HEIGHT 64
+/* one bit per pixel, row major, leftmost pixel in the most significant bit */
+#define NACHO_SHM_PLANE_BYTES (NACHO_SHM_WIDTH * NACHO_SHM_HEIGHT / 8)
+/* bit n of a pixel's palette index is in plane n; CHIP-8 and SCHIP only use plane 0 */
+#define NACHO_SHM_PLANES 4
+#define NACHO_SHM_MEMORY 0x10000
+
+/* the input block starts on a boundary any host page size divides, so it can be mapped on its own */
+#define NACHO_SHM_ALIGN 0x10000
+#define NACHO_SHM_INPUT_OFFSET \
+    ((sizeof(nacho_shm_state) + NACHO_SHM_ALIGN - 1) / NACHO_SHM_ALIGN * NACHO_SHM_ALIGN)
+#define NACHO_SHM_SIZE (NACHO_SHM_INPUT_OFFSET + NACHO_SHM_ALIGN)
+
+typedef struct nacho_shm_header {
+    uint32_t magic;         /* NACHO_SHM_MAGIC once the region is ready */
+    uint32_t version;       /* NACHO_SHM_VERSION */
+    uint32_t size;          /* NACHO_SHM_SIZE */
+    uint32_t input_offset;  /* NACHO_SHM_INPUT_OFFSET */
+    uint32_t pid;           /* of the emulator */
+    uint32_t reserved;
+    uint64_t sequence;      /* seqlock: odd while a frame is being written, +2 per frame */
+    uint8_t padding[32];
+} nacho_shm_header;
+
+typedef struct nacho_shm_frame {
+    uint64_t frame;        /* frames run since the program was loaded */
+    uint64_t instructions; /* instructions run since the program was loaded */
+    uint16_t pc;
+    uint16_t i;
+    uint16_t keys;         /* keypad the frame ran with, bit n for key n */
+    uint16_t stack[16];
+    int8_t sp;             /* top of stack, -1 when empty */
+    uint8_t delay;
+    uint8_t sound;
+    uint8_t plane;         /* XO-CHIP planes selected for drawing */
+    uint8_t system;        /* 0 CHIP-8, 2 SCHIP, 6 SCHIP 1.1, 8 XO-CHIP */
+    uint8_t hires;         /* 0 when the program runs at 64x32 (pixels are drawn as 2x2 blocks) */
+    uint8_t reserved[2];
+    uint8_t v[16];
+    uint8_t planes[NACHO_SHM_PLANES][NACHO_SHM_PLANE_BYTES];
+    uint8_t memory[NACHO_SHM_MEMORY]; /* a copy; writing to it changes nothing */
+} nacho_shm_frame;
+
+typedef struct nacho_shm_state {
+    nacho_shm_header header;
+    nacho_shm_frame frame;
+} nacho_shm_state;
+
+typedef struct nacho_shm_input {
+    uint32_t sequence; /* bumped by the agent after writing keys */
+    uint32_t applied;  /* last sequence the emulator applied */
+    uint16_t keys;     /* bit n for key n */
+    uint16_t reserved[3];
+} nacho_shm_input;
+
+/* waits out a frame being written and returns the sequence to pass to nacho_shm_read_retry */
+static inline uint64_t nacho_shm_read_begin(const nacho_shm_state* state) {
+    uint64_t sequence;
+    while ((sequence = __atomic_load_n(&state->header.sequence, __ATOMIC_ACQUIRE)) & 1) {
+    }
+    return sequence;
+}
+
+/* nonzero when a frame was written while reading, so what was read may be torn */
+static inline int nacho_shm_read_retry(const nacho_shm_state* state, uint64_t sequence) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&state->header.sequence, __ATOMIC_RELAXED) != sequence;
+}
+
+/* one agent at a time; returns the sequence to compare with input->applied */
+static inline uint32_t nacho_shm_set_keys(nacho_shm_input* input, uint16_t keys) {
+    __atomic_store_n(&input->keys, keys, __ATOMIC_RELAXED);
+    return __atomic_add_fetch(&input->sequence, 1, __ATOMIC_RELEASE);
+}
+
+#endif
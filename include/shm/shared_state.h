@@ -0,0 +1,41 @@
+#pragma once
+
+#include <shm/nacho_shm.h>
+
+#include <cstdint>
+#include <string>
+
+class CPU;
+
+// Publishes the machine to a POSIX shared memory region (layout in shm/nacho_shm.h) once per frame and
+// takes keypad input from the same region. Attached with CPU::set_shared_state; publish and apply_input
+// run on the emulation thread. Not available on Windows, where open fails.
+class SharedState {
+   public:
+    SharedState() = default;
+    ~SharedState();
+    SharedState(const SharedState&) = delete;
+    SharedState& operator=(const SharedState&) = delete;
+
+    // creates (or takes over) the region; a leading '/' is added to the name if missing
+    bool open(std::string name);
+    // unmaps and removes the region; readers keep their mappings
+    void close();
+    bool is_open() const;
+
+    // copy the frame that just ran into the region under the seqlock
+    void publish(CPU& cpu);
+    // hand the keypad mask an agent wrote since the last frame to the CPU
+    void apply_input(CPU& cpu);
+
+    // the mapped region, for in-process readers and tests
+    const nacho_shm_state* state() const;
+    nacho_shm_input* input();
+
+   private:
+    std::string name;
+    void* region = nullptr;
+    nacho_shm_state* shared = nullptr;
+    nacho_shm_input* channel = nullptr;
+    uint32_t applied = 0;
+};
@@ -0,0 +1,159 @@
+#include <perf/alloc_counter.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+thread_local uint64_t thread_allocations = 0;
+thread_local uint64_t thread_bytes = 0;
+std::atomic<uint64_t> total_allocations{0};
+std::atomic<uint64_t> total_bytes{0};
+
+inline void count(size_t size) {
+#ifdef NACHO_COUNT_ALLOCS
+    thread_allocations += 1;
+    thread_bytes += size;
+    total_allocations.fetch_add(1, std::memory_order_relaxed);
+    total_bytes.fetch_add(size, std::memory_order_relaxed);
+#else
+    (void)size;
+#endif
+}
+}  // namespace
+
+namespace alloc_counter {
+bool enabled() {
+#ifdef NACHO_COUNT_ALLOCS
+    return true;
+#else
+    return false;
+#endif
+}
+
+Counts thread_counts() {
+    return {thread_allocations, thread_bytes};
+}
+
+Counts total_counts() {
+    return {total_allocations.load(std::memory_order_relaxed), total_bytes.load(std::memory_order_relaxed)};
+}
+
+void* counted_malloc(size_t size, void*) {
+    count(size);
+    return std::malloc(size);
+}
+
+void counted_free(void* ptr, void*) {
+    std::free(ptr);
+}
+}  // namespace alloc_counter
+
+#ifdef NACHO_COUNT_ALLOCS
+
+// Replacements for every global operator new and delete. The object is linked into any binary that reads
+// the counters, so the replacement is active wherever they can be seen.
+
+static void* allocate(std::size_t size) {
+    count(size);
+    return std::malloc(size ? size : 1);
+}
+
+static void* allocate_aligned(std::size_t size, std::align_val_t align) {
+    count(size);
+    size = size ? size : 1;
+#ifdef _WIN32
+    return _aligned_malloc(size, (size_t)align);
+#else
+    void* ptr = nullptr;
+    size_t alignment = std::max((size_t)align, sizeof(void*));
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+#endif
+}
+
+static void free_aligned(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void* operator new(std::size_t size) {
+    void* ptr = allocate(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](std::size_t size) {
+    void* ptr = allocate(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    void* ptr = allocate_aligned(size, align);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+    void* ptr = allocate_aligned(size, align);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return allocate_aligned(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return allocate_aligned(size, align);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    free_aligned(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    free_aligned(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    free_aligned(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    free_aligned(ptr);
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include <batch/batch.h>
+#include <headless/headless.h>
+#include <io/rom_file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <json.hpp>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+const std::array<std::string, 3> rom_extensions{".ch8", ".xo8", ".sc8"};
+
+BatchRunner::BatchRunner(const Database& db, unsigned threads) : db(db), pool(threads) {}
+
+unsigned BatchRunner::threads() {
+    return pool.size();
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<std::string>& roms, uint64_t frames, int platform) {
+    std::vector<BatchResult> results(roms.size());
+    for (size_t i = 0; i < roms.size(); i++) {
+        pool.submit([this, &roms, &results, i, frames, platform]() {
+            results[i] = run_one(roms[i], frames, platform);
+        });
+    }
+    pool.wait();
+    return results;
+}
+
+BatchResult BatchRunner::run_one(std::string path, uint64_t frames, int platform) {
+    BatchResult result;
+    result.path = path;
+
+    // hashed from the mapping and copied straight into emulated memory, as Headless::load does
+    RomFile rom;
+    if (!rom.open(path)) {
+        result.error = "could not open file";
+        return result;
+    }
+
+    try {
+        result.sha1 = rom.sha1();
+        result.title = db.get_title(result.sha1);
+
+        CPU::Config config = platform >= 0 ? db.gen_platform_config(platform) : db.gen_config(result.sha1);
+        result.system = config.system;
+
+        // CPU carries its screen and page table so keep it off the worker stack
+        auto cpu = std::make_unique<CPU>();
+        cpu->set_config(config);
+        if (cpu->load_program_data(rom.data(), rom.size()) < 0) {
+            result.error = "program too large";
+            return result;
+        }
+        cpu->resume();
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t f = 0; f < frames && !cpu->check_stop(); f++) {
+            cpu->run_frame();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        CPU::Stats stats = cpu->get_stats();
+        result.frames = stats.frames;
+        result.instructions = stats.instructions;
+        result.invalid_opcodes = stats.invalid_opcodes;
+        result.stack_faults = stats.stack_faults;
+        result.fetch_faults = stats.fetch_faults;
+        result.seconds = std::chrono::duration<double>(end - start).count();
+        result.mips = result.seconds > 0 ? result.instructions / result.seconds / 1e6 : 0.0;
+
+        auto screenlock{cpu->get_screen()};
+        result.screen_hash = hash_screen(screenlock.screen);
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+/*-----------------[Helpers]-----------------*/
+
+std::vector<std::string> collect_roms(const std::vector<std::string>& paths) {
+    std::vector<std::string> roms;
+    for (const std::string& path : paths) {
+        std::error_code ec;
+        if (!fs::is_directory(path, ec)) {
+            roms.push_back(path);
+            continue;
+        }
+        for (const fs::directory_entry& entry : fs::recursive_directory_iterator(path, ec)) {
+            if (!entry.is_regular_file()) continue;
+            std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            if (std::find(rom_extensions.begin(), rom_extensions.end(), ext) != rom_extensions.end()) {
+                roms.push_back(entry.path().string());
+            }
+        }
+    }
+    // directory iteration order is unspecified; sort so result files diff cleanly
+    std::sort(roms.begin(), roms.end());
+    return roms;
+}
+
+bool write_batch_json(std::string filepath, const std::vector<BatchResult>& results) {
+    std::ofstream file(filepath);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << filepath << std::endl;
+        return false;
+    }
+
+    nlohmann::json out = nlohmann::json::array();
+    for (const BatchResult& r : results) {
+        out.push_back({{"path", r.path},
+                       {"sha1", r.sha1},
+                       {"title", r.title},
+                       {"system", r.system},
+                       {"frames", r.frames},
+                       {"instructions", r.instructions},
+                       {"invalid_opcodes", r.invalid_opcodes},
+                       {"stack_faults", r.stack_faults},
+                       {"fetch_faults", r.fetch_faults},
+                       {"seconds", r.seconds},
+                       {"mips", r.mips},
+                       {"screen_hash", hash_to_hex(r.screen_hash)},
+                       {"error", r.error}});
+    }
+    file << out.dump(2) << std::endl;
+    return true;
+}
+
+std::string csv_field(std::string field) {
+    if (field.find_first_of(",\"\n") == std::string::npos) return field;
+    std::string quoted = "\"";
+    for (char c : field) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+bool write_batch_csv(std::string filepath, const std::vector<BatchResult>& results) {
+    std::ofstream file(filepath);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << filepath << std::endl;
+        return false;
+    }
+
+    file << "path,sha1,title,system,frames,instructions,invalid_opcodes,stack_faults,fetch_faults,seconds,mips,"
+            "screen_hash,error\n";
+    for (const BatchResult& r : results) {
+        file << csv_field(r.path) << ',' << r.sha1 << ',' << csv_field(r.title) << ',' << r.system << ','
+             << r.frames << ',' << r.instructions << ',' << r.invalid_opcodes << ',' << r.stack_faults << ','
+             << r.fetch_faults << ',' << r.seconds << ',' << r.mips << ',' << hash_to_hex(r.screen_hash) << ','
+             << csv_field(r.error) << '\n';
+    }
+    return true;
+}
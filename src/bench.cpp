@@ -0,0 +1,216 @@
+#include <bench/bench.h>
+#include <headless/headless.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+BenchRunner::BenchRunner(const Database& db, unsigned warmup, unsigned runs, bool perf)
+    : db(db), warmup(warmup), runs(std::max(runs, 1u)), perf(perf) {}
+
+/*-----------------[Runs]-----------------*/
+
+BenchResult BenchRunner::run(const BenchCase& bench) {
+    BenchResult result;
+    result.bench = bench;
+
+    std::ifstream file(bench.rom, std::ios::binary);
+    if (!file.is_open()) {
+        result.error = "could not open file";
+        return result;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    try {
+        result.sha1 = CPU::hash_data(data.data(), data.size());
+        CPU::Config config = bench.platform >= 0 ? db.gen_platform_config(bench.platform) : db.gen_config(result.sha1);
+        result.system = config.system;
+        if (data.size() > (size_t)(MAX_MEM - config.start_address)) {
+            result.error = "program too large";
+            return result;
+        }
+        PagedMemory image = CPU::build_image(data.data(), data.size(), config.start_address);
+
+        for (unsigned r = 0; r < warmup + runs; r++) {
+            auto cpu = std::make_unique<CPU>();
+            cpu->set_config(config);
+            cpu->load_image(image);
+            cpu->resume();
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t f = 0; f < bench.frames; f++) {
+                cpu->run_frame();
+            }
+            auto end = std::chrono::steady_clock::now();
+            if (r < warmup) continue;
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            uint64_t instructions = cpu->get_stats().instructions;
+            result.instructions = instructions;
+            result.mips.push_back(seconds > 0 ? instructions / seconds / 1e6 : 0.0);
+            result.fps.push_back(seconds > 0 ? bench.frames / seconds : 0.0);
+        }
+
+        if (perf) {
+            FrameProfiler profiler;
+            auto cpu = std::make_unique<CPU>();
+            cpu->set_config(config);
+            cpu->load_image(image);
+            cpu->resume();
+            cpu->set_profiler(&profiler);
+            for (uint64_t f = 0; f < bench.frames; f++) {
+                cpu->run_frame();
+            }
+            cpu->set_profiler(nullptr);
+            result.profiled = true;
+            result.perf = profiler.report();
+        }
+    } catch (const std::exception& e) {
+        result.error = e.what();
+        return result;
+    }
+
+    result.mips_summary = summarize(result.mips);
+    result.fps_summary = summarize(result.fps);
+    return result;
+}
+
+/*-----------------[Statistics]-----------------*/
+
+// percentiles interpolate linearly between the closest ranks
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    double rank = p * (sorted.size() - 1);
+    size_t lower = (size_t)rank;
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+    return sorted[lower] + (rank - lower) * (sorted[upper] - sorted[lower]);
+}
+
+BenchSummary summarize(std::vector<double> samples) {
+    BenchSummary summary;
+    if (samples.empty()) return summary;
+    std::sort(samples.begin(), samples.end());
+
+    summary.median = percentile(samples, 0.5);
+    summary.p10 = percentile(samples, 0.1);
+    summary.p90 = percentile(samples, 0.9);
+    summary.min = samples.front();
+    summary.max = samples.back();
+
+    double sum = 0;
+    for (double s : samples) sum += s;
+    summary.mean = sum / samples.size();
+    double squares = 0;
+    for (double s : samples) squares += (s - summary.mean) * (s - summary.mean);
+    summary.stddev = samples.size() > 1 ? std::sqrt(squares / (samples.size() - 1)) : 0.0;
+    return summary;
+}
+
+/*-----------------[Suites]-----------------*/
+
+std::string bench_case_name(std::string rom, int platform) {
+    return fs::path(rom).filename().string() + "@" + (platform >= 0 ? platform_name(platform) : "db");
+}
+
+bool load_bench_suite(std::string filepath, std::vector<BenchCase>& cases) {
+    std::ifstream file(filepath);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << filepath << std::endl;
+        return false;
+    }
+
+    json suite;
+    try {
+        file >> suite;
+        uint64_t frames = suite.value("frames", 600);
+        // rom paths are relative to the suite file
+        fs::path base = fs::path(filepath).parent_path();
+        for (const json& entry : suite.at("cases")) {
+            BenchCase bench;
+            bench.rom = (base / entry.at("rom").get<std::string>()).string();
+            bench.frames = entry.value("frames", frames);
+            if (entry.contains("platform")) {
+                bench.platform = parse_platform(entry["platform"]);
+                if (bench.platform < 0) {
+                    std::cerr << "Unknown platform " << entry["platform"] << std::endl;
+                    return false;
+                }
+            }
+            bench.name = entry.value("name", bench_case_name(bench.rom, bench.platform));
+            cases.push_back(bench);
+        }
+    } catch (const json::exception& e) {
+        std::cerr << "Invalid suite " << filepath << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*-----------------[Output]-----------------*/
+
+static json summary_to_json(const BenchSummary& summary) {
+    return {{"median", summary.median}, {"p10", summary.p10},   {"p90", summary.p90},      {"min", summary.min},
+            {"max", summary.max},       {"mean", summary.mean}, {"stddev", summary.stddev}};
+}
+
+json bench_to_json(const std::vector<BenchResult>& results) {
+    json out;
+#ifdef __VERSION__
+    out["meta"]["compiler"] = __VERSION__;
+#endif
+#ifdef NDEBUG
+    out["meta"]["optimized"] = true;
+#else
+    out["meta"]["optimized"] = false;
+#endif
+    out["cases"] = json::array();
+    for (const BenchResult& r : results) {
+        json entry;
+        entry["name"] = r.bench.name;
+        entry["rom"] = r.bench.rom;
+        entry["sha1"] = r.sha1;
+        entry["system"] = r.system;
+        entry["frames"] = r.bench.frames;
+        entry["runs"] = r.mips.size();
+        entry["instructions"] = r.instructions;
+        entry["mips"] = summary_to_json(r.mips_summary);
+        entry["fps"] = summary_to_json(r.fps_summary);
+        if (r.profiled) entry["perf"] = perf_report_to_json(r.perf);
+        if (!r.error.empty()) entry["error"] = r.error;
+        out["cases"].push_back(entry);
+    }
+    return out;
+}
+
+int compare_bench(const json& current, const json& baseline, double threshold, std::ostream& report) {
+    int regressions = 0;
+    report << std::left << std::setw(32) << "case" << std::right << std::setw(12) << "baseline" << std::setw(12)
+           << "current" << std::setw(10) << "change" << std::endl;
+
+    for (const json& entry : current.at("cases")) {
+        if (entry.contains("error")) continue;
+        std::string name = entry.at("name");
+        auto match = std::find_if(baseline.at("cases").begin(), baseline.at("cases").end(),
+                                  [&name](const json& b) { return b.value("name", "") == name; });
+        if (match == baseline.at("cases").end() || match->contains("error")) continue;
+
+        double before = match->at("mips").value("median", 0.0);
+        double now = entry.at("mips").value("median", 0.0);
+        double change = before > 0 ? (now - before) / before : 0.0;
+        bool regressed = change < -threshold;
+        regressions += regressed;
+
+        report << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(2)
+               << std::setw(12) << before << std::setw(12) << now << std::setw(9) << change * 100 << "%"
+               << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return regressions;
+}
@@ -0,0 +1,137 @@
+#include <batch/batch.h>
+#include <bench/bench.h>
+#include <database/database.h>
+#include <headless/headless.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <json.hpp>
+#include <sstream>
+#include <string>
+
+using json = nlohmann::json;
+
+void usage() {
+    std::cerr << "usage: nacho-bench [options] [rom or directory]...\n"
+                 "  --suite FILE        json suite of cases (see include/bench/bench.h)\n"
+                 "  --platform LIST     comma separated platforms to run every rom with (default: database config)\n"
+                 "  --frames N          frames per run (default 600)\n"
+                 "  --runs N            measured runs per case (default 10)\n"
+                 "  --warmup N          unmeasured runs per case (default 2)\n"
+                 "  --json FILE         write results as json\n"
+                 "  --baseline FILE     compare median MIPS against an earlier --json result\n"
+                 "  --threshold PCT     slowdown counted as a regression (default 5)\n"
+                 "  --db DIR            database directory (default: database)\n"
+                 "  --perf              add host counters per frame phase to the json (one extra run per case)\n"
+                 "exit status is 2 when a regression against the baseline was found"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    std::vector<int> platforms;
+    std::vector<BenchCase> cases;
+    std::string db_dir = "database";
+    std::string json_file, baseline_file;
+    uint64_t frames = 600;
+    unsigned runs = 10, warmup = 2;
+    double threshold = 0.05;
+    bool perf = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            paths.push_back(arg);
+        } else if (arg == "--perf") {
+            perf = true;
+        } else if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--suite") {
+            if (!load_bench_suite(argv[++i], cases)) return 1;
+        } else if (arg == "--platform") {
+            std::stringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                int platform = parse_platform(name);
+                if (platform < 0) {
+                    std::cerr << "Unknown platform " << name << std::endl;
+                    return 1;
+                }
+                platforms.push_back(platform);
+            }
+        } else if (arg == "--frames") {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--runs") {
+            runs = std::stoul(argv[++i]);
+        } else if (arg == "--warmup") {
+            warmup = std::stoul(argv[++i]);
+        } else if (arg == "--json") {
+            json_file = argv[++i];
+        } else if (arg == "--baseline") {
+            baseline_file = argv[++i];
+        } else if (arg == "--threshold") {
+            threshold = std::stod(argv[++i]) / 100;
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (paths.empty() && cases.empty()) paths.push_back("games");
+    if (platforms.empty()) platforms.push_back(-1);
+    for (const std::string& rom : collect_roms(paths)) {
+        for (int platform : platforms) {
+            cases.push_back({bench_case_name(rom, platform), rom, platform, frames});
+        }
+    }
+
+    Database db(db_dir);
+    BenchRunner runner(db, warmup, runs, perf);
+    std::vector<BenchResult> results;
+    std::cout << std::left << std::setw(32) << "case" << std::right << std::setw(12) << "median MIPS" << std::setw(10)
+              << "p10" << std::setw(10) << "p90" << std::setw(12) << "median FPS" << std::endl;
+    for (const BenchCase& bench : cases) {
+        results.push_back(runner.run(bench));
+        const BenchResult& r = results.back();
+        std::cout << std::left << std::setw(32) << r.bench.name << std::right;
+        if (!r.error.empty()) {
+            std::cout << "  " << r.error << std::endl;
+            continue;
+        }
+        std::cout << std::fixed << std::setprecision(2) << std::setw(12) << r.mips_summary.median << std::setw(10)
+                  << r.mips_summary.p10 << std::setw(10) << r.mips_summary.p90 << std::setw(12) << std::setprecision(0)
+                  << r.fps_summary.median << std::endl;
+    }
+
+    if (perf && !results.empty() && results.front().profiled && !results.front().perf.available) {
+        std::cerr << "Hardware counters unavailable (check /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+    }
+
+    json out = bench_to_json(results);
+    if (!json_file.empty()) {
+        std::ofstream file(json_file);
+        if (!file.is_open()) {
+            std::cerr << "Could not write " << json_file << std::endl;
+            return 1;
+        }
+        file << out.dump(2) << std::endl;
+    }
+
+    if (!baseline_file.empty()) {
+        std::ifstream file(baseline_file);
+        json baseline;
+        try {
+            file >> baseline;
+        } catch (const json::exception& e) {
+            std::cerr << "Could not read baseline " << baseline_file << std::endl;
+            return 1;
+        }
+        std::cout << std::endl;
+        if (compare_bench(out, baseline, threshold, std::cout) > 0) return 2;
+    }
+    return 0;
+}
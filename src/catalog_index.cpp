@@ -0,0 +1,167 @@
+#include <database/catalog_index.h>
+
+#include <algorithm>
+#include <cctype>
+#include <numeric>
+#include <unordered_map>
+
+CatalogIndex::CatalogIndex(const Database& db) {
+    build(db);
+}
+
+static char lower(char c) {
+    return (char)std::tolower((unsigned char)c);
+}
+
+static uint32_t gram_key(const char* text) {
+    return (uint8_t)text[0] | (uint8_t)text[1] << 8 | (uint8_t)text[2] << 16;
+}
+
+// first four digit run, so "1991", "c. 1978" and "2015-10-01" all give a year and "19xx" does not
+static int parse_year(const std::string& release) {
+    for (size_t i = 0; i + 4 <= release.size(); i++) {
+        if (std::all_of(release.begin() + i, release.begin() + i + 4, [](char c) { return std::isdigit((unsigned char)c); })) {
+            return std::stoi(release.substr(i, 4));
+        }
+    }
+    return 0;
+}
+
+/*-----------------[Build]-----------------*/
+
+void CatalogIndex::build(const Database& db) {
+    names = db.platform_names();
+    entries.clear();
+    for (Database::ProgramInfo& program : db.list_programs()) {
+        Entry entry;
+        entry.title = std::move(program.title);
+        entry.authors = std::move(program.authors);
+        entry.description = std::move(program.description);
+        entry.release = std::move(program.release);
+        entry.year = parse_year(entry.release);
+        entry.platforms = program.platforms;
+        for (size_t p = 0; p < names.size() && p < 32; p++) {
+            if (!(entry.platforms & 1u << p)) continue;
+            if (!entry.platform_text.empty()) entry.platform_text += ", ";
+            entry.platform_text += names[p];
+        }
+        entry.roms = std::move(program.roms);
+        entry.files = std::move(program.files);
+        entries.push_back(std::move(entry));
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return std::lexicographical_compare(a.title.begin(), a.title.end(), b.title.begin(), b.title.end(),
+                                            [](char x, char y) { return lower(x) < lower(y); });
+    });
+
+    // entries are visited in id order, so each posting list comes out sorted and a repeat is always last
+    haystacks.clear();
+    std::unordered_map<uint32_t, std::vector<uint32_t>> lists;
+    size_t total = 0;
+    for (uint32_t id = 0; id < entries.size(); id++) {
+        const Entry& entry = entries[id];
+        std::string haystack = entry.title + "\n" + entry.authors + "\n" + entry.description;
+        std::transform(haystack.begin(), haystack.end(), haystack.begin(), lower);
+        for (size_t i = 0; i + 3 <= haystack.size(); i++) {
+            std::vector<uint32_t>& list = lists[gram_key(&haystack[i])];
+            if (list.empty() || list.back() != id) {
+                list.push_back(id);
+                total++;
+            }
+        }
+        haystacks.push_back(std::move(haystack));
+    }
+
+    grams.clear();
+    for (const auto& [key, list] : lists) grams.push_back({key, 0, (uint32_t)list.size()});
+    std::sort(grams.begin(), grams.end(), [](const Gram& a, const Gram& b) { return a.key < b.key; });
+    postings.clear();
+    postings.reserve(total);
+    for (Gram& gram : grams) {
+        const std::vector<uint32_t>& list = lists[gram.key];
+        gram.start = postings.size();
+        postings.insert(postings.end(), list.begin(), list.end());
+    }
+
+    candidates.reserve(entries.size());
+    narrowed.reserve(entries.size());
+}
+
+/*-----------------[Search]-----------------*/
+
+const CatalogIndex::Gram* CatalogIndex::find_gram(uint32_t key) const {
+    auto it = std::lower_bound(grams.begin(), grams.end(), key, [](const Gram& g, uint32_t k) { return g.key < k; });
+    return it != grams.end() && it->key == key ? &*it : nullptr;
+}
+
+bool CatalogIndex::matches(uint32_t id, const Query& query) const {
+    const Entry& entry = entries[id];
+    if (query.platforms && !(entry.platforms & query.platforms)) return false;
+    if ((query.min_year || query.max_year) && !entry.year) return false;
+    if (query.min_year && entry.year < query.min_year) return false;
+    if (query.max_year && entry.year > query.max_year) return false;
+    // trigrams only say the letters are there, not that they are in one run
+    std::string_view haystack = haystacks[id];
+    for (std::string_view word : words) {
+        if (haystack.find(word) == std::string_view::npos) return false;
+    }
+    return true;
+}
+
+void CatalogIndex::search(const Query& query, std::vector<uint32_t>& results) {
+    results.clear();
+    lowered.assign(query.text);
+    std::transform(lowered.begin(), lowered.end(), lowered.begin(), lower);
+    words.clear();
+    for (size_t i = 0; i < lowered.size();) {
+        while (i < lowered.size() && std::isspace((unsigned char)lowered[i])) i++;
+        size_t start = i;
+        while (i < lowered.size() && !std::isspace((unsigned char)lowered[i])) i++;
+        if (i > start) words.push_back(std::string_view(lowered).substr(start, i - start));
+    }
+
+    // start from the shortest posting list and intersect the rest into it
+    const Gram* shortest = nullptr;
+    for (std::string_view word : words) {
+        for (size_t i = 0; i + 3 <= word.size(); i++) {
+            const Gram* gram = find_gram(gram_key(&word[i]));
+            if (!gram) return;
+            if (!shortest || gram->count < shortest->count) shortest = gram;
+        }
+    }
+    if (shortest) {
+        candidates.assign(postings.begin() + shortest->start, postings.begin() + shortest->start + shortest->count);
+        for (std::string_view word : words) {
+            for (size_t i = 0; i + 3 <= word.size() && !candidates.empty(); i++) {
+                const Gram* gram = find_gram(gram_key(&word[i]));
+                if (gram == shortest) continue;
+                narrowed.clear();
+                std::set_intersection(candidates.begin(), candidates.end(), postings.begin() + gram->start,
+                                      postings.begin() + gram->start + gram->count, std::back_inserter(narrowed));
+                candidates.swap(narrowed);
+            }
+        }
+    } else {
+        // only words shorter than a trigram: check every entry
+        candidates.resize(entries.size());
+        std::iota(candidates.begin(), candidates.end(), 0);
+    }
+
+    for (uint32_t id : candidates) {
+        if (matches(id, query)) results.push_back(id);
+    }
+}
+
+/*-----------------[Access Functions]-----------------*/
+
+const CatalogIndex::Entry& CatalogIndex::entry(uint32_t id) const {
+    return entries.at(id);
+}
+
+size_t CatalogIndex::size() const {
+    return entries.size();
+}
+
+const std::vector<std::string>& CatalogIndex::platform_names() const {
+    return names;
+}
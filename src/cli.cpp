@@ -0,0 +1,777 @@
+#include <cpu/cpu.h>
+#include <batch/batch.h>
+#include <database/database.h>
+#include <debug/debugger.h>
+#include <detect/detector.h>
+#include <env/vec_env.h>
+#include <headless/headless.h>
+#include <library/library.h>
+#include <lockstep/lockstep.h>
+#include <lockstep/validator.h>
+#include <log/log.h>
+#include <shm/shared_state.h>
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <json.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+
+using json = nlohmann::json;
+
+void usage() {
+    std::cerr << "usage: nacho-cli <rom> [options]\n"
+                 "       nacho-cli batch <rom or directory>... [batch options]\n"
+                 "       nacho-cli vecenv <rom> [vecenv options]\n"
+                 "       nacho-cli lockstep <rom> [lockstep options]\n"
+                 "       nacho-cli validate <rom> [validate options]\n"
+                 "       nacho-cli scan <directory>... [scan options]\n"
+                 "       nacho-cli detect <rom> [detect options]\n"
+                 "       nacho-cli trace <trace file> (print a binary trace as text)\n"
+                 "  --frames N          frames to run (default 600)\n"
+                 "  --until COND        stop early: halt, pc=ADDR, vX=VAL, mem@ADDR=VAL (repeatable)\n"
+                 "  --platform NAME     force chip8, schip, schip1.1 or xochip instead of the database config\n"
+                 "  --input FILE        input script of \"<frame> press|release <key>\" lines\n"
+                 "  --press FRAME:KEY   press hex KEY at FRAME (repeatable)\n"
+                 "  --release FRAME:KEY release hex KEY at FRAME (repeatable)\n"
+                 "  --screen FILE       write the final framebuffer as a PPM image\n"
+                 "  --ascii             print the final framebuffer as text\n"
+                 "  --state FILE        write the final machine state as a save file\n"
+                 "  --stats             print run statistics as json\n"
+                 "  --profile FILE      write an opcode, hot pc, subroutine and coverage profile as json\n"
+                 "  --trace FILE        write the last instructions executed as a binary trace\n"
+                 "  --trace-size N      instructions the trace keeps (default 65536)\n"
+                 "  --shm NAME          publish every frame to shared memory NAME and take keys from it (shm/nacho_shm.h)\n"
+                 "  --realtime          run at 60 frames per second instead of as fast as possible\n"
+                 "  --break BP          stop before ADDR, ADDR if COND, or when COND becomes true (repeatable)\n"
+                 "  --watch RANGE       stop after an access to ADDR[-ADDR][:r|w|rw] (repeatable, default w)\n"
+                 "  --break-screen      stop after the first instruction that changes the screen\n"
+                 "  --detect FILE       pick a config for roms the database doesn't support, cached in FILE\n"
+                 "  --db DIR            database directory (default: database)\n"
+                 "batch options:\n"
+                 "  --frames N          frames to run each rom (default 600)\n"
+                 "  --threads N         worker threads (default: one per hardware thread)\n"
+                 "  --platform NAME     force a platform for every rom\n"
+                 "  --json FILE         write per rom results as json\n"
+                 "  --csv FILE          write per rom results as csv\n"
+                 "  --db DIR            database directory (default: database)\n"
+                 "vecenv options (measures environment steps per second with random actions):\n"
+                 "  --envs N            parallel instances (default 64)\n"
+                 "  --steps N           steps to run (default 1000)\n"
+                 "  --frameskip N       frames per step (default 4)\n"
+                 "  --format NAME       packed, lores or hires observations (default packed)\n"
+                 "  --threads N         worker threads (default: one per hardware thread)\n"
+                 "  --db DIR            database directory (default: database)\n"
+                 "lockstep options (runs the same lanes on the lockstep engine and on separate CPUs):\n"
+                 "  --lanes N           instances, at most 64 (default 64)\n"
+                 "  --frames N          frames to run (default 600)\n"
+                 "  --db DIR            database directory (default: database)\n"
+                 "validate options (compares the lockstep engine with the reference interpreter every frame):\n"
+                 "  --lanes N           instances, each with its own seed (default 4)\n"
+                 "  --frames N          frames to run (default 600)\n"
+                 "  --platform NAME     force a platform instead of the database config\n"
+                 "  --input FILE        input script applied to every lane\n"
+                 "  --press FRAME:KEY   press hex KEY at FRAME (repeatable)\n"
+                 "  --release FRAME:KEY release hex KEY at FRAME (repeatable)\n"
+                 "  --db DIR            database directory (default: database)\n"
+                 "scan options (identifies every rom in the directories against the database):\n"
+                 "  --cache FILE        hash cache; unchanged files are not read again (default: library.cache)\n"
+                 "  --threads N         worker threads (default: one per hardware thread)\n"
+                 "  --list              print sha1, title and path of every rom\n"
+                 "  --db DIR            database directory (default: database)\n"
+                 "detect options (scores every platform profile and quirk variant on the rom):\n"
+                 "  --frames N          frames each candidate runs (default 300)\n"
+                 "  --threads N         worker threads (default: one per hardware thread)\n"
+                 "  --db DIR            database directory (default: database)"
+              << std::endl;
+}
+
+bool parse_event(std::string text, bool pressed, Headless::InputEvent& event) {
+    size_t colon = text.find(':');
+    if (colon == std::string::npos) return false;
+    try {
+        event.frame = std::stoull(text.substr(0, colon));
+        int key = std::stoi(text.substr(colon + 1), nullptr, 16);
+        if (key < 0 || key > 0xF) return false;
+        event.key = key;
+    } catch (const std::exception& e) {
+        return false;
+    }
+    event.pressed = pressed;
+    return true;
+}
+
+// run many roms in parallel and summarize the sweep
+int run_batch(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    std::string db_dir = "database";
+    std::string json_file, csv_file;
+    uint64_t frames = 600;
+    unsigned threads = 0;
+    int platform = -1;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            paths.push_back(arg);
+        } else if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--frames") {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--threads") {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--platform") {
+            platform = parse_platform(argv[++i]);
+            if (platform < 0) {
+                std::cerr << "Unknown platform " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--json") {
+            json_file = argv[++i];
+        } else if (arg == "--csv") {
+            csv_file = argv[++i];
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<std::string> roms = collect_roms(paths);
+    if (roms.empty()) {
+        std::cerr << "No roms found" << std::endl;
+        return 1;
+    }
+
+    Database db(db_dir);
+    BatchRunner runner(db, threads);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results = runner.run(roms, frames, platform);
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    if (!json_file.empty() && !write_batch_json(json_file, results)) return 1;
+    if (!csv_file.empty() && !write_batch_csv(csv_file, results)) return 1;
+
+    uint64_t instructions = 0, invalid = 0, faults = 0, failed = 0, known = 0;
+    for (const BatchResult& r : results) {
+        instructions += r.instructions;
+        invalid += r.invalid_opcodes;
+        faults += r.stack_faults + r.fetch_faults;
+        if (!r.error.empty()) failed++;
+        if (!r.title.empty()) known++;
+    }
+
+    json summary;
+    summary["roms"] = results.size();
+    summary["in_database"] = known;
+    summary["failed"] = failed;
+    summary["threads"] = runner.threads();
+    summary["frames_per_rom"] = frames;
+    summary["instructions"] = instructions;
+    summary["invalid_opcodes"] = invalid;
+    summary["faults"] = faults;
+    summary["seconds"] = seconds;
+    summary["aggregate_mips"] = seconds > 0 ? instructions / seconds / 1e6 : 0.0;
+    std::cout << summary.dump(2) << std::endl;
+    return 0;
+}
+
+// throughput check for the vectorized environment
+int run_vecenv(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    std::string rom_path = argv[2];
+    std::string db_dir = "database";
+    size_t num_envs = 64, steps = 1000;
+    uint32_t frame_skip = 4;
+    unsigned threads = 0;
+    VecEnv::FrameFormat format = VecEnv::PACKED;
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--envs") {
+            num_envs = std::stoull(argv[++i]);
+        } else if (arg == "--steps") {
+            steps = std::stoull(argv[++i]);
+        } else if (arg == "--frameskip") {
+            frame_skip = std::stoul(argv[++i]);
+        } else if (arg == "--threads") {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--format") {
+            std::string name = argv[++i];
+            if (name == "packed") {
+                format = VecEnv::PACKED;
+            } else if (name == "lores") {
+                format = VecEnv::LORES_BYTES;
+            } else if (name == "hires") {
+                format = VecEnv::HIRES_BYTES;
+            } else {
+                std::cerr << "Unknown format " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ifstream file(rom_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << rom_path << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Database db(db_dir);
+    CPU::Config config = db.gen_config(CPU::hash_data(rom.data(), rom.size()));
+
+    VecEnv env(rom, config, num_envs, format, threads);
+    std::vector<uint8_t> frames(env.size() * env.frame_bytes());
+    std::vector<uint16_t> actions(env.size());
+    std::vector<uint32_t> skips(env.size(), frame_skip);
+    std::vector<float> rewards(env.size());
+    std::vector<uint8_t> dones(env.size());
+
+    env.reset(frames.data());
+
+    uint32_t rng = 1;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < steps; s++) {
+        for (uint16_t& action : actions) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            action = 1 << (rng & 0xF);
+        }
+        env.step(actions.data(), skips.data(), frames.data(), rewards.data(), dones.data());
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    json out;
+    out["envs"] = env.size();
+    out["steps"] = steps;
+    out["frame_skip"] = frame_skip;
+    out["seconds"] = seconds;
+    out["env_steps_per_second"] = seconds > 0 ? env.size() * steps / seconds : 0.0;
+    out["frames_per_second"] = seconds > 0 ? env.size() * steps * frame_skip / seconds : 0.0;
+    std::cout << out.dump(2) << std::endl;
+    return 0;
+}
+
+// throughput of the lockstep engine against one CPU per lane
+int run_lockstep(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    std::string rom_path = argv[2];
+    std::string db_dir = "database";
+    size_t lanes = MAX_LANES;
+    uint64_t frames = 600;
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--lanes") {
+            lanes = std::stoull(argv[++i]);
+        } else if (arg == "--frames") {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ifstream file(rom_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << rom_path << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Database db(db_dir);
+    CPU::Config config = db.gen_config(CPU::hash_data(rom.data(), rom.size()));
+
+    LockstepEngine engine(config, lanes);
+    if (engine.load(rom.data(), rom.size()) < 0) return 1;
+    for (size_t lane = 0; lane < engine.size(); lane++) {
+        engine.seed(lane, 1 + lane);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t f = 0; f < frames; f++) {
+        engine.run_frame();
+    }
+    double lockstep_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t cpu_instructions = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t lane = 0; lane < engine.size(); lane++) {
+        CPU cpu;
+        cpu.set_config(config);
+        cpu.load_program_data(rom.data(), rom.size());
+        cpu.seed(1 + lane);
+        cpu.resume();
+        for (uint64_t f = 0; f < frames; f++) {
+            cpu.run_frame();
+        }
+        cpu_instructions += cpu.get_stats().instructions;
+    }
+    double cpu_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LockstepEngine::Stats stats = engine.get_stats();
+    uint64_t instructions = stats.vector_instructions + stats.scalar_instructions;
+    json out;
+    out["lanes"] = engine.size();
+    out["frames"] = frames;
+    out["instructions"] = instructions;
+    out["vector_steps"] = stats.vector_steps;
+    out["vector_share"] = instructions ? (double)stats.vector_instructions / instructions : 0.0;
+    out["lockstep_mips"] = lockstep_seconds > 0 ? instructions / lockstep_seconds / 1e6 : 0.0;
+    out["cpu_instructions"] = cpu_instructions;
+    out["cpu_mips"] = cpu_seconds > 0 ? cpu_instructions / cpu_seconds / 1e6 : 0.0;
+    std::cout << out.dump(2) << std::endl;
+    return 0;
+}
+
+// run the lockstep engine against the reference interpreter; exits 1 with a report on the first divergence
+int run_validate(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    std::string rom_path = argv[2];
+    std::string db_dir = "database";
+    size_t lanes = 4;
+    uint64_t frames = 600;
+    int platform = -1;
+    std::vector<Headless::InputEvent> events;
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--lanes") {
+            lanes = std::stoull(argv[++i]);
+        } else if (arg == "--frames") {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--platform") {
+            platform = parse_platform(argv[++i]);
+            if (platform < 0) {
+                std::cerr << "Unknown platform " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--input") {
+            if (read_input_script(argv[++i], events) != 0) return 1;
+        } else if (arg == "--press" || arg == "--release") {
+            Headless::InputEvent event;
+            if (!parse_event(argv[++i], arg == "--press", event)) {
+                std::cerr << "Invalid input event " << argv[i] << std::endl;
+                return 1;
+            }
+            events.push_back(event);
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ifstream file(rom_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << rom_path << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Database db(db_dir);
+    CPU::Config config = platform >= 0 ? db.gen_platform_config(platform)
+                                       : db.gen_config(CPU::hash_data(rom.data(), rom.size()));
+
+    LockstepValidator validator(config, lanes);
+    if (validator.load(rom.data(), rom.size()) < 0) return 1;
+    for (const Headless::InputEvent& event : events) validator.add_input(event);
+
+    if (!validator.run(frames)) {
+        std::cerr << divergence_to_text(validator.divergence());
+        return 1;
+    }
+    std::cout << validator.size() << " lanes matched for " << validator.frames() << " frames" << std::endl;
+    return 0;
+}
+
+// identify a rom library, reusing the hash cache from the last scan
+int run_scan(int argc, char* argv[]) {
+    std::vector<std::string> dirs;
+    std::string db_dir = "database";
+    std::string cache = "library.cache";
+    unsigned threads = 0;
+    bool list = false;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            dirs.push_back(arg);
+        } else if (arg == "--list") {
+            list = true;
+        } else if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--cache") {
+            cache = argv[++i];
+        } else if (arg == "--threads") {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (dirs.empty()) {
+        usage();
+        return 1;
+    }
+
+    Database db(db_dir);
+    RomLibrary library(db, cache, threads);
+    for (const std::string& dir : dirs) library.add_directory(dir);
+    auto start = std::chrono::steady_clock::now();
+    library.load_cache();
+    double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    RomLibrary::ScanStats stats = library.scan();
+
+    if (list) {
+        for (const LibraryRom& rom : library.roms()) {
+            std::cout << rom.sha1 << "  " << (rom.title.empty() ? "-" : rom.title) << "  " << rom.path << "\n";
+        }
+    }
+    json summary;
+    summary["files"] = stats.files;
+    summary["hashed"] = stats.hashed;
+    summary["cached"] = stats.cached;
+    summary["removed"] = stats.removed;
+    summary["matched"] = stats.matched;
+    summary["threads"] = library.threads();
+    summary["cache_load_seconds"] = load_seconds;
+    summary["scan_seconds"] = stats.seconds;
+    std::cout << summary.dump(2) << std::endl;
+    return 0;
+}
+
+// rank every candidate config for a rom, best first
+int run_detect(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    std::string rom_path = argv[2];
+    std::string db_dir = "database";
+    uint64_t frames = DETECT_FRAMES;
+    unsigned threads = 0;
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--frames") {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--threads") {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ifstream file(rom_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << rom_path << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Database db(db_dir);
+    QuirkDetector detector(db, "", threads);
+    detector.set_frames(frames);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<QuirkDetector::Result> results = detector.rank(rom.data(), rom.size());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const QuirkDetector::Result& result : results) std::cout << detect_result_to_text(result) << "\n";
+    std::cout << results.size() << " candidates in " << seconds * 1000 << " ms" << std::endl;
+    return 0;
+}
+
+// print a binary trace written by --trace or the GUI as text
+int run_trace(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    std::vector<TraceEntry> entries;
+    if (!load_trace(argv[2], entries)) return 1;
+    std::cout << "   frame   pc   op I      reg     VF" << std::endl;
+    for (const TraceEntry& entry : entries) {
+        std::cout << trace_entry_to_text(entry) << "\n";
+    }
+    std::cout.flush();
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    if (std::string(argv[1]) == "batch") {
+        return run_batch(argc, argv);
+    }
+    if (std::string(argv[1]) == "vecenv") {
+        return run_vecenv(argc, argv);
+    }
+    if (std::string(argv[1]) == "lockstep") {
+        return run_lockstep(argc, argv);
+    }
+    if (std::string(argv[1]) == "validate") {
+        return run_validate(argc, argv);
+    }
+    if (std::string(argv[1]) == "scan") {
+        return run_scan(argc, argv);
+    }
+    if (std::string(argv[1]) == "detect") {
+        return run_detect(argc, argv);
+    }
+    if (std::string(argv[1]) == "trace") {
+        return run_trace(argc, argv);
+    }
+
+    std::string rom = argv[1];
+    std::string db_dir = "database";
+    std::string input_script, screen_file, state_file, profile_file, trace_file, shm_name;
+    size_t trace_size = 1 << 16;
+    uint64_t frames = 600;
+    int platform = -1;
+    bool ascii = false, print_stats = false, realtime = false;
+
+    std::string detect_cache;
+    bool detect = false;
+
+    CPU cpu;
+    Headless headless(cpu);
+    Debugger debugger;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--ascii") {
+            ascii = true;
+        } else if (arg == "--stats") {
+            print_stats = true;
+        } else if (arg == "--break-screen") {
+            debugger.break_on_screen_change(true);
+        } else if (arg == "--realtime") {
+            realtime = true;
+        } else if (!has_value) {
+            usage();
+            return 1;
+        } else if (arg == "--frames") {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--until") {
+            Headless::Condition condition;
+            if (!parse_condition(argv[++i], condition)) {
+                std::cerr << "Invalid condition " << argv[i] << std::endl;
+                return 1;
+            }
+            headless.add_condition(condition);
+        } else if (arg == "--platform") {
+            platform = parse_platform(argv[++i]);
+            if (platform < 0) {
+                std::cerr << "Unknown platform " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--input") {
+            input_script = argv[++i];
+        } else if (arg == "--press" || arg == "--release") {
+            Headless::InputEvent event;
+            if (!parse_event(argv[++i], arg == "--press", event)) {
+                std::cerr << "Invalid input event " << argv[i] << std::endl;
+                return 1;
+            }
+            headless.add_input(event);
+        } else if (arg == "--screen") {
+            screen_file = argv[++i];
+        } else if (arg == "--state") {
+            state_file = argv[++i];
+        } else if (arg == "--profile") {
+            profile_file = argv[++i];
+        } else if (arg == "--trace") {
+            trace_file = argv[++i];
+        } else if (arg == "--trace-size") {
+            trace_size = std::stoull(argv[++i]);
+        } else if (arg == "--shm") {
+            shm_name = argv[++i];
+        } else if (arg == "--break") {
+            Debugger::Breakpoint breakpoint;
+            if (!Debugger::parse_breakpoint(argv[++i], breakpoint)) {
+                std::cerr << "Invalid breakpoint " << argv[i] << std::endl;
+                return 1;
+            }
+            if (breakpoint.conditional) {
+                debugger.add_breakpoint(breakpoint.pc, breakpoint.condition);
+            } else {
+                debugger.add_breakpoint(breakpoint.pc);
+            }
+        } else if (arg == "--watch") {
+            Debugger::Watchpoint watch;
+            if (!Debugger::parse_watchpoint(argv[++i], watch)) {
+                std::cerr << "Invalid watchpoint " << argv[i] << std::endl;
+                return 1;
+            }
+            debugger.add_watchpoint(watch);
+        } else if (arg == "--detect") {
+            detect = true;
+            detect_cache = argv[++i];
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!input_script.empty() && headless.load_input_script(input_script) != 0) {
+        return 1;
+    }
+
+    Database db(db_dir);
+    std::unique_ptr<QuirkDetector> detector;
+    if (detect) {
+        detector = std::make_unique<QuirkDetector>(db, detect_cache);
+        headless.set_detector(detector.get());
+    }
+    if (headless.load(rom, db, platform) < 0) {
+        std::cerr << "Failed to load " << rom << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<GuestProfiler> profiler;
+    if (!profile_file.empty()) {
+        profiler = std::make_unique<GuestProfiler>();
+        cpu.set_guest_profiler(profiler.get());
+    }
+    std::unique_ptr<TraceBuffer> trace;
+    if (!trace_file.empty()) {
+        trace = std::make_unique<TraceBuffer>(trace_size);
+        cpu.set_trace(trace.get());
+    }
+    cpu.set_debugger(&debugger);
+    SharedState shared;
+    if (!shm_name.empty()) {
+        if (!shared.open(shm_name)) return 1;
+        cpu.set_shared_state(&shared);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t frames_run = 0;
+    if (realtime) {
+        // one frame per 60 Hz tick so readers of the shared region see every frame
+        auto next = start;
+        while (frames_run < frames) {
+            uint64_t ran = headless.run(1);
+            frames_run += ran;
+            if (!ran || headless.condition_met()) break;
+            next += std::chrono::microseconds(16667);
+            std::this_thread::sleep_until(next);
+        }
+    } else {
+        frames_run = headless.run(frames);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::string stopped = Debugger::describe(debugger.last_hit());
+    if (!stopped.empty() && !print_stats) std::cerr << "Stopped: " << stopped << std::endl;
+
+    auto screenlock{cpu.get_screen()};
+    screenlock.lock.unlock();
+
+    if (!screen_file.empty() && !write_screen_ppm(screen_file, screenlock.screen, cpu.config)) {
+        return 1;
+    }
+
+    if (profiler && !profiler->export_json(profile_file)) {
+        return 1;
+    }
+
+    if (trace && !trace->dump(trace_file)) {
+        return 1;
+    }
+
+    if (!state_file.empty()) {
+        std::ofstream file(state_file);
+        if (!file.is_open()) {
+            std::cerr << "Could not open " << state_file << std::endl;
+            return 1;
+        }
+        file << cpu.gen_save().dump(2);
+    }
+
+    if (ascii) {
+        std::cout << screen_to_ascii(screenlock.screen);
+    }
+
+    if (print_stats) {
+        CPU::Stats stats = cpu.get_stats();
+
+        json out;
+        out["rom"] = rom;
+        out["sha1"] = headless.get_hash();
+        out["system"] = cpu.config.system;
+        out["frames"] = frames_run;
+        out["condition_met"] = headless.condition_met();
+        if (!stopped.empty()) out["break"] = stopped;
+        out["instructions"] = stats.instructions;
+        out["invalid_opcodes"] = stats.invalid_opcodes;
+        out["stack_faults"] = stats.stack_faults;
+        out["fetch_faults"] = stats.fetch_faults;
+        out["pc"] = cpu.get_pc();
+        out["seconds"] = seconds;
+        out["mips"] = seconds > 0 ? stats.instructions / seconds / 1e6 : 0.0;
+        out["screen_hash"] = hash_to_hex(hash_screen(screenlock.screen));
+        uint64_t suppressed = 0;
+        for (const LogCounter& counter : logging::counters()) suppressed += counter.suppressed;
+        out["log_suppressed"] = suppressed + logging::dropped();
+        logging::flush();
+        std::cout << out.dump(2) << std::endl;
+    }
+
+    return 0;
+}
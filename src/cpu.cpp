@@ -1,14 +1,23 @@
 #include <cpu/cpu.h>
-#include <openssl/sha.h>
-
+#include <cpu/kernels.h>
+#include <debug/debugger.h>
+#include <log/log.h>
+#include <perf/alloc_counter.h>
+#include <io/rom_file.h>
+#include <shm/shared_state.h>
+
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstddef>
 #include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <json.hpp>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -56,21 +65,51 @@ const uint8_t big_fonts[] = {
 
 /*-----------------[Special Member Functions]-----------------*/
 CPU::CPU() {
+    // the register line and each group shared with another thread start their own cache line
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+#endif
+    static_assert(offsetof(CPU, PC) % CACHE_LINE == 0, "registers start a cache line");
+    static_assert(offsetof(CPU, quirks) + sizeof(Quirks) <= offsetof(CPU, PC) + CACHE_LINE,
+                  "quirks share the register line");
+    static_assert(offsetof(CPU, screen) % CACHE_LINE == 0, "screen starts a cache line");
+    static_assert(offsetof(CPU, screen_mtx) % CACHE_LINE == 0, "screen handoff starts a cache line");
+    static_assert(offsetof(CPU, key_mtx) % CACHE_LINE == 0, "input mailbox starts a cache line");
+    static_assert(offsetof(CPU, stop) % CACHE_LINE == 0, "controls start a cache line");
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
 #ifdef _WIN32
     if (timeBeginPeriod(2) == TIMERR_NOCANDO) {
         std::cerr << "Failed to set high resolution timer. Frame rate may be off" << std::endl;
     }
 #endif
-    // copy fonts to memory (0x050 - 0x09F)
-    std::copy(std::begin(fonts), std::end(fonts), memory.begin() + 0x50);
-    // copy big fonts to memory (0xA0 - 0x13F)
-    std::copy(std::begin(big_fonts), std::end(big_fonts), memory.begin() + 0xA0);
+    init_memory();
 };
 
+// clear memory left by a previous program and restore the fonts
+void CPU::init_memory() {
+    memory = boot_memory();
+}
+
+const PagedMemory& boot_memory() {
+    static const PagedMemory boot = [] {
+        PagedMemory memory;
+        // copy fonts to memory (0x050 - 0x09F)
+        memory.copy_in(0x50, fonts, sizeof(fonts));
+        // copy big fonts to memory (0xA0 - 0x13F)
+        memory.copy_in(0xA0, big_fonts, sizeof(big_fonts));
+        return memory;
+    }();
+    return boot;
+}
+
 /*-----------------[Stack]-----------------*/
 void CPU::push(uint16_t x) {
     if (SP == MAX_STACK - 1) {
-        std::cerr << "Cannot push; Stack full" << std::endl;
+        NACHO_LOG(LOG_WARN, "Cannot push; Stack full (PC %04X)", PC);
+        stats.stack_faults += 1;
         return;
     }
     stack[++SP] = x;
@@ -78,7 +117,8 @@ void CPU::push(uint16_t x) {
 
 uint16_t CPU::pop() {
     if (SP == -1) {
-        std::cerr << "Cannot pop; Stack empty" << std::endl;
+        NACHO_LOG(LOG_WARN, "Cannot pop; Stack empty (PC %04X)", PC);
+        stats.stack_faults += 1;
         return 0;
     }
     return stack[SP--];
@@ -86,7 +126,8 @@ uint16_t CPU::pop() {
 
 uint16_t CPU::peek() {
     if (SP == -1) {
-        std::cerr << "Cannot peek; Stack empty" << std::endl;
+        NACHO_LOG(LOG_WARN, "Cannot peek; Stack empty (PC %04X)", PC);
+        stats.stack_faults += 1;
         return 0;
     }
     return stack[SP];
@@ -94,66 +135,94 @@ uint16_t CPU::peek() {
 
 /*-----------------[IO Functions]-----------------*/
 
-// load program into memory starting from 0x200 (512)
+// load program into memory at the configured start address, straight from the mapped file
 int CPU::loadProgram(std::string filepath) {
     reset();
-    std::cout << filepath << std::endl;
-    std::ifstream program(filepath, std::ios::binary);
-    if (!program.is_open()) {
-        std::cerr << "Invalid file" << std::endl;
-        return -1;
-    }
-
-    program.seekg(0, std::ios::end);
-    std::streampos fileSize = program.tellg();
-    program.seekg(0, std::ios::beg);
+    NACHO_LOG(LOG_INFO, "Loading %s", filepath.c_str());
+    RomFile rom;
+    if (!rom.open(filepath)) return -1;
+    return load_program_data(rom.data(), rom.size());
+}
 
-    if (fileSize > MAX_MEM - config.start_address) {
+// load program already in host memory (e.g. read by a batch runner) starting from start address
+int CPU::load_program_data(const uint8_t* data, size_t size) {
+    reset();
+    if (size > (size_t)(MAX_MEM - config.start_address)) {
         std::cerr << "File size exceeds max program size" << std::endl;
         return -2;
     }
+    init_memory();
+    memory.copy_in(config.start_address, data, size);
+    PC = config.start_address;
+    return size;
+}
 
-    program.read(reinterpret_cast<char*>(memory.data() + config.start_address), fileSize);
-
-    for (int i = config.start_address; i < config.start_address + (int)fileSize; i++) {
-        printf("%02x ", memory[i]);
-        fflush(stdout);
-    }
-    printf("\n");
-    fflush(stdout);
-
+int CPU::load_image(const PagedMemory& image) {
+    reset();
+    memory = image;
     PC = config.start_address;
-    return fileSize;
+    return 0;
 }
 
-std::string CPU::hash_bin(int fileSize) {
-    // compute hash
-    unsigned char hash[SHA_DIGEST_LENGTH];
-    SHA1(memory.data() + config.start_address, fileSize, hash);
+// fonts plus the program at start_address, ready to be shared through load_image
+PagedMemory CPU::build_image(const uint8_t* data, size_t size, uint16_t start_address) {
+    PagedMemory image = boot_memory();
+    image.copy_in(start_address, data, std::min(size, (size_t)(MAX_MEM - start_address)));
+    return image;
+}
 
-    std::ostringstream oss;
-    for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    }
-    return oss.str();
+std::string CPU::hash_data(const uint8_t* data, size_t size) {
+    Sha1Stream digest;
+    digest.update(data, size);
+    return digest.hex();
 }
 
 /*-----------------[Access Functions]-----------------*/
 
 void CPU::press_key(uint8_t key) {
-    std::lock_guard<std::mutex> lock(key_mtx);
+    std::lock_guard<ContendedMutex> lock(key_mtx);
+    key_down(key);
+}
+
+void CPU::release_key(uint8_t key) {
+    std::lock_guard<ContendedMutex> lock(key_mtx);
+    key_up(key);
+}
+
+// replace the whole keypad state at once, raising the same edges as press/release so FX0A still sees them.
+// The diff is taken under the lock so a key callback on another thread can't slip in between
+void CPU::set_keys(uint16_t mask) {
+    std::lock_guard<ContendedMutex> lock(key_mtx);
+    uint16_t changed = keys ^ mask;
+    for (uint8_t key = 0; key < 16; key++) {
+        if (!((changed >> key) & 1)) continue;
+        if ((mask >> key) & 1) {
+            key_down(key);
+        } else {
+            key_up(key);
+        }
+    }
+}
+
+void CPU::key_down(uint8_t key) {
     keys |= (1 << key);
     pressed |= (1 << key);
 }
 
-void CPU::release_key(uint8_t key) {
-    std::lock_guard<std::mutex> lock(key_mtx);
-    keys ^= (1 << key);
+// clears rather than toggles, so a release of a key that is already up leaves it up
+void CPU::key_up(uint8_t key) {
+    keys &= ~(1 << key);
     released = key;
 }
 
 CPU::ScreenLock CPU::get_screen() {
-    return {std::unique_lock<std::mutex>(screen_mtx), screen};
+    FrameProfiler::Scope handoff(profiler.load(std::memory_order_relaxed), FrameProfiler::HANDOFF);
+    return {std::unique_lock<ContendedMutex>(screen_mtx), screen};
+}
+
+// unsynchronized view of the framebuffer; only for drivers that run frames on the calling thread
+const std::array<uint8_t, SCREEN_SIZE>& CPU::screen_view() {
+    return screen;
 }
 
 bool CPU::check_screen() {
@@ -164,13 +233,37 @@ bool CPU::check_screen() {
     return false;
 }
 
-void CPU::set_audio_callback(std::function<void(void)> callback) {
+void CPU::set_profiler(FrameProfiler* frame_profiler) {
+    profiler = frame_profiler;
+}
+
+void CPU::set_guest_profiler(GuestProfiler* guest) {
+    guest_profiler = guest;
+}
+
+void CPU::set_trace(TraceBuffer* tracer) {
+    trace = tracer;
+}
+
+void CPU::set_metrics(RuntimeMetrics* runtime_metrics) {
+    metrics = runtime_metrics;
+}
+
+void CPU::set_debugger(Debugger* cpu_debugger) {
+    debugger = cpu_debugger;
+}
+
+void CPU::set_shared_state(SharedState* shared) {
+    shared_state = shared;
+}
+
+void CPU::set_audio_callback(void (*callback)(void* context), void* context) {
     audio_callback = callback;
+    audio_context = context;
 }
 
 // Generate a frames worth of audio samples from the pattern buffer
-std::array<uint8_t, SAMPLE_SIZE> CPU::gen_frame_samples() {
-    std::array<uint8_t, SAMPLE_SIZE> samples;
+void CPU::gen_frame_samples(uint8_t* samples) {
     float step_size = playback_rate / 128 / DEVICE_SAMPLE_RATE;
 
     for (int i = 0; i < SAMPLE_SIZE; i++) {
@@ -178,7 +271,6 @@ std::array<uint8_t, SAMPLE_SIZE> CPU::gen_frame_samples() {
         phase = fmod(position, 1.0);
         samples[i] = MAX_AMPLITUDE * audio_pattern[int(128 * phase)];
     }
-    return samples;
 }
 
 bool CPU::check_stop() {
@@ -196,9 +288,106 @@ bool CPU::check_color() {
 void CPU::set_config(Config config) {
     pause();
     CPU::config = config;
+    quirks = config.quirks;
     color_update = true;
 }
 
+uint16_t CPU::get_pc() {
+    return PC;
+}
+
+uint16_t CPU::get_index() {
+    return I;
+}
+
+uint8_t CPU::get_register(uint8_t reg) {
+    return registers[reg & 0xF];
+}
+
+uint8_t CPU::get_plane() {
+    return bit_plane;
+}
+
+uint8_t CPU::get_delay() {
+    return delay;
+}
+
+uint8_t CPU::get_sound() {
+    return sound;
+}
+
+int CPU::get_sp() {
+    return SP;
+}
+
+uint16_t CPU::get_stack(int level) {
+    return stack[level & (MAX_STACK - 1)];
+}
+
+uint16_t CPU::get_keys() {
+    std::lock_guard<ContendedMutex> lock(key_mtx);
+    return keys;
+}
+
+bool CPU::is_lores() {
+    return lores;
+}
+
+uint8_t CPU::read_memory(uint16_t addr) {
+    return memory.read(addr);
+}
+
+const PagedMemory& CPU::get_memory() {
+    return memory;
+}
+
+void CPU::reserve_pages(size_t count) {
+    memory.reserve(count);
+}
+
+CPU::Stats CPU::get_stats() {
+    return stats;
+}
+
+void CPU::reset_stats() {
+    stats = Stats{};
+}
+
+// seed the per instance generator used by CXNN so runs are reproducible and threads don't share state
+void CPU::seed(uint32_t seed) {
+    rng_state = seed ? seed : 1;
+}
+
+std::unique_ptr<CPU> CPU::fork() {
+    std::unique_ptr<CPU> copy = std::make_unique<CPU>();
+    copy->config = config;
+    copy->quirks = quirks;
+    copy->memory = memory;
+    copy->screen = screen;
+    copy->PC = PC;
+    copy->I = I;
+    copy->stack = stack;
+    copy->SP = SP;
+    copy->delay = delay;
+    copy->sound = sound;
+    copy->registers = registers;
+    copy->flags = flags;
+    copy->audio_pattern = audio_pattern;
+    copy->playback_rate = playback_rate;
+    copy->phase = phase;
+    copy->lores = lores;
+    copy->bit_plane = bit_plane;
+    copy->keys = keys;
+    copy->pressed = pressed;
+    copy->released = released;
+    copy->waiting = waiting;
+    copy->stats = stats;
+    copy->rng_state = rng_state;
+    copy->draw = draw;
+    copy->paused = paused.load();
+    return copy;
+}
+
 // TODO fix bug when changing games that use diff systems
 void CPU::reset() {
     pause();
@@ -264,8 +453,11 @@ json CPU::gen_save() {
     // save config, memory, screen, PC, I, stack, registers, timers, flags, mode
 
     save["config"] = config;
-    save["memory"] = memory;
-    save["screen"] = screen;
+    // go through vectors; nlohmann's std::array conversions unroll per element and are very slow to compile
+    std::vector<uint8_t> memory_bytes(MAX_MEM);
+    memory.copy_out(0, memory_bytes.data(), MAX_MEM);
+    save["memory"] = memory_bytes;
+    save["screen"] = std::vector<uint8_t>(screen.begin(), screen.end());
     save["PC"] = PC;
     save["I"] = I;
     save["Stack"] = stack;
@@ -296,8 +488,11 @@ int CPU::load_save(std::ifstream& file) {
     }
 
     set_config(save["config"]);
-    memory = save["memory"];
-    screen = save["screen"];
+    std::vector<uint8_t> memory_bytes = save["memory"];
+    std::vector<uint8_t> screen_bytes = save["screen"];
+    init_memory();
+    memory.copy_in(0, memory_bytes.data(), std::min(memory_bytes.size(), (size_t)MAX_MEM));
+    std::copy_n(screen_bytes.begin(), std::min(screen_bytes.size(), screen.size()), screen.begin());
     PC = save["PC"];
     I = save["I"];
     stack = save["Stack"];
@@ -314,6 +509,86 @@ int CPU::load_save(std::ifstream& file) {
     return 0;
 }
 
+/*-----------------[Binary State]-----------------*/
+
+template <typename Field>
+void CPU::state_fields(Field&& field) {
+    field(&config.system, sizeof(config.system));
+    field(&config.speed, sizeof(config.speed));
+    field(&config.start_address, sizeof(config.start_address));
+    field(&config.quirks, sizeof(config.quirks));
+    field(config.colors.data(), sizeof(config.colors));
+    field(&PC, sizeof(PC));
+    field(&I, sizeof(I));
+    field(&SP, sizeof(SP));
+    field(&delay, sizeof(delay));
+    field(&sound, sizeof(sound));
+    field(registers.data(), sizeof(registers));
+    field(flags.data(), sizeof(flags));
+    field(stack.data(), sizeof(stack));
+    field(audio_pattern.data(), sizeof(audio_pattern));
+    field(&playback_rate, sizeof(playback_rate));
+    field(&phase, sizeof(phase));
+    field(&lores, sizeof(lores));
+    field(&bit_plane, sizeof(bit_plane));
+    field(&waiting, sizeof(waiting));
+    field(&draw, sizeof(draw));
+    field(&keys, sizeof(keys));
+    field(&pressed, sizeof(pressed));
+    field(&released, sizeof(released));
+    field(&rng_state, sizeof(rng_state));
+    field(&stats, sizeof(stats));
+}
+
+size_t CPU::state_size() {
+    size_t fields = 0;
+    state_fields([&fields](void*, size_t bytes) { fields += bytes; });
+    return 2 * sizeof(uint32_t) + fields + CPU_STATE_MEMORY + SCREEN_SIZE;
+}
+
+void CPU::save_state(uint8_t* out) {
+    uint32_t header[2] = {CPU_STATE_MAGIC, CPU_STATE_VERSION};
+    std::memcpy(out, header, sizeof(header));
+    out += sizeof(header);
+    state_fields([&out](void* field, size_t bytes) {
+        std::memcpy(out, field, bytes);
+        out += bytes;
+    });
+    memory.copy_out(0, out, CPU_STATE_MEMORY);
+    out += CPU_STATE_MEMORY;
+    std::memcpy(out, screen.data(), SCREEN_SIZE);
+}
+
+bool CPU::load_state(const uint8_t* data, size_t size) {
+    uint32_t header[2];
+    if (size != state_size()) return false;
+    std::memcpy(header, data, sizeof(header));
+    if (header[0] != CPU_STATE_MAGIC || header[1] != CPU_STATE_VERSION) return false;
+    data += sizeof(header);
+
+    // memory pages are swapped below, so let a running frame finish first
+    bool was_paused = paused;
+    pause();
+    std::lock_guard<ContendedMutex> keys_lock(key_mtx);
+    state_fields([&data](void* field, size_t bytes) {
+        std::memcpy(field, data, bytes);
+        data += bytes;
+    });
+    quirks = config.quirks;
+    // start from the boot image so pages the state doesn't change stay shared
+    init_memory();
+    memory.copy_in(0, data, CPU_STATE_MEMORY);
+    data += CPU_STATE_MEMORY;
+    {
+        std::lock_guard<ContendedMutex> screen_lock(screen_mtx);
+        std::memcpy(screen.data(), data, SCREEN_SIZE);
+    }
+    screen_update = true;
+    color_update = true;
+    paused = was_paused;
+    return true;
+}
+
 void CPU::dump_reg() {
     std::cout << "<------------[Reigsters]------------>" << std::endl;
     std::cout << std::hex << "I: " << I << std::endl;
@@ -329,36 +604,42 @@ void CPU::dump_reg() {
 void CPU::emulate_cycle() {
     uint16_t instruction = CPU::fetch();
     CPU::decode(instruction);
-    if (paused) {
-        std::cout << std::hex << "Executing: " << instruction << std::endl;
-    }
+    stats.instructions += 1;
 }
 
 // Start emulation loop running at speed instructions per cycle
 void CPU::emulate_loop() {
+    auto previous = std::chrono::high_resolution_clock::time_point{};
     while (1) {
         auto start = std::chrono::high_resolution_clock::now();
-        if (!paused) {
-            decrementTimers();
-            for (int i = 0; i < config.speed; i++) {
-                if (stop) {
-                    break;
-                }
-                if (draw) {
-                    draw = false;
-                    break;
-                }
-                emulate_cycle();
-            }
-            screen_update = true;
-            if (sound) audio_callback();
+        uint64_t start_instructions = stats.instructions;
+        uint64_t start_allocations = alloc_counter::thread_counts().allocations;
+        // in_frame is set before paused is read and pause() sets paused before reading in_frame, so either
+        // this frame is skipped or pause() waits for it
+        in_frame = true;
+        bool ran = !paused;
+        if (ran) {
+            run_frame();
         }
+        in_frame = false;
         if (stop) {
             break;
         }
+        auto work_end = std::chrono::high_resolution_clock::now();
+        uint64_t allocations = alloc_counter::thread_counts().allocations - start_allocations;
         std::this_thread::sleep_for(std::chrono::milliseconds(14));
         auto end = std::chrono::high_resolution_clock::now();
 
+        RuntimeMetrics* loop_metrics = metrics.load(std::memory_order_relaxed);
+        if (loop_metrics && ran) {
+            auto ms = [](auto duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+            double interval = previous.time_since_epoch().count() ? ms(start - previous) : 0;
+            loop_metrics->emulation_frame(ms(work_end - start), interval, ms(end - work_end) - 14,
+                                          stats.instructions - start_instructions, config.speed, allocations);
+            loop_metrics->lock_waits(screen_mtx, key_mtx);
+        }
+        previous = start;
+
         // spinlock remaining time until 16.666 ms
         auto diff = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
         while (diff.count() < 16666) {
@@ -368,49 +649,126 @@ void CPU::emulate_loop() {
     }
 }
 
-// TODO: add ui element to show MIPS and auto load 1dcell
-// add logic for calculating mips
-// In benchmark mode timers are not decremented and pausing is not possible
+// Run one 60Hz frame worth of instructions with no pacing (used directly by headless drivers)
+void CPU::run_frame() {
+    FrameProfiler* frame_profiler = profiler.load(std::memory_order_relaxed);
+    uint64_t start_instructions = stats.instructions;
+    SharedState* shared = shared_state.load(std::memory_order_relaxed);
+    if (shared) shared->apply_input(*this);
+    decrementTimers();
+    {
+        FrameProfiler::Scope execute(frame_profiler, FrameProfiler::EXECUTE);
+        GuestProfiler* guest = guest_profiler.load(std::memory_order_relaxed);
+        if (guest) guest->begin_frame();
+        TraceBuffer* tracer = trace.load(std::memory_order_relaxed);
+        Debugger* checks = debugger.load(std::memory_order_relaxed);
+        if (checks && !checks->begin_frame()) checks = nullptr;
+        if (guest || tracer || checks) {
+            run_instructions_instrumented(guest, tracer, checks);
+        } else {
+            run_instructions();
+        }
+    }
+    stats.frames += 1;
+    screen_update = true;
+    Debugger* frame_checks = debugger.load(std::memory_order_relaxed);
+    if (frame_checks && frame_checks->end_frame(*this, stats.frames)) paused = true;
+    if (shared) shared->publish(*this);
+    if (sound && audio_callback) {
+        FrameProfiler::Scope audio(frame_profiler, FrameProfiler::AUDIO);
+        audio_callback(audio_context);
+    }
+    if (frame_profiler) frame_profiler->frame_done(stats.instructions - start_instructions);
+}
+
+// one frame's instructions, cut short by a stop or a vblank wait after drawing
+void CPU::run_instructions() {
+    for (int i = 0; i < config.speed; i++) {
+        if (stop) {
+            break;
+        }
+        if (draw) {
+            draw = false;
+            break;
+        }
+        emulate_cycle();
+    }
+}
+
+// the same loop recording every instruction and checking breakpoints; kept separate so the plain loop
+// stays free of checks. A hit pauses and ends the frame early
+void CPU::run_instructions_instrumented(GuestProfiler* guest, TraceBuffer* tracer, Debugger* checks) {
+    for (int i = 0; i < config.speed; i++) {
+        if (stop) {
+            break;
+        }
+        if (draw) {
+            draw = false;
+            break;
+        }
+        uint16_t pc = PC;
+        uint16_t instruction = pc <= MAX_MEM - 2 ? memory.read16(pc) : 0;
+        if (checks && checks->before(*this, pc, instruction)) {
+            paused = true;
+            break;
+        }
+        if (guest && pc <= MAX_MEM - 2) guest->record(pc, instruction, I);
+        emulate_cycle();
+        if (tracer) {
+            uint8_t reg = TraceBuffer::written_register(instruction);
+            uint8_t value = reg == TRACE_NO_REG ? 0 : registers[reg];
+            tracer->record({(uint32_t)stats.frames, pc, instruction, I, reg, value, registers[0xF], {}});
+        }
+        if (checks && checks->after(*this, pc, instruction)) {
+            paused = true;
+            break;
+        }
+    }
+}
+
+// Run unpaced 16.666 ms frames and print MIPS once a second. The clock is read once per block of
+// instructions instead of after every instruction so timing doesn't distort the measurement.
+// Pausing is not possible in benchmark mode
 void CPU::benchmark() {
-    int mips = 0;
-    while (1) {
-        auto start_sec = std::chrono::high_resolution_clock::now();
-        auto diff_sec = std::chrono::microseconds{0};
+    const int block = 1024;
+    uint64_t total_instructions = 0;
+    double total_seconds = 0;
+
+    while (!stop) {
+        auto start_sec = std::chrono::steady_clock::now();
+        double elapsed_sec = 0;
+        uint64_t num_instructions = 0;
 
-        int num_instructions = 0;
-        while (diff_sec.count() < 1000000) {
+        while (elapsed_sec < 1.0 && !stop) {
             decrementTimers();
-            // change for loop to run for 16.666 ms
-            auto start_frame = std::chrono::high_resolution_clock::now();
-            auto diff_frame = std::chrono::microseconds{0};
-
-            while (diff_frame.count() < 16666) {
-                if (stop) break;
-                if (draw) {
-                    draw = false;
-                    break;
+            auto start_frame = std::chrono::steady_clock::now();
+            bool frame_done = false;
+
+            while (!frame_done) {
+                for (int i = 0; i < block; i++) {
+                    if (stop) break;
+                    if (draw) {
+                        draw = false;
+                        frame_done = true;
+                        break;
+                    }
+                    emulate_cycle();
+                    num_instructions += 1;
                 }
-
-                emulate_cycle();
-                num_instructions += 1;
-
-                auto loop_end = std::chrono::high_resolution_clock::now();
-                diff_frame = std::chrono::duration_cast<std::chrono::microseconds>(loop_end - start_frame);
-                diff_sec = std::chrono::duration_cast<std::chrono::microseconds>(loop_end - start_sec);
+                auto now = std::chrono::steady_clock::now();
+                frame_done = frame_done || stop || now - start_frame >= std::chrono::microseconds(16666);
+                elapsed_sec = std::chrono::duration<double>(now - start_sec).count();
             }
-            if (stop) break;
 
             screen_update = true;
-            if (sound) audio_callback();
+            if (sound && audio_callback) audio_callback(audio_context);
         }
         if (stop) break;
 
-        if (mips == 0) {
-            mips = num_instructions / 1000000;
-        } else {
-            mips = (mips + num_instructions / 1000000) / 2;
-        }
-        std::cout << "Mips: " << mips << std::endl;
+        total_instructions += num_instructions;
+        total_seconds += elapsed_sec;
+        std::cout << std::fixed << std::setprecision(2) << "MIPS: " << num_instructions / elapsed_sec / 1e6
+                  << " (average " << total_instructions / total_seconds / 1e6 << ")" << std::endl;
     }
 }
 
@@ -423,6 +781,7 @@ void CPU::decrementTimers() {
 // pause fetch decode loop
 void CPU::pause() {
     paused = true;
+    while (in_frame) std::this_thread::yield();
 }
 
 // resume fetch decode loop
@@ -433,9 +792,14 @@ void CPU::resume() {
 // run one fetch decode cycle
 void CPU::step() {
     if (!paused) pause();
+    if (PC <= MAX_MEM - 2) NACHO_LOG(LOG_INFO, "Executing: %04X", memory.read16(PC));
     emulate_cycle();
 }
 
+bool CPU::is_paused() {
+    return paused;
+}
+
 // set stop flag to on
 void CPU::terminate() {
 #ifdef _WIN32
@@ -449,13 +813,19 @@ void CPU::terminate() {
 // get 2 byte instruction at PC location and increment by 2
 uint16_t CPU::fetch() {
     if (PC > MAX_MEM - 2) {
-        std::cerr << "PC at end of memory; failed to fetch" << std::endl;
+        NACHO_LOG(LOG_WARN, "PC at end of memory; failed to fetch (PC %04X)", PC);
+        stats.fetch_faults += 1;
         return 0;
     }
-    uint16_t mask = 0xFFFF;
-    mask &= ((memory[PC] << 8) + (memory[PC + 1]));
+    uint16_t instruction = memory.read16(PC);
     PC += 2;
-    return mask;
+    return instruction;
+}
+
+// count and report an instruction no decoder branch handles
+void CPU::invalid_opcode(uint16_t instruction) {
+    NACHO_LOG(LOG_WARN, "Invalid opcode %04X at %04X", instruction, (uint16_t)(PC - 2));
+    stats.invalid_opcodes += 1;
 }
 
 // determine what to do based on instruction
@@ -474,7 +844,7 @@ void CPU::decode(uint16_t instruction) {
                             break;
 
                         default:
-                            std::cerr << "Invalid opcode " << std::hex << instruction << std::endl;
+                            CPU::invalid_opcode(instruction);
                     }
                     break;
                 }
@@ -514,13 +884,13 @@ void CPU::decode(uint16_t instruction) {
                             break;
 
                         default:
-                            std::cerr << "Invalid opcode " << std::hex << instruction << std::endl;
+                            CPU::invalid_opcode(instruction);
                     }
                     break;
                 }
 
                 default:
-                    std::cerr << "Invalid opcode " << std::hex << instruction << std::endl;
+                    CPU::invalid_opcode(instruction);
             }
             break;
         }
@@ -566,6 +936,9 @@ void CPU::decode(uint16_t instruction) {
                 case 0x3:
                     CPU::read_reg_mem_range(x_reg, y_reg);
                     break;
+
+                default:
+                    CPU::invalid_opcode(instruction);
             }
             break;
         }
@@ -626,7 +999,7 @@ void CPU::decode(uint16_t instruction) {
                     break;
 
                 default:
-                    std::cerr << "Invalid opcode " << std::hex << instruction << std::endl;
+                    CPU::invalid_opcode(instruction);
             }
             break;
         }
@@ -646,7 +1019,7 @@ void CPU::decode(uint16_t instruction) {
 
         case 0xB: {
             uint16_t addr = instruction & 0xFFF;
-            if (config.quirks.jump) {
+            if (quirks.jump) {
                 uint8_t x_reg = (instruction >> 8) & 0xF;
                 CPU::jump_plus_reg(addr, x_reg);
             } else {
@@ -670,11 +1043,11 @@ void CPU::decode(uint16_t instruction) {
             registers[0xF] = 0;
             // exit early if we are a system that is able to draw 0 height sprite
             if (height == 0) {
-                if (config.quirks.draw_zero) {
-                    if (config.quirks.vblank) draw = true;
+                if (quirks.draw_zero) {
+                    if (quirks.vblank) draw = true;
                     return;
                 }
-                if (!(lores && config.quirks.lores_8x16)) {
+                if (!(lores && quirks.lores_8x16)) {
                     width = 16;
                 }
                 height = 16;
@@ -690,7 +1063,7 @@ void CPU::decode(uint16_t instruction) {
                 }
             }
 
-            // if (height == 0x0 && !config.quirks.draw_zero) {
+            // if (height == 0x0 && !quirks.draw_zero) {
             //     CPU::display_16(x_reg, y_reg);
             // } else {
             //     CPU::display_8(x_reg, y_reg, height);
@@ -710,7 +1083,7 @@ void CPU::decode(uint16_t instruction) {
                     break;
 
                 default:
-                    std::cerr << "Invalid opcode " << std::hex << instruction << std::endl;
+                    CPU::invalid_opcode(instruction);
             }
             break;
         }
@@ -783,7 +1156,7 @@ void CPU::decode(uint16_t instruction) {
                     break;
 
                 default:
-                    std::cerr << "Invalid opcode " << std::hex << instruction << std::endl;
+                    CPU::invalid_opcode(instruction);
             }
             break;
         }
@@ -796,13 +1169,8 @@ void CPU::decode(uint16_t instruction) {
 
 //(00E0) clear screen
 void CPU::clear() {
-    std::lock_guard<std::mutex> lock(screen_mtx);
-    for (int r = 0; r < HEIGHT; r++) {
-        for (int c = 0; c < WIDTH; c++) {
-            int screen_index = (r * WIDTH) + c;
-            screen[screen_index] &= ~bit_plane;
-        }
-    }
+    std::lock_guard<ContendedMutex> lock(screen_mtx);
+    clear_planes(screen.data(), bit_plane);
 }
 
 //(00EE) return from subroutine
@@ -869,7 +1237,7 @@ void CPU::set_reg_equals(uint8_t x_reg, uint8_t y_reg) {
 //(8XY1) set VX to or of value of VX and VY
 void CPU::set_reg_or(uint8_t x_reg, uint8_t y_reg) {
     registers[x_reg] |= registers[y_reg];
-    if (config.quirks.logic) {
+    if (quirks.logic) {
         registers[0xF] = 0;
     }
 }
@@ -877,7 +1245,7 @@ void CPU::set_reg_or(uint8_t x_reg, uint8_t y_reg) {
 //(8XY2) set VX to and of value of VX and VY
 void CPU::set_reg_and(uint8_t x_reg, uint8_t y_reg) {
     registers[x_reg] &= registers[y_reg];
-    if (config.quirks.logic) {
+    if (quirks.logic) {
         registers[0xF] = 0;
     }
 }
@@ -885,7 +1253,7 @@ void CPU::set_reg_and(uint8_t x_reg, uint8_t y_reg) {
 //(8XY3) set VX to xor of value of VX and VY
 void CPU::set_reg_xor(uint8_t x_reg, uint8_t y_reg) {
     registers[x_reg] ^= registers[y_reg];
-    if (config.quirks.logic) {
+    if (quirks.logic) {
         registers[0xF] = 0;
     }
 }
@@ -915,7 +1283,7 @@ void CPU::set_reg_sub_Y(uint8_t x_reg, uint8_t y_reg) {
 //(8XY6) set VX to value of VY, shift VX by a bit to right and set VF to bit
 // shifted out
 void CPU::set_reg_shift_right(uint8_t x_reg, uint8_t y_reg) {
-    if (!config.quirks.shift) {
+    if (!quirks.shift) {
         registers[x_reg] = registers[y_reg];
     }
     uint8_t out = registers[x_reg] & 1;
@@ -936,7 +1304,7 @@ void CPU::set_reg_sub_X(uint8_t x_reg, uint8_t y_reg) {
 //(8XYE) set VX to value of VY, shift VX by a bit to left and set VF to bit
 // shifted out
 void CPU::set_reg_shift_left(uint8_t x_reg, uint8_t y_reg) {
-    if (!config.quirks.shift) {
+    if (!quirks.shift) {
         registers[x_reg] = registers[y_reg];
     }
     uint8_t out = (registers[x_reg] >> 7) & 1;
@@ -966,111 +1334,35 @@ void CPU::jump_plus(uint16_t addr) {
 
 //(CXNN) set VX to random byte (bitwise AND) NN
 void CPU::set_reg_rand(uint8_t x_reg, uint8_t val) {
-    uint8_t res = rand() % 256;
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    uint8_t res = rng_state % 256;
     registers[x_reg] = res & val;
 }
 
 // loop through the first four bits of bit_plane and draw with that plane if there is a 1 there
 void CPU::display(uint16_t mem_index, uint8_t plane, uint8_t x_reg, uint8_t y_reg, uint8_t width, uint8_t height) {
-    std::lock_guard<std::mutex> lock(screen_mtx);
-    int scale = lores ? 2 : 1;  // multiply everything by two if we in lores
-
-    width *= scale;
-    height *= scale;
-
-    uint8_t x = (registers[x_reg] * scale) % WIDTH;
-    uint8_t y = (registers[y_reg] * scale) % HEIGHT;
-
-    for (int r = y; r < (y + height); r += scale) {
-        int row = r;
-
-        // we went off of screen
-        if (row >= HEIGHT) {
-            // if we are on a system that sets number of collisions set it
-            if (config.quirks.set_collisions && !lores) {
-                registers[0xF] += ((y + height) - HEIGHT);
-            }
-            // if we dont wrap we are done
-            if (!config.quirks.wrap) {
-                break;
-            }
-            // otherwise wrap around and continue
-            row = r % HEIGHT;
-        }
-
-        // flag for if we got a collision in this row
-        bool collision = false;
-
-        // index to select individual bits from the sprite
-        int sprite_row_index;
-
-        // if our width is 16 * scale we extract two bytes otherwise we just extract one
-        uint16_t sprite_row;
-        if (width == 16 * scale) {
-            sprite_row = (memory[mem_index] << 8) + memory[mem_index + 1];
-            mem_index += 2;
-            sprite_row_index = 15;
-        } else {
-            sprite_row = memory[mem_index];
-            mem_index += 1;
-            sprite_row_index = 7;
-        }
-
-        for (int c = x; c < (x + width); c += scale) {
-            int col = c;
-            if (c >= WIDTH) {
-                if (!config.quirks.wrap) {
-                    break;
-                }
-                col = c % WIDTH;
-            }
-
-            uint8_t bit = (sprite_row >> sprite_row_index) & 1;
-            sprite_row_index -= 1;
-            // if bit is 0 we can skip there is nothing to draw
-            if (bit == 0) continue;
-            uint8_t draw_mask = plane;
-
-            // if we are in lores mode draw a 2x2 otherwise draw pixel by pixel
-            if (lores) {
-                int top_left = (row * WIDTH) + col;
-                int top_right = (row * WIDTH) + col + 1;
-                int bot_left = ((row + 1) * WIDTH) + col;
-                int bot_right = ((row + 1) * WIDTH) + col + 1;
-                if ((screen[top_left] & draw_mask) || (screen[top_right] & draw_mask) ||
-                    (screen[bot_left] & draw_mask) || (screen[bot_right] & draw_mask)) {
-                    collision = true;
-                }
-                screen[top_left] ^= draw_mask;
-                screen[top_right] ^= draw_mask;
-                screen[bot_left] ^= draw_mask;
-                screen[bot_right] ^= draw_mask;
-            } else {
-                int screen_index = (row * WIDTH) + col;
-                if (screen[screen_index] & draw_mask) {
-                    collision = true;
-                }
-                screen[screen_index] ^= draw_mask;
-            }
-        }
-        // if there is a collision either increase the vf register by 1 if we are on a system that counts them
-        // otherwise just set it to 1
-        if (collision) {
-            if (config.quirks.set_collisions && !lores) {
-                registers[0xF] += 1;
-            } else {
-                registers[0xF] = 1;
-            }
-        }
+    FrameProfiler::Scope measure(profiler.load(std::memory_order_relaxed), FrameProfiler::DRAW);
+    // gather the sprite rows first; the kernel never touches emulated memory
+    std::array<uint8_t, 32> sprite;
+    int sprite_bytes = height * (width == 16 ? 2 : 1);
+    for (int i = 0; i < sprite_bytes; i++) {
+        sprite[i] = read_memory(mem_index + i);
     }
-    if (lores && config.quirks.vblank) {
+
+    std::lock_guard<ContendedMutex> lock(screen_mtx);
+    draw_sprite(screen.data(), sprite.data(), plane, registers[x_reg], registers[y_reg], width, height, lores,
+                quirks, registers[0xF]);
+    if (lores && quirks.vblank) {
         draw = true;
     }
 }
 
 //(EX9E) skip if key represented by VX's lower nibble is pressed
 void CPU::skip_key_pressed(uint8_t x_reg) {
-    std::lock_guard<std::mutex> lock(key_mtx);
+    std::lock_guard<ContendedMutex> lock(key_mtx);
     uint8_t key = registers[x_reg] & 0xF;
     if ((keys >> key) & 1) {
         uint16_t opcode = fetch();
@@ -1082,7 +1374,7 @@ void CPU::skip_key_pressed(uint8_t x_reg) {
 
 //(EXA1) skip if key represented by VX's lower nibble is not pressed
 void CPU::skip_key_not_pressed(uint8_t x_reg) {
-    std::lock_guard<std::mutex> lock(key_mtx);
+    std::lock_guard<ContendedMutex> lock(key_mtx);
     uint8_t key = registers[x_reg] & 0xF;
     if (!((keys >> key) & 1)) {
         uint16_t opcode = fetch();
@@ -1099,7 +1391,7 @@ void CPU::set_reg_delay(uint8_t x_reg) {
 
 //(FX0A) wait for key press and release and set VX to that key
 void CPU::set_reg_keypress(uint8_t x_reg) {
-    std::lock_guard<std::mutex> lock(key_mtx);
+    std::lock_guard<ContendedMutex> lock(key_mtx);
     if (!waiting) {
         pressed = NO_PRESS;
         released = NO_RELEASE;
@@ -1141,7 +1433,7 @@ void CPU::set_index_font(uint8_t x_reg) {
 void CPU::set_reg_BCD(uint8_t x_reg) {
     int num = registers[x_reg];
     for (int offset = 2; offset >= 0; offset--) {
-        memory[I + (uint16_t)offset] = (uint8_t)(num % 10);
+        memory.write(I + (uint16_t)offset, (uint8_t)(num % 10));
         num /= 10;
     }
 }
@@ -1152,14 +1444,14 @@ void CPU::write_reg_mem(uint8_t x_reg) {
     // modern behavior doesn't
     uint16_t addr = I;
     uint16_t* addr_ptr = &addr;
-    if (!config.quirks.memory_leave_I_unchanged) {
+    if (!quirks.memory_leave_I_unchanged) {
         addr_ptr = &I;
     }
     for (uint8_t reg = 0; reg <= x_reg; reg++) {
-        memory[*addr_ptr] = registers[reg];
+        memory.write(*addr_ptr, registers[reg]);
         *addr_ptr += 1;
     }
-    if (config.quirks.memory_increment_by_X) {
+    if (quirks.memory_increment_by_X) {
         *addr_ptr -= 1;
     }
 }
@@ -1170,14 +1462,14 @@ void CPU::read_mem_reg(uint8_t x_reg) {
     // modern behavior doesn't
     uint16_t addr = I;
     uint16_t* addr_ptr = &addr;
-    if (!config.quirks.memory_leave_I_unchanged) {
+    if (!quirks.memory_leave_I_unchanged) {
         addr_ptr = &I;
     }
     for (uint8_t reg = 0; reg <= x_reg; reg++) {
-        registers[reg] = memory[*addr_ptr];
+        registers[reg] = memory.read(*addr_ptr);
         *addr_ptr += 1;
     }
-    if (config.quirks.memory_increment_by_X) {
+    if (quirks.memory_increment_by_X) {
         *addr_ptr -= 1;
     }
 }
@@ -1186,61 +1478,34 @@ void CPU::read_mem_reg(uint8_t x_reg) {
 
 //(00CN) scroll screen down by N pixels
 void CPU::scroll_down_n(uint8_t val) {
-    std::lock_guard<std::mutex> lock(screen_mtx);
-    // start from bottom and replace with n heigher if in bounds else set to 0
-    if (lores && !config.quirks.half_scroll_lores) {
+    FrameProfiler::Scope measure(profiler.load(std::memory_order_relaxed), FrameProfiler::SCROLL);
+    std::lock_guard<ContendedMutex> lock(screen_mtx);
+    if (lores && !quirks.half_scroll_lores) {
         val *= 2;
     }
-    for (int row = HEIGHT - 1; row >= 0; row--) {
-        for (int col = WIDTH - 1; col >= 0; col--) {
-            int index = (row * WIDTH) + col;
-            screen[index] &= ~(bit_plane);  // zeroes out bits that will be changed
-            if ((row - val) >= 0) {
-                int replace_index = ((row - val) * WIDTH) + col;
-                screen[index] |= bit_plane & screen[replace_index];  // places the scrolled bits in correct bit spot
-            }
-        }
-    }
+    scroll_planes_down(screen.data(), bit_plane, val);
 }
 
 //(00FB) scroll screen right by four pixels  (SCHIP Quirk: lores scrolls half)
 void CPU::scroll_right_four() {
-    std::lock_guard<std::mutex> lock(screen_mtx);
+    FrameProfiler::Scope measure(profiler.load(std::memory_order_relaxed), FrameProfiler::SCROLL);
+    std::lock_guard<ContendedMutex> lock(screen_mtx);
     uint8_t val = 4;
-    if (lores && !config.quirks.half_scroll_lores) {
+    if (lores && !quirks.half_scroll_lores) {
         val *= 2;
     }
-    // traverse right to left top to down
-    for (int row = 0; row < HEIGHT; row++) {
-        for (int col = WIDTH - 1; col >= 0; col--) {
-            int index = (row * WIDTH) + col;
-            screen[index] &= ~(bit_plane);  // zeroes out bits that will be changed
-            if ((col - val) >= 0) {
-                int replace_index = (row * WIDTH) + (col - val);
-                screen[index] |= bit_plane & screen[replace_index];  // places the scrolled bits in correct bit spot
-            }
-        }
-    }
+    scroll_planes_right(screen.data(), bit_plane, val);
 }
 
 //(00FC) scroll screen left by four pixels (SCHIP Quirk: lores scrolls half)
 void CPU::scroll_Left_four() {
-    std::lock_guard<std::mutex> lock(screen_mtx);
+    FrameProfiler::Scope measure(profiler.load(std::memory_order_relaxed), FrameProfiler::SCROLL);
+    std::lock_guard<ContendedMutex> lock(screen_mtx);
     uint8_t val = 4;
-    if (lores && !config.quirks.half_scroll_lores) {
+    if (lores && !quirks.half_scroll_lores) {
         val *= 2;
     }
-    // traverse left to right top to down
-    for (int row = 0; row < HEIGHT; row++) {
-        for (int col = 0; col < WIDTH; col++) {
-            int index = (row * WIDTH) + col;
-            screen[index] &= ~(bit_plane);  // zeroes out bits that will be changed
-            if ((col + val) < WIDTH) {
-                int replace_index = (row * WIDTH) + (col + val);
-                screen[index] |= bit_plane & screen[replace_index];  // places the scrolled bits in correct bit spot
-            }
-        }
-    }
+    scroll_planes_left(screen.data(), bit_plane, val);
 }
 
 // TODO make this function return to start screen not kill render loop
@@ -1253,8 +1518,8 @@ void CPU::exit() {
 //(00FE) switch to lores (64x32) mode
 void CPU::switch_lores() {
     // SCHIP Quirk: original didnt clear screen
-    if (config.quirks.clean_screen) {
-        std::lock_guard<std::mutex> lock(screen_mtx);
+    if (quirks.clean_screen) {
+        std::lock_guard<ContendedMutex> lock(screen_mtx);
         std::fill(screen.begin(), screen.end(), 0);
     }
     lores = true;
@@ -1263,8 +1528,8 @@ void CPU::switch_lores() {
 //(00FF) switch to hires (128x64) mode
 void CPU::switch_hires() {
     // SCHIP Quirk: original didnt clear screen
-    if (config.quirks.clean_screen) {
-        std::lock_guard<std::mutex> lock(screen_mtx);
+    if (quirks.clean_screen) {
+        std::lock_guard<ContendedMutex> lock(screen_mtx);
         std::fill(screen.begin(), screen.end(), 0);
     }
     lores = false;
@@ -1301,22 +1566,13 @@ void CPU::read_flags_storage(uint8_t x_reg) {
 
 // 00DN scroll screen up by N pixels
 void CPU::scroll_up_n(uint8_t val) {
-    std::lock_guard<std::mutex> lock(screen_mtx);
+    FrameProfiler::Scope measure(profiler.load(std::memory_order_relaxed), FrameProfiler::SCROLL);
+    std::lock_guard<ContendedMutex> lock(screen_mtx);
     // scroll only selected bit planes
-    //  start from bottom and replace with n lower if in bounds else set to 0
     if (lores) {
         val *= 2;
     }
-    for (int row = 0; row < HEIGHT; row++) {
-        for (int col = 0; col < WIDTH; col++) {
-            int index = (row * WIDTH) + col;
-            screen[index] &= ~(bit_plane);  // zeroes out bits that will be changed
-            if ((row + val) < HEIGHT) {
-                int replace_index = ((row + val) * WIDTH) + col;
-                screen[index] |= bit_plane & screen[replace_index];  // places the scrolled bits in correct bit spot
-            }
-        }
-    }
+    scroll_planes_up(screen.data(), bit_plane, val);
 }
 
 // 5XY2 write memory starting from register X to register y
@@ -1325,10 +1581,10 @@ void CPU::write_reg_mem_range(uint8_t x_reg, uint8_t y_reg) {
     int8_t inc = x_reg <= y_reg ? 1 : -1;
 
     for (uint8_t reg = x_reg; reg != y_reg; reg += inc) {
-        memory[addr] = registers[reg];
+        memory.write(addr, registers[reg]);
         addr += 1;
     }
-    memory[addr] = registers[y_reg];
+    memory.write(addr, registers[y_reg]);
 }
 
 // 5XY2 read memory starting at I into register X to register y
@@ -1337,10 +1593,10 @@ void CPU::read_reg_mem_range(uint8_t x_reg, uint8_t y_reg) {
     int8_t inc = x_reg <= y_reg ? 1 : -1;
 
     for (uint8_t reg = x_reg; reg != y_reg; reg += inc) {
-        registers[reg] = memory[addr];
+        registers[reg] = memory.read(addr);
         addr += 1;
     }
-    registers[y_reg] = memory[addr];
+    registers[y_reg] = memory.read(addr);
 }
 
 // FOOO NNNN read the next two bytes into I
@@ -1357,7 +1613,7 @@ void CPU::select_plane(uint8_t val) {
 void CPU::set_waveform() {
     phase = 0;
     for (uint16_t i = 0; i < 16; i++) {
-        uint8_t pattern = memory[I + i];
+        uint8_t pattern = memory.read(I + i);
         for (int b = 7; b >= 0; b--) {
             audio_pattern[8 * i + (7 - b)] = (pattern >> b) & 1;
         }
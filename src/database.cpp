@@ -1,17 +1,28 @@
 #include <cpu/cpu.h>
 #include <database/database.h>
-#include <openssl/sha.h>
+#include <log/log.h>
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
 
-std::unordered_map<std::string, int> supported = {{"originalChip8", CHIP8},
+const std::unordered_map<std::string, int> supported = {{"originalChip8", CHIP8},
                                                   {"modernChip8", SCHIP_MODERN},
                                                   {"superchip", SCHIP1_1},
                                                   {"xochip", XO_CHIP}};
 
-Database::Database(std::string data_dir) {
+const char* const sources[CATALOG_SOURCES] = {"platforms.json", "programs.json", "quirks.json",
+                                              "sha1-hashes.json"};
+
+Database::Database(std::string data_dir, std::string catalog_path) : data_dir(data_dir) {
+    if (!catalog_path.empty() && open_catalog(catalog_path)) return;
+    load_json();
+};
+
+void Database::load_json() {
     // open files and parse into json objects
     std::ifstream platform_f(data_dir + "/platforms.json");
     std::ifstream programs_f(data_dir + "/programs.json");
@@ -22,30 +33,286 @@ Database::Database(std::string data_dir) {
     programs = json::parse(programs_f);
     quirk_list = json::parse(quirks_f);
     sha1_hashes = json::parse(sha1_hashes_f);
-};
+}
+
+static std::string json_text(const json& object, const char* key) {
+    const json& value = object.contains(key) ? object.at(key) : json(nullptr);
+    if (value.is_string()) return value.get<std::string>();
+    if (!value.is_array()) return "";
+    std::string text;
+    for (const json& item : value) {
+        if (!item.is_string()) continue;
+        if (!text.empty()) text += ", ";
+        text += item.get<std::string>();
+    }
+    return text;
+}
+
+// bit per platform index for a list of platform ids
+static uint32_t platform_bits(const json& platform_list, const json& platforms) {
+    uint32_t bits = 0;
+    for (const json& id : platform_list) {
+        for (size_t i = 0; i < platforms.size() && i < 32; i++) {
+            if (platforms[i].value("id", "") == id) bits |= 1u << i;
+        }
+    }
+    return bits;
+}
+
+/*-----------------[Compiled Catalog]-----------------*/
+
+// size and mtime of the JSON sources; the catalog is only trusted while these match
+static bool stamp_sources(const std::string& data_dir, CatalogSource stamps[CATALOG_SOURCES]) {
+    std::error_code error;
+    for (int i = 0; i < CATALOG_SOURCES; i++) {
+        std::filesystem::path path = std::filesystem::path(data_dir) / sources[i];
+        stamps[i].size = std::filesystem::file_size(path, error);
+        if (error) return false;
+        stamps[i].mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        if (error) return false;
+    }
+    return true;
+}
+
+static bool section_fits(size_t file_size, uint64_t offset, uint64_t count, size_t record) {
+    return offset <= file_size && count <= (file_size - offset) / record;
+}
+
+bool Database::open_catalog(const std::string& path) {
+    if (!catalog.open(path)) return false;
+
+    const uint8_t* base = catalog.data();
+    size_t size = catalog.size();
+    const CatalogHeader* h = (const CatalogHeader*)base;
+    CatalogSource stamps[CATALOG_SOURCES];
+    bool valid = size >= sizeof(CatalogHeader) && h->magic == CATALOG_MAGIC && h->version == CATALOG_VERSION &&
+                 section_fits(size, h->platforms_offset, h->platform_count, sizeof(CatalogPlatform)) &&
+                 section_fits(size, h->programs_offset, h->program_count, sizeof(CatalogProgram)) &&
+                 section_fits(size, h->roms_offset, h->rom_count, sizeof(CatalogRom)) &&
+                 section_fits(size, h->strings_offset, h->strings_size, 1);
+    if (!valid) {
+        std::cerr << "Ignoring invalid game catalog " << path << std::endl;
+        catalog.close();
+        return false;
+    }
+    if (!stamp_sources(data_dir, stamps) || std::memcmp(stamps, h->sources, sizeof(stamps)) != 0) {
+        std::cerr << "Game catalog is out of date, reading the JSON database instead" << std::endl;
+        catalog.close();
+        return false;
+    }
+
+    header = h;
+    catalog_platforms = (const CatalogPlatform*)(base + h->platforms_offset);
+    catalog_programs = (const CatalogProgram*)(base + h->programs_offset);
+    catalog_roms = (const CatalogRom*)(base + h->roms_offset);
+    strings = (const char*)(base + h->strings_offset);
+    return true;
+}
+
+bool Database::is_compiled() const {
+    return catalog.is_open();
+}
+
+std::string Database::catalog_string(CatalogString s) const {
+    if ((uint64_t)s.offset + s.length > header->strings_size) return "";
+    return std::string(strings + s.offset, s.length);
+}
+
+static bool hex_to_sha1(const std::string& hash, uint8_t sha1[20]) {
+    if (hash.size() != 40) return false;
+    for (int i = 0; i < 20; i++) {
+        int value = 0;
+        for (int n = 0; n < 2; n++) {
+            char c = hash[i * 2 + n];
+            int digit = c >= '0' && c <= '9' ? c - '0'
+                        : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                        : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                               : -1;
+            if (digit < 0) return false;
+            value = value << 4 | digit;
+        }
+        sha1[i] = value;
+    }
+    return true;
+}
+
+// binary search over the sorted rom records
+const CatalogRom* Database::find_rom(const std::string& hash) const {
+    uint8_t sha1[20];
+    if (!hex_to_sha1(hash, sha1)) return nullptr;
+    const CatalogRom* end = catalog_roms + header->rom_count;
+    const CatalogRom* rom = std::lower_bound(catalog_roms, end, sha1, [](const CatalogRom& r, const uint8_t* key) {
+        return std::memcmp(r.sha1, key, 20) < 0;
+    });
+    if (rom == end || std::memcmp(rom->sha1, sha1, 20) != 0) return nullptr;
+    return rom;
+}
+
+static CatalogConfig to_record(const CPU::Config& config) {
+    CatalogConfig record = {};
+    record.system = config.system;
+    record.speed = config.speed;
+    record.start_address = config.start_address;
+    const CPU::Quirks& q = config.quirks;
+    const bool quirks[CATALOG_QUIRKS] = {q.shift,  q.memory_increment_by_X, q.memory_leave_I_unchanged,
+                                         q.wrap,   q.jump,                  q.vblank,
+                                         q.logic,  q.draw_zero,             q.half_scroll_lores,
+                                         q.clean_screen, q.set_collisions,  q.lores_8x16};
+    for (int i = 0; i < CATALOG_QUIRKS; i++) record.quirks[i] = quirks[i];
+    for (int i = 0; i < CATALOG_COLORS; i++) {
+        for (int c = 0; c < 3; c++) record.colors[i][c] = config.colors[i][c];
+    }
+    return record;
+}
+
+static CPU::Config from_record(const CatalogConfig& record) {
+    CPU::Config config;
+    config.system = record.system;
+    config.speed = record.speed;
+    config.start_address = record.start_address;
+    CPU::Quirks& q = config.quirks;
+    bool* quirks[CATALOG_QUIRKS] = {&q.shift,  &q.memory_increment_by_X, &q.memory_leave_I_unchanged,
+                                    &q.wrap,   &q.jump,                  &q.vblank,
+                                    &q.logic,  &q.draw_zero,             &q.half_scroll_lores,
+                                    &q.clean_screen, &q.set_collisions,  &q.lores_8x16};
+    for (int i = 0; i < CATALOG_QUIRKS; i++) *quirks[i] = record.quirks[i];
+    for (int i = 0; i < CATALOG_COLORS; i++) {
+        for (int c = 0; c < 3; c++) config.colors[i][c] = record.colors[i][c];
+    }
+    return config;
+}
+
+bool Database::compile_catalog(std::string data_dir, std::string output) {
+    CatalogHeader h = {};
+    h.magic = CATALOG_MAGIC;
+    h.version = CATALOG_VERSION;
+    if (!stamp_sources(data_dir, h.sources)) {
+        std::cerr << "Missing JSON database in " << data_dir << std::endl;
+        return false;
+    }
+
+    std::vector<CatalogPlatform> platform_records;
+    std::vector<CatalogProgram> program_records;
+    std::vector<CatalogRom> rom_records;
+    std::string pool;
+    auto add_string = [&pool](const std::string& s) {
+        CatalogString ref = {(uint32_t)pool.size(), (uint32_t)s.size()};
+        pool += s;
+        return ref;
+    };
+
+    try {
+        Database db(data_dir, "");
+
+        for (size_t i = 0; i < db.platforms.size(); i++) {
+            CatalogPlatform record = {};
+            record.id = add_string(db.platforms[i].value("id", ""));
+            record.name = add_string(db.platforms[i].value("name", ""));
+            // platforms with an incomplete quirk list keep the defaults, as they are never selected
+            CPU::Config config;
+            config.system = i;
+            try {
+                config = db.gen_platform_config(i);
+            } catch (const json::exception&) {
+            }
+            record.config = to_record(config);
+            platform_records.push_back(record);
+        }
+
+        for (const json& program : db.programs) {
+            CatalogProgram record = {};
+            record.title = add_string(json_text(program, "title"));
+            record.description = add_string(json_text(program, "description"));
+            record.release = add_string(json_text(program, "release"));
+            record.authors = add_string(json_text(program, "authors"));
+            for (const auto& rom : program.at("roms").items()) {
+                record.platforms |= platform_bits(rom.value().at("platforms"), db.platforms);
+            }
+            program_records.push_back(record);
+        }
+
+        for (const auto& entry : db.sha1_hashes.items()) {
+            CatalogRom record = {};
+            if (!hex_to_sha1(entry.key(), record.sha1)) continue;
+            CPU::Config config;
+            int platform = -1;
+            int program = db.resolve_rom(entry.key(), config, platform);
+            if (program < 0) continue;
+            const json& rom = db.programs.at(program).at("roms").at(entry.key());
+            record.program = program;
+            record.file = add_string(rom.value("file", ""));
+            record.platforms = platform_bits(rom.at("platforms"), db.platforms);
+            record.platform = platform;
+            record.config = to_record(config);
+            rom_records.push_back(record);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to compile game catalog: " << e.what() << std::endl;
+        return false;
+    }
+
+    std::sort(rom_records.begin(), rom_records.end(), [](const CatalogRom& a, const CatalogRom& b) {
+        return std::memcmp(a.sha1, b.sha1, 20) < 0;
+    });
+
+    // sections are laid out back to back, 8 byte aligned
+    auto align = [](uint64_t offset) { return (offset + 7) & ~(uint64_t)7; };
+    h.platform_count = platform_records.size();
+    h.program_count = program_records.size();
+    h.rom_count = rom_records.size();
+    h.platforms_offset = align(sizeof(CatalogHeader));
+    h.programs_offset = align(h.platforms_offset + platform_records.size() * sizeof(CatalogPlatform));
+    h.roms_offset = align(h.programs_offset + program_records.size() * sizeof(CatalogProgram));
+    h.strings_offset = align(h.roms_offset + rom_records.size() * sizeof(CatalogRom));
+    h.strings_size = pool.size();
 
-void Database::set_platform_quirks(CPU::Config& config, int platform) {
+    std::vector<uint8_t> image(h.strings_offset + pool.size());
+    std::memcpy(image.data(), &h, sizeof(h));
+    std::memcpy(image.data() + h.platforms_offset, platform_records.data(),
+                platform_records.size() * sizeof(CatalogPlatform));
+    std::memcpy(image.data() + h.programs_offset, program_records.data(),
+                program_records.size() * sizeof(CatalogProgram));
+    std::memcpy(image.data() + h.roms_offset, rom_records.data(), rom_records.size() * sizeof(CatalogRom));
+    std::memcpy(image.data() + h.strings_offset, pool.data(), pool.size());
+
+    // write beside the target and rename so running emulators never map a half written file
+    std::string temp = output + ".tmp";
+    std::ofstream file(temp, std::ios::binary);
+    file.write((const char*)image.data(), image.size());
+    file.close();
+    std::error_code error;
+    if (!file || (std::filesystem::rename(temp, output, error), error)) {
+        std::cerr << "Failed to write game catalog " << output << std::endl;
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+    return true;
+}
+
+/*-----------------[JSON Database]-----------------*/
+
+void Database::set_platform_quirks(CPU::Config& config, int platform) const {
     // set platform defaults
-    json& platform_data = platforms[platform];
-    json& platform_quirks = platform_data["quirks"];
+    const json& platform_data = platforms.at(platform);
+    const json& platform_quirks = platform_data.at("quirks");
 
     config.system = platform;
-    config.speed = platform_data["defaultTickrate"];
-    config.quirks.shift = platform_quirks["shift"];
-    config.quirks.memory_increment_by_X = platform_quirks["memoryIncrementByX"];
-    config.quirks.memory_leave_I_unchanged = platform_quirks["memoryLeaveIUnchanged"];
-    config.quirks.wrap = platform_quirks["wrap"];
-    config.quirks.jump = platform_quirks["jump"];
-    config.quirks.vblank = platform_quirks["vblank"];
-    config.quirks.logic = platform_quirks["logic"];
-    config.quirks.draw_zero = platform_quirks["drawZero"];
-    config.quirks.half_scroll_lores = platform_quirks["halfScrollLores"];
-    config.quirks.clean_screen = platform_quirks["cleanScreen"];
-    config.quirks.set_collisions = platform_quirks["setCollisions"];
-    config.quirks.lores_8x16 = platform_quirks["lores8x16"];
-}
-
-void Database::set_game_quirks(CPU::Config& config, json& game_rom) {
+    config.speed = platform_data.at("defaultTickrate");
+    config.quirks.shift = platform_quirks.at("shift");
+    config.quirks.memory_increment_by_X = platform_quirks.at("memoryIncrementByX");
+    config.quirks.memory_leave_I_unchanged = platform_quirks.at("memoryLeaveIUnchanged");
+    config.quirks.wrap = platform_quirks.at("wrap");
+    config.quirks.jump = platform_quirks.at("jump");
+    config.quirks.vblank = platform_quirks.at("vblank");
+    config.quirks.logic = platform_quirks.at("logic");
+    config.quirks.draw_zero = platform_quirks.at("drawZero");
+    config.quirks.half_scroll_lores = platform_quirks.at("halfScrollLores");
+    config.quirks.clean_screen = platform_quirks.at("cleanScreen");
+    config.quirks.set_collisions = platform_quirks.at("setCollisions");
+    config.quirks.lores_8x16 = platform_quirks.at("lores8x16");
+}
+
+void Database::set_game_quirks(CPU::Config& config, const json& game_rom) const {
     int tick_rate = game_rom.value("tickrate", -1);
     if (tick_rate != -1) config.speed = tick_rate;
     int start_address = game_rom.value("startAddress", -1);
@@ -62,7 +329,7 @@ void Database::set_game_quirks(CPU::Config& config, json& game_rom) {
     }
 }
 
-std::array<float, 3> Database::hex_to_rgb(std::string hex) {
+std::array<float, 3> Database::hex_to_rgb(std::string hex) const {
     std::array<float, 3> rgb;
     rgb[0] = std::stoi(hex.substr(1, 2), nullptr, 16) / 255.0f;
     rgb[1] = std::stoi(hex.substr(3, 2), nullptr, 16) / 255.0f;
@@ -70,37 +337,19 @@ std::array<float, 3> Database::hex_to_rgb(std::string hex) {
     return rgb;
 }
 
-// generates a configuration and sets internal variables to store quick info related to the game
-// will choose best system to emulate automatically.
-CPU::Config Database::gen_config(std::string hash) {
-    std::cout << hash << std::endl;
-    CPU::Config config;
+int Database::resolve_rom(const std::string& hash, CPU::Config& config, int& platform) const {
+    int game_index = sha1_hashes.value(hash, -1);
+    platform = -1;
+    if (game_index == -1) return -1;
 
-    game_index = sha1_hashes.value(hash, -1);
-    if (game_index == -1) {
-        std::cout << "Game not found in database. Please select a system..." << std::endl;
-        return config;
-    }
-    std::cout << "Game found at index " << game_index << std::endl;
-
-    json& game_meta = programs[game_index];
-    json& game_rom = game_meta["roms"][hash];
-    std::vector<std::string> platform_list = game_rom["platforms"];
-    std::string platform_name = "";
+    const json& game_rom = programs.at(game_index).at("roms").at(hash);
+    std::vector<std::string> platform_list = game_rom.at("platforms");
     for (std::string p : platform_list) {
         if (supported.find(p) != supported.end()) {
-            platform_name = p;
+            platform = supported.at(p);
         }
     }
-
-    if (platform_name.empty()) {
-        std::cout << "Game: " << game_meta["title"] << " is not spported yet :(" << std::endl;
-        return config;
-    }
-
-    std::cout << "Platform " << platform_name << std::endl;
-
-    platform = supported[platform_name];
+    if (platform == -1) return game_index;
 
     // set platform quirks
     set_platform_quirks(config, platform);
@@ -108,12 +357,134 @@ CPU::Config Database::gen_config(std::string hash) {
     // set game specific quirks
     set_game_quirks(config, game_rom);
 
+    return game_index;
+}
+
+/*-----------------[Lookups]-----------------*/
+
+// generates a configuration for the game and will choose best system to emulate automatically.
+// only reads the database so it is safe to call from several threads at once
+CPU::Config Database::gen_config(std::string hash) const {
+    NACHO_LOG(LOG_DEBUG, "Looking up %s", hash.c_str());
+    CPU::Config config;
+    int game_index = -1;
+    int platform = -1;
+
+    if (is_compiled()) {
+        const CatalogRom* rom = find_rom(hash);
+        if (rom) {
+            game_index = rom->program;
+            platform = rom->platform;
+            if (platform != -1) config = from_record(rom->config);
+        }
+    } else {
+        game_index = resolve_rom(hash, config, platform);
+    }
+
+    if (game_index == -1) {
+        NACHO_LOG(LOG_DEBUG, "Game not found in database");
+        return config;
+    }
+    NACHO_LOG(LOG_DEBUG, "Game found at index %d", game_index);
+
+    if (platform == -1) {
+        NACHO_LOG(LOG_DEBUG, "Game \"%s\" has no supported platform", get_title(hash).c_str());
+        return config;
+    }
+
+    std::string platform_name = is_compiled() ? catalog_string(catalog_platforms[platform].id)
+                                              : platforms.at(platform).value("id", "");
+    NACHO_LOG(LOG_DEBUG, "Platform %s", platform_name.c_str());
+
     return config;
 }
 
 
-CPU::Config Database::gen_platform_config(int platform){
+CPU::Config Database::gen_platform_config(int platform) const {
+    if (is_compiled()) {
+        if (platform < 0 || (uint32_t)platform >= header->platform_count) {
+            throw std::out_of_range("platform " + std::to_string(platform));
+        }
+        return from_record(catalog_platforms[platform].config);
+    }
     CPU::Config config;
     set_platform_quirks(config, platform);
     return config;
 }
+
+bool Database::is_supported(std::string hash) const {
+    if (is_compiled()) {
+        const CatalogRom* rom = find_rom(hash);
+        return rom && rom->platform != -1;
+    }
+    CPU::Config config;
+    int platform = -1;
+    return resolve_rom(hash, config, platform) != -1 && platform != -1;
+}
+
+// title of the program the hash belongs to or an empty string if unknown
+std::string Database::get_title(std::string hash) const {
+    if (is_compiled()) {
+        const CatalogRom* rom = find_rom(hash);
+        if (!rom || rom->program >= header->program_count) return "";
+        return catalog_string(catalog_programs[rom->program].title);
+    }
+    int game_index = sha1_hashes.value(hash, -1);
+    if (game_index == -1) return "";
+    return programs.at(game_index).value("title", "");
+}
+
+std::vector<Database::ProgramInfo> Database::list_programs() const {
+    std::vector<ProgramInfo> list;
+    if (is_compiled()) {
+        list.resize(header->program_count);
+        for (uint32_t i = 0; i < header->program_count; i++) {
+            const CatalogProgram& program = catalog_programs[i];
+            list[i].title = catalog_string(program.title);
+            list[i].description = catalog_string(program.description);
+            list[i].release = catalog_string(program.release);
+            list[i].authors = catalog_string(program.authors);
+            list[i].platforms = program.platforms;
+        }
+        for (uint32_t i = 0; i < header->rom_count; i++) {
+            const CatalogRom& rom = catalog_roms[i];
+            if (rom.program >= list.size()) continue;
+            static const char digits[] = "0123456789abcdef";
+            std::string hash(40, '0');
+            for (int b = 0; b < 20; b++) {
+                hash[b * 2] = digits[rom.sha1[b] >> 4];
+                hash[b * 2 + 1] = digits[rom.sha1[b] & 0xF];
+            }
+            list[rom.program].roms.push_back(hash);
+            list[rom.program].files.push_back(catalog_string(rom.file));
+        }
+        return list;
+    }
+
+    for (const json& program : programs) {
+        ProgramInfo info;
+        info.title = json_text(program, "title");
+        info.description = json_text(program, "description");
+        info.release = json_text(program, "release");
+        info.authors = json_text(program, "authors");
+        for (const auto& rom : program.at("roms").items()) {
+            info.platforms |= platform_bits(rom.value().at("platforms"), platforms);
+            info.roms.push_back(rom.key());
+            info.files.push_back(rom.value().value("file", ""));
+        }
+        list.push_back(info);
+    }
+    return list;
+}
+
+std::vector<std::string> Database::platform_names() const {
+    std::vector<std::string> names;
+    if (is_compiled()) {
+        for (uint32_t i = 0; i < header->platform_count; i++) {
+            names.push_back(catalog_string(catalog_platforms[i].name));
+        }
+        return names;
+    }
+    for (const json& platform : platforms) names.push_back(platform.value("name", ""));
+    return names;
+}
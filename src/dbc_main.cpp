@@ -0,0 +1,20 @@
+#include <database/database.h>
+
+#include <iostream>
+#include <string>
+
+// compiles the JSON game database into the binary catalog the emulators map at startup
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: nacho-dbc <database dir> <output file>" << std::endl;
+        return 1;
+    }
+    if (!Database::compile_catalog(argv[1], argv[2])) return 1;
+
+    Database db(argv[1], argv[2]);
+    if (!db.is_compiled()) {
+        std::cerr << "Compiled catalog " << argv[2] << " failed to load" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,359 @@
+#include <debug/debugger.h>
+
+#include <algorithm>
+#include <cstdio>
+
+/*-----------------[Editing]-----------------*/
+
+bool Debugger::Armed::per_instruction() const {
+    return !breakpoints.empty() || !watchpoints.empty() || screen;
+}
+
+// copy, change and publish; the emulation thread picks the new state up at its next frame
+void Debugger::publish(const Armed& armed) {
+    auto next = std::make_shared<Armed>(armed);
+    next->pcs = {};
+    for (const Breakpoint& b : next->breakpoints) {
+        if (b.pc != DEBUG_NO_PC) next->pcs[b.pc >> 6] |= 1ull << (b.pc & 63);
+    }
+    published = next;
+    version.fetch_add(1, std::memory_order_release);
+}
+
+void Debugger::add_breakpoint(uint32_t pc) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Armed armed = *published;
+    armed.breakpoints.push_back(Breakpoint{pc & 0xFFFF, false, {}});
+    publish(armed);
+}
+
+void Debugger::add_breakpoint(uint32_t pc, Headless::Condition condition) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Armed armed = *published;
+    armed.breakpoints.push_back({pc, true, condition});
+    publish(armed);
+}
+
+void Debugger::remove_breakpoint(size_t index) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Armed armed = *published;
+    if (index >= armed.breakpoints.size()) return;
+    armed.breakpoints.erase(armed.breakpoints.begin() + index);
+    publish(armed);
+}
+
+void Debugger::add_watchpoint(Watchpoint watch) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Armed armed = *published;
+    if (watch.first > watch.last) std::swap(watch.first, watch.last);
+    armed.watchpoints.push_back(watch);
+    publish(armed);
+}
+
+void Debugger::remove_watchpoint(size_t index) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Armed armed = *published;
+    if (index >= armed.watchpoints.size()) return;
+    armed.watchpoints.erase(armed.watchpoints.begin() + index);
+    publish(armed);
+}
+
+void Debugger::break_on_screen_change(bool enabled) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Armed armed = *published;
+    armed.screen = enabled;
+    publish(armed);
+}
+
+void Debugger::run_to_frame(uint64_t frame) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Armed armed = *published;
+    armed.frame = frame;
+    publish(armed);
+}
+
+void Debugger::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    publish(Armed{});
+}
+
+std::shared_ptr<const Debugger::Armed> Debugger::armed() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return published;
+}
+
+Debugger::Hit Debugger::last_hit() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return hit;
+}
+
+uint64_t Debugger::hits() const {
+    return hit_count.load(std::memory_order_acquire);
+}
+
+void Debugger::record(Hit::Type type, uint16_t pc, uint16_t instruction, uint16_t addr, uint64_t frame) {
+    std::lock_guard<std::mutex> lock(mtx);
+    hit = {type, pc, instruction, addr, frame};
+    hit_count.fetch_add(1, std::memory_order_release);
+}
+
+/*-----------------[Checks]-----------------*/
+
+bool Debugger::begin_frame() {
+    uint64_t now = version.load(std::memory_order_acquire);
+    if (now != seen) {
+        std::lock_guard<std::mutex> lock(mtx);
+        current = published;
+        seen = version.load(std::memory_order_relaxed);
+        was_true.assign(current->breakpoints.size(), false);
+    }
+    return current->per_instruction();
+}
+
+// how many bytes from I the instruction will read and write, given the selected planes
+static void memory_access(uint16_t instruction, uint8_t planes, uint32_t& read_size, uint32_t& write_size) {
+    uint8_t x = (instruction >> 8) & 0xF;
+    uint8_t y = (instruction >> 4) & 0xF;
+    uint32_t range = (x > y ? x - y : y - x) + 1;
+    read_size = 0;
+    write_size = 0;
+    switch (instruction >> 12) {
+        case 0x5:
+            if ((instruction & 0xF) == 0x2) write_size = range;
+            if ((instruction & 0xF) == 0x3) read_size = range;
+            break;
+        case 0xD: {
+            // a zero height sprite is 16x16 on most platforms; over-reporting on the rest is harmless
+            uint32_t rows = instruction & 0xF;
+            uint32_t count = 0;
+            for (int plane = 0; plane < 4; plane++) count += (planes >> plane) & 1;
+            read_size = (rows ? rows : 32) * std::max<uint32_t>(count, 1);
+            break;
+        }
+        case 0xF:
+            switch (instruction & 0xFF) {
+                case 0x02:
+                    if (x == 0) read_size = 16;
+                    break;
+                case 0x33:
+                    write_size = 3;
+                    break;
+                case 0x55:
+                    write_size = x + 1;
+                    break;
+                case 0x65:
+                    read_size = x + 1;
+                    break;
+            }
+            break;
+    }
+}
+
+static bool changes_screen(uint16_t instruction) {
+    if ((instruction >> 12) == 0xD) return true;
+    if ((instruction & 0xFF00) != 0x0000) return false;
+    uint8_t low = instruction & 0xFF;
+    return low == 0xE0 || (low & 0xF0) == 0xC0 || (low & 0xF0) == 0xD0 || low == 0xFB || low == 0xFC ||
+           low == 0xFE || low == 0xFF;
+}
+
+bool Debugger::before(CPU& cpu, uint16_t pc, uint16_t instruction) {
+    const Armed& armed = *current;
+    bool skip = pc == resume_pc;
+    resume_pc = DEBUG_NO_PC;
+
+    for (size_t b = 0; b < armed.breakpoints.size(); b++) {
+        const Breakpoint& breakpoint = armed.breakpoints[b];
+        if (breakpoint.pc == DEBUG_NO_PC) {
+            bool now = check_condition(cpu, breakpoint.condition);
+            bool rising = now && !was_true[b];
+            was_true[b] = now;
+            if (rising && !skip) {
+                resume_pc = pc;
+                record(Hit::BREAKPOINT, pc, instruction, 0, cpu.get_stats().frames);
+                return true;
+            }
+        }
+    }
+    if (armed.at(pc) && !skip) {
+        for (const Breakpoint& breakpoint : armed.breakpoints) {
+            if (breakpoint.pc != pc) continue;
+            if (breakpoint.conditional && !check_condition(cpu, breakpoint.condition)) continue;
+            resume_pc = pc;
+            record(Hit::BREAKPOINT, pc, instruction, 0, cpu.get_stats().frames);
+            return true;
+        }
+    }
+
+    reads = writes = false;
+    if (!armed.watchpoints.empty()) {
+        uint32_t read_size, write_size;
+        uint16_t index = cpu.get_index();
+        memory_access(instruction, cpu.get_plane(), read_size, write_size);
+        reads = read_size > 0;
+        writes = write_size > 0;
+        read_first = write_first = index;
+        read_last = (uint16_t)std::min<uint32_t>(index + read_size - 1, 0xFFFF);
+        write_last = (uint16_t)std::min<uint32_t>(index + write_size - 1, 0xFFFF);
+    }
+
+    draws = armed.screen && changes_screen(instruction);
+    if (draws) screen_before = cpu.screen_view();
+    return false;
+}
+
+bool Debugger::after(CPU& cpu, uint16_t pc, uint16_t instruction) {
+    const Armed& armed = *current;
+    if (reads || writes) {
+        for (const Watchpoint& watch : armed.watchpoints) {
+            if (watch.write && writes && write_first <= watch.last && write_last >= watch.first) {
+                record(Hit::WRITE, pc, instruction, std::max(write_first, watch.first), cpu.get_stats().frames);
+                return true;
+            }
+            if (watch.read && reads && read_first <= watch.last && read_last >= watch.first) {
+                record(Hit::READ, pc, instruction, std::max(read_first, watch.first), cpu.get_stats().frames);
+                return true;
+            }
+        }
+    }
+    if (draws && cpu.screen_view() != screen_before) {
+        record(Hit::SCREEN, pc, instruction, 0, cpu.get_stats().frames);
+        return true;
+    }
+    return false;
+}
+
+// run-to-frame fires once, then disarms itself
+bool Debugger::end_frame(CPU& cpu, uint64_t frame) {
+    uint64_t target = current->frame;
+    if (!target || frame < target) return false;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (published->frame == target) {
+            Armed armed = *published;
+            armed.frame = 0;
+            publish(armed);
+        }
+    }
+    uint16_t pc = cpu.get_pc();
+    record(Hit::FRAME, pc, (cpu.read_memory(pc) << 8) | cpu.read_memory(pc + 1), 0, frame);
+    return true;
+}
+
+/*-----------------[Helpers]-----------------*/
+
+static bool parse_address(std::string text, uint32_t& addr) {
+    try {
+        size_t used;
+        int value = std::stoi(text, &used, 0);
+        if (used != text.size() || value < 0 || value > 0xFFFF) return false;
+        addr = value;
+    } catch (const std::exception& e) {
+        return false;
+    }
+    return true;
+}
+
+bool Debugger::parse_breakpoint(std::string text, Breakpoint& breakpoint) {
+    breakpoint = {};
+    std::string condition;
+    size_t split = text.find(" if ");
+    if (split != std::string::npos) {
+        condition = text.substr(split + 4);
+        text = text.substr(0, split);
+    }
+    if (text.rfind("pc=", 0) == 0 && text.rfind("pc==", 0) != 0) text = text.substr(3);
+
+    if (!parse_address(text, breakpoint.pc)) {
+        // no address: a condition checked at every instruction
+        if (!condition.empty()) return false;
+        breakpoint.pc = DEBUG_NO_PC;
+        condition = text;
+    }
+    if (!condition.empty()) {
+        breakpoint.conditional = true;
+        if (!parse_condition(condition, breakpoint.condition)) return false;
+    }
+    return true;
+}
+
+bool Debugger::parse_watchpoint(std::string text, Watchpoint& watch) {
+    watch = {};
+    size_t colon = text.find(':');
+    if (colon != std::string::npos) {
+        std::string mode = text.substr(colon + 1);
+        if (mode != "r" && mode != "w" && mode != "rw") return false;
+        watch.read = mode.find('r') != std::string::npos;
+        watch.write = mode.find('w') != std::string::npos;
+        text = text.substr(0, colon);
+    }
+    uint32_t first, last;
+    size_t dash = text.find('-');
+    if (dash == std::string::npos) {
+        if (!parse_address(text, first)) return false;
+        last = first;
+    } else if (!parse_address(text.substr(0, dash), first) || !parse_address(text.substr(dash + 1), last)) {
+        return false;
+    }
+    watch.first = std::min(first, last);
+    watch.last = std::max(first, last);
+    return true;
+}
+
+std::string Debugger::describe(const Hit& hit) {
+    char text[96];
+    switch (hit.type) {
+        case Hit::NONE:
+            return "";
+        case Hit::BREAKPOINT:
+            std::snprintf(text, sizeof(text), "breakpoint at %04X (%04X), frame %llu", hit.pc, hit.instruction,
+                          (unsigned long long)hit.frame);
+            break;
+        case Hit::READ:
+        case Hit::WRITE:
+            std::snprintf(text, sizeof(text), "%s of %04X by %04X at %04X, frame %llu",
+                          hit.type == Hit::READ ? "read" : "write", hit.addr, hit.instruction, hit.pc,
+                          (unsigned long long)hit.frame);
+            break;
+        case Hit::SCREEN:
+            std::snprintf(text, sizeof(text), "screen changed by %04X at %04X, frame %llu", hit.instruction,
+                          hit.pc, (unsigned long long)hit.frame);
+            break;
+        case Hit::FRAME:
+            std::snprintf(text, sizeof(text), "reached frame %llu at %04X", (unsigned long long)hit.frame, hit.pc);
+            break;
+    }
+    return text;
+}
+
+std::string Debugger::describe(const Breakpoint& breakpoint) {
+    char text[48] = "";
+    const Headless::Condition& c = breakpoint.condition;
+    if (breakpoint.conditional) {
+        switch (c.type) {
+            case Headless::Condition::PC:
+                std::snprintf(text, sizeof(text), "pc == %04X", c.addr);
+                break;
+            case Headless::Condition::HALT:
+                std::snprintf(text, sizeof(text), "halt");
+                break;
+            case Headless::Condition::REG:
+                std::snprintf(text, sizeof(text), "V%X == %02X", c.addr, c.val);
+                break;
+            case Headless::Condition::MEM:
+                std::snprintf(text, sizeof(text), "mem@%04X == %02X", c.addr, c.val);
+                break;
+        }
+    }
+    if (breakpoint.pc == DEBUG_NO_PC) return std::string("when ") + text;
+    char at[8];
+    std::snprintf(at, sizeof(at), "%04X", breakpoint.pc);
+    return breakpoint.conditional ? std::string(at) + " if " + text : std::string(at);
+}
+
+std::string Debugger::describe(const Watchpoint& watch) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%04X-%04X %s%s", watch.first, watch.last, watch.read ? "r" : "",
+                  watch.write ? "w" : "");
+    return text;
+}
@@ -0,0 +1,167 @@
+#include <detect/detector.h>
+#include <headless/headless.h>
+#include <log/log.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+// most to least likely for an unknown ROM; ties go to the earlier candidate
+const std::array<int, 4> detect_platforms{SCHIP_MODERN, CHIP8, SCHIP1_1, XO_CHIP};
+// keys games tend to use first
+const std::array<uint8_t, 8> detect_keys{0x5, 0x4, 0x6, 0x8, 0x2, 0x7, 0xA, 0x1};
+
+QuirkDetector::QuirkDetector(const Database& db, std::string cache_path, unsigned threads)
+    : db(db), cache_path(cache_path), pool(threads) {
+    // quirks that change behaviour without changing the platform; the rest follow the platform
+    for (int platform : detect_platforms) {
+        CPU::Config base = db.gen_platform_config(platform);
+        std::string name = platform_name(platform);
+        candidates.push_back({name, base});
+
+        CPU::Config variant = base;
+        variant.quirks.shift = !base.quirks.shift;
+        candidates.push_back({name + (variant.quirks.shift ? " +shift" : " -shift"), variant});
+
+        variant = base;
+        variant.quirks.memory_leave_I_unchanged = !base.quirks.memory_leave_I_unchanged;
+        variant.quirks.memory_increment_by_X = false;
+        candidates.push_back({name + (variant.quirks.memory_leave_I_unchanged ? " +memory" : " -memory"), variant});
+
+        variant = base;
+        variant.quirks.jump = !base.quirks.jump;
+        candidates.push_back({name + (variant.quirks.jump ? " +jump" : " -jump"), variant});
+    }
+
+    if (cache_path.empty()) return;
+    std::ifstream file(cache_path);
+    if (!file.is_open()) return;
+    try {
+        json saved = json::parse(file);
+        for (const auto& entry : saved.items()) cache[entry.key()] = entry.value().get<CPU::Config>();
+    } catch (const std::exception& e) {
+        std::cerr << "Ignoring detection cache " << cache_path << ": " << e.what() << std::endl;
+        cache.clear();
+    }
+}
+
+void QuirkDetector::set_frames(uint64_t detect_frames) {
+    frames = detect_frames;
+}
+
+/*-----------------[Detection]-----------------*/
+
+QuirkDetector::Result QuirkDetector::run(const Candidate& candidate, const uint8_t* data, size_t size) {
+    Result result;
+    result.candidate = candidate;
+
+    // CPU carries its screen and page table so keep it off the worker stack
+    auto cpu = std::make_unique<CPU>();
+    cpu->set_config(candidate.config);
+    if (cpu->load_program_data(data, size) < 0) {
+        result.score = -1e9;
+        return result;
+    }
+    cpu->seed(1);
+    cpu->reset_stats();
+    cpu->resume();
+
+    const uint16_t start = candidate.config.start_address;
+    Headless::Condition halt;
+    uint64_t previous = hash_screen(cpu->screen_view());
+    uint64_t lit = 0;
+    for (uint64_t f = 0; f < frames; f++) {
+        uint64_t phase = f % DETECT_PERIOD;
+        uint8_t key = detect_keys[f / DETECT_PERIOD % detect_keys.size()];
+        cpu->set_keys(phase < DETECT_HOLD ? 1 << key : 0);
+        cpu->run_frame();
+
+        const std::array<uint8_t, SCREEN_SIZE>& screen = cpu->screen_view();
+        uint64_t current = hash_screen(screen);
+        result.changed_frames += current != previous;
+        previous = current;
+        lit += SCREEN_SIZE - std::count(screen.begin(), screen.end(), 0);
+
+        uint16_t pc = cpu->get_pc();
+        result.stray_frames += pc < start || pc >= start + size;
+        // keep running a halted program; a draw can still be waiting on the vblank
+        result.halted = result.halted || check_condition(*cpu, halt);
+    }
+
+    CPU::Stats stats = cpu->get_stats();
+    result.instructions = stats.instructions;
+    result.invalid_opcodes = stats.invalid_opcodes;
+    result.stack_faults = stats.stack_faults;
+    result.fetch_faults = stats.fetch_faults;
+    uint64_t ran = std::max<uint64_t>(1, stats.frames);
+    result.lit = (double)lit / ran / SCREEN_SIZE;
+
+    // faults are near certain signs of the wrong machine, a stray PC a likely one
+    double score = 0;
+    score -= 100.0 * std::min<uint64_t>(result.invalid_opcodes, 10);
+    score -= 100.0 * std::min<uint64_t>(result.stack_faults, 10);
+    score -= 100.0 * std::min<uint64_t>(result.fetch_faults, 10);
+    score -= 50.0 * result.stray_frames / ran;
+    // something should be drawn and keep changing, but a screen that is mostly lit is usually garbage
+    score += std::min<uint64_t>(result.changed_frames, 60) / 2.0;
+    if (result.changed_frames == 0) score -= 20;
+    if (result.lit > 0.45) score -= 30;
+    result.score = score;
+    return result;
+}
+
+std::vector<QuirkDetector::Result> QuirkDetector::rank(const uint8_t* data, size_t size) {
+    std::vector<Result> results(candidates.size());
+    auto run_candidate = [&](size_t i) { results[i] = run(candidates[i], data, size); };
+    pool.parallel_for(candidates.size(), run_candidate);
+    std::stable_sort(results.begin(), results.end(),
+                     [](const Result& a, const Result& b) { return a.score > b.score; });
+    return results;
+}
+
+CPU::Config QuirkDetector::detect(const uint8_t* data, size_t size, const std::string& sha1) {
+    CPU::Config config;
+    if (cached(sha1, config)) return config;
+
+    std::vector<Result> results = rank(data, size);
+    config = results.front().candidate.config;
+    NACHO_LOG(LOG_DEBUG, "Detected %s for unknown game", results.front().candidate.name.c_str());
+
+    std::lock_guard<std::mutex> lock(cache_mtx);
+    cache[sha1] = config;
+    save_cache();
+    return config;
+}
+
+bool QuirkDetector::cached(const std::string& sha1, CPU::Config& config) {
+    std::lock_guard<std::mutex> lock(cache_mtx);
+    auto it = cache.find(sha1);
+    if (it == cache.end()) return false;
+    config = it->second;
+    return true;
+}
+
+// called with cache_mtx held
+void QuirkDetector::save_cache() {
+    if (cache_path.empty()) return;
+    json saved = json::object();
+    for (const auto& [sha1, config] : cache) saved[sha1] = config;
+    std::ofstream file(cache_path);
+    if (!file.is_open()) {
+        std::cerr << "Could not write detection cache " << cache_path << std::endl;
+        return;
+    }
+    file << saved.dump(2) << std::endl;
+}
+
+std::string detect_result_to_text(const QuirkDetector::Result& r) {
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-18s %8.1f  invalid %llu  stack %llu  fetch %llu  stray %llu  changed %llu  lit %.2f%s",
+                  r.candidate.name.c_str(), r.score, (unsigned long long)r.invalid_opcodes,
+                  (unsigned long long)r.stack_faults, (unsigned long long)r.fetch_faults,
+                  (unsigned long long)r.stray_frames, (unsigned long long)r.changed_frames, r.lit,
+                  r.halted ? "  halted" : "");
+    return line;
+}
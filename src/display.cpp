@@ -1,16 +1,37 @@
 #include <display/display.h>
 
+#include <embedded/shader_fs.h>
+#include <embedded/shader_vs.h>
+#include <log/log.h>
+
+#include <chrono>
 #include <cstring>
+#include <future>
 
 #include "cpu/cpu.h"
 #include "miniaudio.h"
 
 /*-----------------[Special Member Functions]-----------------*/
 
-Display::Display(CPU& cpu) : core(cpu), gui(core) {
+Display::Display(CPU& cpu) : core(cpu) {
+    // neither needs the window, so both run while GLFW and GL are set up on this thread
+    auto database = std::async(std::launch::async, [this] {
+        Database db("database");
+        startup.mark("database");
+        return db;
+    });
+    auto audio = std::async(std::launch::async, [this] {
+        init_audio();
+        startup.mark("audio");
+    });
+
     init_display();
-    gui.init_gui(window);
-    init_audio();
+    gui = std::make_unique<GUI>(core, database.get());
+    gui->init_gui(window);
+    gui->set_metrics(&metrics);
+    core.set_metrics(&metrics);
+    startup.mark("gui");
+    audio.get();
 }
 
 /*-----------------[Window]-----------------*/
@@ -25,6 +46,7 @@ void Display::init_display() {
     if (!window) {
         throw std::runtime_error("Failed to create GLFW window");
     }
+    startup.mark("window");
 
     glfwSetWindowAspectRatio(window, WIDTH, (HEIGHT + OFFSET));
     glfwSetWindowSizeLimits(window, WIDTH * SCALE, (HEIGHT + OFFSET) * SCALE, GLFW_DONT_CARE, GLFW_DONT_CARE);
@@ -36,15 +58,17 @@ void Display::init_display() {
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         throw std::runtime_error("Failed to initialize GLAD");
     }
+    startup.mark("gl");
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
     glViewport(0, 0, WIDTH * SCALE, (HEIGHT + OFFSET) * SCALE);
     glfwSetFramebufferSizeCallback(window, Display::framebuffer_size_callback);
 
-    // create shader object
-    shader = Shader("shaders/shader.vs", "shaders/shader.fs");
+    // create shader object from the sources embedded at build time
+    shader = Shader::fromSource((const char*)shader_vs, (const char*)shader_fs, SHADER_CACHE);
     shader.use();
+    startup.mark(shader.cached ? "shaders (cached)" : "shaders");
 
     float top = 1.0 - (2.0 * OFFSET) / (HEIGHT + OFFSET);
 
@@ -93,12 +117,18 @@ void Display::init_display() {
 
     // set on and off color uniforms
     for (int i = 0; i < 16; i++) {
-        shader.setVec3fv("color" + std::to_string(i), core.config.colors[i].data());
+        color_locations[i] = shader.getLocation("color" + std::to_string(i));
     }
+    update_colors();
+
+    glGenQueries(GPU_QUERIES, gpu_queries.data());
 }
 
 void Display::render_loop() {
+    auto previous = std::chrono::steady_clock::time_point{};
     while (!glfwWindowShouldClose(window)) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_allocations = alloc_counter::thread_counts().allocations;
         if (core.check_stop()) {
             break;
         }
@@ -108,13 +138,16 @@ void Display::render_loop() {
         }
 
         if (core.check_screen() == true) {
+            // uploads straight from the emulator's framebuffer; the lock only lasts as long as the copy
+            // into the driver
             auto screenlock { core.get_screen() };
             glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RED_INTEGER, GL_UNSIGNED_BYTE,
                             screenlock.screen.data());
         }
 
-        gui.update();
+        gui->update();
 
+        glBeginQuery(GL_TIME_ELAPSED, gpu_queries[presented % GPU_QUERIES]);
         glClear(GL_COLOR_BUFFER_BIT);
 
         shader.use();
@@ -124,22 +157,53 @@ void Display::render_loop() {
 
         glBindVertexArray(0);
 
-        gui.render();
+        gui->render();
+        glEndQuery(GL_TIME_ELAPSED);
+
+        auto ms = [](auto duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+        double interval = previous.time_since_epoch().count() ? ms(start - previous) : 0;
+        metrics.render_frame(ms(std::chrono::steady_clock::now() - start), interval, read_gpu_time(),
+                             alloc_counter::thread_counts().allocations - start_allocations);
+        previous = start;
+        presented += 1;
 
         glfwSwapBuffers(window);
+        if (presented == 1) {
+            double ms = startup.mark("first frame");
+            NACHO_LOG(ms > STARTUP_TARGET_MS ? LOG_WARN : LOG_INFO, "Startup: %s", startup.report().c_str());
+        }
         glfwPollEvents();
     }
 }
 
+// result of the oldest query in flight in milliseconds, or -1 while it isn't available yet
+double Display::read_gpu_time() {
+    if (presented + 1 < GPU_QUERIES) return -1;
+    unsigned int query = gpu_queries[(presented + 1) % GPU_QUERIES];
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return -1;
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    return elapsed / 1e6;
+}
+
+void Display::export_metrics(std::string target) {
+    exporter = std::make_unique<MetricsExporter>(metrics, target);
+}
+
 void Display::update_colors() {
     shader.use();
 
     for (int i = 0; i < 16; i++) {
-        shader.setVec3fv("color" + std::to_string(i), core.config.colors[i].data());
+        shader.setVec3fv(color_locations[i], core.config.colors[i].data());
     }
 }
 
 void Display::terminate() {
+    exporter.reset();
+    core.set_metrics(nullptr);
+    glDeleteQueries(GPU_QUERIES, gpu_queries.data());
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &EBO);
 
@@ -317,10 +381,9 @@ void Display::write_samples_callback() {
     void* pWriteBuffer;
     ma_pcm_rb_acquire_write(pRB, &numSamples, &pWriteBuffer);
 
-    std::array<uint8_t, SAMPLE_SIZE> samples; 
     // if XO-CHIP we generate custom samples otherwise we generate a default beep from a square wave
     if (core.config.system == XO_CHIP) {
-        samples = core.gen_frame_samples();
+        core.gen_frame_samples(samples.data());
     } else {
         ma_waveform_read_pcm_frames(&beepWF, samples.data(), SAMPLE_SIZE, nullptr);
     }
@@ -336,11 +399,13 @@ void Display::write_samples_callback() {
         memcpy(pWriteBuffer, samples.data() + numSamples, remaining);
         ma_pcm_rb_commit_write(pRB, remaining);
     }
+
+    metrics.audio_fill(ma_pcm_rb_available_read(pRB), SAMPLE_SIZE * 8);
 }
 
 void Display::init_audio() {
     // set audio callback to write samples
-    core.set_audio_callback([this]() { this->write_samples_callback(); });
+    core.set_audio_callback([](void* display) { ((Display*)display)->write_samples_callback(); }, this);
 
     ma_device_config deviceConfig;
 
@@ -360,7 +425,7 @@ void Display::init_audio() {
     deviceConfig.playback.channels = DEVICE_CHANNELS;
     deviceConfig.sampleRate = DEVICE_SAMPLE_RATE;
     deviceConfig.dataCallback = data_callback;
-    deviceConfig.pUserData = &rb;
+    deviceConfig.pUserData = this;
 
     if (ma_device_init(NULL, &deviceConfig, &device) != MA_SUCCESS) {
         throw std::runtime_error("Failed to initialize audio device");
@@ -369,12 +434,17 @@ void Display::init_audio() {
 }
 
 void Display::data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
-    ma_pcm_rb* pRB;
+    Display* display = (Display*)pDevice->pUserData;
+    assert(display != NULL);
+    ma_pcm_rb* pRB = &display->rb;
 
     assert(pDevice->playback.channels == DEVICE_CHANNELS);
 
-    pRB = (ma_pcm_rb*)pDevice->pUserData;
-    assert(pRB != NULL);
+    // samples were queued but not enough of them: the emulation thread fell behind the device
+    ma_uint32 queued = ma_pcm_rb_available_read(pRB);
+    if (queued > 0 && queued < frameCount) {
+        display->metrics.audio_underrun();
+    }
 
     ma_uint32 framesRead = frameCount;
 
@@ -0,0 +1,220 @@
+#include <perf/guest_profiler.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+static const char* class_names[OPCODE_CLASSES] = {
+    "00E0", "00EE", "00CN", "00DN", "00FB", "00FC", "00FD", "00FE", "00FF", "0NNN", "1NNN", "2NNN", "3XNN", "4XNN",
+    "5XY0", "5XY2", "5XY3", "6XNN", "7XNN", "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+    "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "F000", "FX01", "F002", "FX07", "FX0A", "FX15", "FX18",
+    "FX1E", "FX29", "FX30", "FX33", "FX3A", "FX55", "FX65", "FX75", "FX85", "5XYN", "8XYN", "invalid"};
+
+// indices of the classes that need a lookup below
+#define CLASS_5XYN 51
+#define CLASS_8XYN 52
+#define CLASS_INVALID 53
+
+GuestProfiler::GuestProfiler()
+    : pc_counts(new std::atomic<uint64_t>[0x10000]), written_bytes(new std::atomic<uint8_t>[0x10000]) {
+    reset();
+}
+
+void GuestProfiler::reset() {
+    reset_requested.store(false, std::memory_order_relaxed);
+    for (size_t i = 0; i < 0x10000; i++) {
+        pc_counts[i] = 0;
+        written_bytes[i] = 0;
+    }
+    for (auto& count : class_counts) count = 0;
+    executed_total = 0;
+    depth = 0;
+    std::lock_guard<std::mutex> lock(subroutine_mtx);
+    subroutine_stats.clear();
+}
+
+void GuestProfiler::request_reset() {
+    reset_requested.store(true, std::memory_order_relaxed);
+}
+
+/*-----------------[Classes]-----------------*/
+
+// the decode tree of CPU::decode flattened to one index per opcode form
+int GuestProfiler::opcode_class(uint16_t instruction) {
+    uint8_t n = instruction & 0xF;
+    uint8_t nn = instruction & 0xFF;
+    switch (instruction >> 12) {
+        case 0x0:
+            if (instruction == 0x00E0) return 0;
+            if (instruction == 0x00EE) return 1;
+            if ((instruction & 0xFFF0) == 0x00C0) return 2;
+            if ((instruction & 0xFFF0) == 0x00D0) return 3;
+            if (instruction >= 0x00FB && instruction <= 0x00FF) return 4 + (instruction - 0x00FB);
+            return 9;
+        case 0x5:
+            if (n == 0) return 14;
+            if (n == 2) return 15;
+            if (n == 3) return 16;
+            return CLASS_5XYN;
+        case 0x8:
+            if (n <= 7) return 19 + n;
+            if (n == 0xE) return 27;
+            return CLASS_8XYN;
+        case 0x9:
+            return 28;
+        case 0xE:
+            if (nn == 0x9E) return 33;
+            if (nn == 0xA1) return 34;
+            return CLASS_INVALID;
+        case 0xF:
+            if (instruction == 0xF000) return 35;
+            if (instruction == 0xF002) return 37;
+            switch (nn) {
+                case 0x01: return 36;
+                case 0x07: return 38;
+                case 0x0A: return 39;
+                case 0x15: return 40;
+                case 0x18: return 41;
+                case 0x1E: return 42;
+                case 0x29: return 43;
+                case 0x30: return 44;
+                case 0x33: return 45;
+                case 0x3A: return 46;
+                case 0x55: return 47;
+                case 0x65: return 48;
+                case 0x75: return 49;
+                case 0x85: return 50;
+            }
+            return CLASS_INVALID;
+        default:
+            // 1NNN-4XNN, 6XNN, 7XNN and ANNN-DXYN have one form each
+            static const int single[16] = {0, 10, 11, 12, 13, 0, 17, 18, 0, 0, 29, 30, 31, 32, 0, 0};
+            return single[instruction >> 12];
+    }
+}
+
+const char* GuestProfiler::class_name(int opcode_class) {
+    return class_names[opcode_class];
+}
+
+/*-----------------[Subroutines]-----------------*/
+
+void GuestProfiler::enter(uint16_t addr) {
+    // deeper than any real stack: the program is faulting, stop attributing
+    if (depth == SHADOW_STACK) return;
+    frames[depth++] = {addr, executed_total.load(std::memory_order_relaxed), 0};
+}
+
+void GuestProfiler::leave() {
+    if (depth == 0) return;
+    Frame frame = frames[--depth];
+    // the return itself counts toward the subroutine
+    uint64_t inclusive = executed_total.load(std::memory_order_relaxed) - frame.start;
+    if (depth > 0) frames[depth - 1].callees += inclusive;
+
+    std::lock_guard<std::mutex> lock(subroutine_mtx);
+    Subroutine& stats = subroutine_stats[frame.addr];
+    stats.addr = frame.addr;
+    stats.calls += 1;
+    stats.inclusive += inclusive;
+    stats.self += inclusive - frame.callees;
+}
+
+/*-----------------[Access]-----------------*/
+
+uint64_t GuestProfiler::instructions() const {
+    return executed_total.load(std::memory_order_relaxed);
+}
+
+uint64_t GuestProfiler::pc_count(uint16_t pc) const {
+    return pc_counts[pc].load(std::memory_order_relaxed);
+}
+
+bool GuestProfiler::written(uint16_t addr) const {
+    return written_bytes[addr].load(std::memory_order_relaxed);
+}
+
+std::array<uint64_t, OPCODE_CLASSES> GuestProfiler::class_histogram() const {
+    std::array<uint64_t, OPCODE_CLASSES> histogram;
+    for (int c = 0; c < OPCODE_CLASSES; c++) histogram[c] = class_counts[c].load(std::memory_order_relaxed);
+    return histogram;
+}
+
+// heaviest first
+std::vector<GuestProfiler::Subroutine> GuestProfiler::subroutines() const {
+    std::vector<Subroutine> list;
+    {
+        std::lock_guard<std::mutex> lock(subroutine_mtx);
+        for (const auto& [addr, stats] : subroutine_stats) list.push_back(stats);
+    }
+    std::sort(list.begin(), list.end(), [](const Subroutine& a, const Subroutine& b) {
+        return a.inclusive != b.inclusive ? a.inclusive > b.inclusive : a.addr < b.addr;
+    });
+    return list;
+}
+
+/*-----------------[Output]-----------------*/
+
+// [first, last] runs of addresses where covered(addr) holds
+template <typename Covered>
+static nlohmann::json ranges(Covered covered, uint64_t& bytes) {
+    nlohmann::json out = nlohmann::json::array();
+    bytes = 0;
+    int first = -1;
+    for (int addr = 0; addr <= 0x10000; addr++) {
+        bool in = addr < 0x10000 && covered((uint16_t)addr);
+        if (in) bytes += 1;
+        if (in && first < 0) first = addr;
+        if (!in && first >= 0) {
+            out.push_back({first, addr - 1});
+            first = -1;
+        }
+    }
+    return out;
+}
+
+nlohmann::json GuestProfiler::to_json() const {
+    nlohmann::json out;
+    out["instructions"] = instructions();
+
+    std::array<uint64_t, OPCODE_CLASSES> histogram = class_histogram();
+    out["opcodes"] = nlohmann::json::object();
+    for (int c = 0; c < OPCODE_CLASSES; c++) {
+        if (histogram[c]) out["opcodes"][class_names[c]] = histogram[c];
+    }
+
+    std::vector<std::pair<uint16_t, uint64_t>> pcs;
+    for (size_t pc = 0; pc < 0x10000; pc++) {
+        if (pc_count(pc)) pcs.push_back({(uint16_t)pc, pc_count(pc)});
+    }
+    std::sort(pcs.begin(), pcs.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    out["pcs"] = nlohmann::json::array();
+    for (const auto& [pc, count] : pcs) out["pcs"].push_back({pc, count});
+
+    out["subroutines"] = nlohmann::json::array();
+    for (const Subroutine& s : subroutines()) {
+        out["subroutines"].push_back(
+            {{"addr", s.addr}, {"calls", s.calls}, {"inclusive", s.inclusive}, {"self", s.self}});
+    }
+
+    // an executed instruction covers its two bytes
+    uint64_t executed = 0, written_total = 0;
+    out["coverage"]["executed_ranges"] =
+        ranges([this](uint16_t addr) { return pc_count(addr) || pc_count(addr - 1); }, executed);
+    out["coverage"]["written_ranges"] = ranges([this](uint16_t addr) { return written(addr); }, written_total);
+    out["coverage"]["executed"] = executed;
+    out["coverage"]["written"] = written_total;
+    return out;
+}
+
+bool GuestProfiler::export_json(std::string filepath) const {
+    std::ofstream file(filepath);
+    if (!file.is_open()) {
+        std::cerr << "Could not write " << filepath << std::endl;
+        return false;
+    }
+    file << to_json().dump(2) << std::endl;
+    return true;
+}
@@ -1,11 +1,18 @@
 #include <ImGuiFileDialog.h>
 #include <gui/gui.h>
+#include <io/rom_file.h>
+#include <perf/alloc_counter.h>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -13,11 +20,32 @@
 #include "cpu/cpu.h"
 #include "imgui_internal.h"
 
-GUI::GUI(CPU& cpu) : core(cpu), db("database") {}
+GUI::GUI(CPU& cpu, Database&& database)
+    : core(cpu), db(std::move(database)), library(db, "library.cache"), detector(db, "detected.json") {
+    core.set_debugger(&debugger);
+    library.add_directory("games");
+    library.load_cache();
+    library.watch(std::chrono::seconds(3));
+    // indexing takes a few milliseconds, too long to do on the frame that first opens the catalog
+    catalog_future = std::async(std::launch::async, [this] { return std::make_unique<CatalogIndex>(db); });
+}
+
+GUI::~GUI() {
+    core.set_debugger(nullptr);
+    core.set_profiler(nullptr);
+    core.set_guest_profiler(nullptr);
+    core.set_trace(nullptr);
+}
+
+void GUI::set_metrics(RuntimeMetrics* runtime_metrics) {
+    metrics = runtime_metrics;
+}
 
 // provide openGL window context and type
 void GUI::init_gui(GLFWwindow* window) {
     IMGUI_CHECKVERSION();
+    // route ImGui's heap use through the counters too, so the overlay's numbers cover the whole frame
+    if (alloc_counter::enabled()) ImGui::SetAllocatorFunctions(alloc_counter::counted_malloc, alloc_counter::counted_free);
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO();
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
@@ -46,18 +74,22 @@ void GUI::update() {
     ImGui::NewFrame();
     // ImGui::ShowDemoWindow();
 
+    if (detecting.valid() && detecting.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        core.set_config(detecting.get());
+        core.load_program_data(detecting_rom.data(), detecting_rom.size());
+    }
+    superseded.erase(std::remove_if(superseded.begin(), superseded.end(),
+                                    [](const std::future<CPU::Config>& f) {
+                                        return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                                    }),
+                     superseded.end());
+
     if (ImGuiFileDialog::Instance()->Display("ChooseFileDlg", ImGuiWindowFlags_NoCollapse, minSize, maxSize)) {
         if (ImGuiFileDialog::Instance()->IsOk()) {  // action if OK
             std::string filePathName = ImGuiFileDialog::Instance()->GetFilePathName();
             std::string filePath = ImGuiFileDialog::Instance()->GetCurrentPath();
 
-            int fileSize = core.loadProgram(filePathName);
-            if (fileSize >= 0) {
-                CPU::Config config = db.gen_config(core.hash_bin(fileSize));
-                core.set_config(config);
-                // reload if not default start addr
-                if (config.start_address != 0x200) core.loadProgram(filePathName);
-            }
+            load_game(filePathName);
         }
         // close
         ImGuiFileDialog::Instance()->Close();
@@ -173,6 +205,44 @@ void GUI::update() {
         ImGui::End();
     }
 
+    if (show_perf) {
+        perf_window();
+    }
+
+    if (show_overlay && metrics) {
+        overlay_window();
+    }
+
+    if (show_trace) {
+        trace_window();
+    }
+
+    if (show_breakpoints) {
+        breakpoint_window();
+    }
+
+    if (show_catalog) {
+        catalog_window();
+    }
+
+    if (ImGuiFileDialog::Instance()->Display("TraceFileDlg", ImGuiWindowFlags_NoCollapse, minSize, maxSize)) {
+        if (ImGuiFileDialog::Instance()->IsOk() && trace) {
+            trace->dump(ImGuiFileDialog::Instance()->GetFilePathName());
+        }
+        ImGuiFileDialog::Instance()->Close();
+    }
+
+    if (show_guest_profile) {
+        guest_profile_window();
+    }
+
+    if (ImGuiFileDialog::Instance()->Display("ProfileFileDlg", ImGuiWindowFlags_NoCollapse, minSize, maxSize)) {
+        if (ImGuiFileDialog::Instance()->IsOk() && guest_profiler) {
+            guest_profiler->export_json(ImGuiFileDialog::Instance()->GetFilePathName());
+        }
+        ImGuiFileDialog::Instance()->Close();
+    }
+
     if (ImGui::BeginMainMenuBar()) {
         if (ImGui::BeginMenu("File")) {
             if (ImGui::MenuItem("Open", "Ctrl+O")) {
@@ -180,6 +250,9 @@ void GUI::update() {
                 config.path = "games";
                 ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlg", "Choose File", ".ch8,.xo8", config);
             }
+            if (ImGui::MenuItem("Catalog", nullptr, show_catalog)) {
+                show_catalog = !show_catalog;
+            }
             if (ImGui::MenuItem("Save", "Ctrl+S")) {
                 // TODO: add savestate functionality
                 // menu for save functionality
@@ -244,12 +317,462 @@ void GUI::update() {
             if (ImGui::MenuItem("Registers")) {
                 core.dump_reg();
             }
+            if (ImGui::MenuItem("Breakpoints", nullptr, show_breakpoints)) {
+                show_breakpoints = !show_breakpoints;
+            }
+            if (ImGui::MenuItem("Performance overlay", nullptr, show_overlay)) {
+                show_overlay = !show_overlay;
+            }
+            if (ImGui::MenuItem("Trace", nullptr, show_trace)) {
+                show_trace = !show_trace;
+                if (!trace) trace = std::make_unique<TraceBuffer>();
+                core.set_trace(show_trace ? trace.get() : nullptr);
+            }
+            if (ImGui::MenuItem("Guest profile", nullptr, show_guest_profile)) {
+                show_guest_profile = !show_guest_profile;
+                if (!guest_profiler) guest_profiler = std::make_unique<GuestProfiler>();
+                core.set_guest_profiler(show_guest_profile ? guest_profiler.get() : nullptr);
+            }
+            if (ImGui::MenuItem("Performance counters", nullptr, show_perf)) {
+                show_perf = !show_perf;
+                profiler.reset();
+                core.set_profiler(show_perf ? &profiler : nullptr);
+            }
             ImGui::EndMenu();
         }
         ImGui::EndMainMenuBar();
     }
 }
 
+// host counters per frame phase, accumulated since the window was opened or reset
+void GUI::perf_window() {
+    ImGui::Begin("Performance counters", &show_perf, ImGuiWindowFlags_AlwaysAutoResize);
+    FrameProfiler::Report report = profiler.report();
+
+    if (!report.available) {
+        ImGui::TextUnformatted("Hardware counters unavailable (perf_event_paranoid or no PMU)");
+    }
+    ImGui::Text("%llu frames, %llu instructions", (unsigned long long)report.frames,
+                (unsigned long long)report.instructions);
+    ImGui::Checkbox("Per million instructions", &perf_per_minstr);
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) profiler.reset();
+
+    double scale = 0;
+    if (perf_per_minstr && report.instructions) scale = 1e6 / report.instructions;
+    if (!perf_per_minstr && report.frames) scale = 1.0 / report.frames;
+
+    if (ImGui::BeginTable("phases", PERF_EVENTS + 2, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("phase");
+        ImGui::TableSetupColumn("calls");
+        for (int e = 0; e < PERF_EVENTS; e++) ImGui::TableSetupColumn(PerfCounters::event_name(e));
+        ImGui::TableHeadersRow();
+        for (int p = 0; p < PERF_PHASES; p++) {
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(FrameProfiler::phase_name(p));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", report.calls[p] * scale);
+            for (int e = 0; e < PERF_EVENTS; e++) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%.0f", report.totals[p][e] * scale);
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    // closing the window detaches the profiler so the emulator runs without counter reads
+    if (!show_perf) core.set_profiler(nullptr);
+    ImGui::End();
+}
+
+// newest instructions at the bottom; recording stops when the window closes
+void GUI::trace_window() {
+    ImGui::SetNextWindowSize(ImVec2(420, 400), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Trace", &show_trace);
+    ImGui::Text("%llu instructions recorded", (unsigned long long)trace->recorded());
+    ImGui::SameLine();
+    if (ImGui::Button("Dump")) {
+        IGFD::FileDialogConfig config;
+        config.path = ".";
+        ImGuiFileDialog::Instance()->OpenDialog("TraceFileDlg", "Dump trace...", ".bin", config);
+    }
+
+    // the newest few thousand are plenty to look at; Dump writes the whole ring
+    double now = ImGui::GetTime();
+    if (now - trace_refreshed >= VIEW_REFRESH) {
+        trace_refreshed = now;
+        trace->snapshot(trace_entries, 4096);
+    }
+    ImGui::BeginChild("entries");
+    ImGuiListClipper clipper;
+    clipper.Begin((int)trace_entries.size());
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            ImGui::TextUnformatted(trace_entry_to_text(trace_entries[i]).c_str());
+        }
+    }
+    if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) ImGui::SetScrollHereY(1.0f);
+    ImGui::EndChild();
+
+    if (!show_trace) core.set_trace(nullptr);
+    ImGui::End();
+}
+
+// breakpoints stay armed when the window closes; Clear disarms everything
+void GUI::breakpoint_window() {
+    ImGui::SetNextWindowSize(ImVec2(360, 420), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Breakpoints", &show_breakpoints);
+
+    std::string hit = Debugger::describe(debugger.last_hit());
+    ImGui::Text("%s", core.is_paused() ? "Paused" : "Running");
+    if (!hit.empty()) ImGui::TextWrapped("Last stop: %s", hit.c_str());
+    if (ImGui::Button("Continue")) core.resume();
+    ImGui::SameLine();
+    if (ImGui::Button("Step")) core.step();
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) {
+        debugger.clear();
+        break_screen = false;
+    }
+
+    std::shared_ptr<const Debugger::Armed> armed = debugger.armed();
+
+    ImGui::SeparatorText("Breakpoints");
+    ImGui::SetNextItemWidth(220);
+    bool add = ImGui::InputTextWithHint("##breakpoint", "0x2a4, 0x2a4 if v3==0x10, v3==0x10",
+                                        breakpoint_text.data(), breakpoint_text.size(),
+                                        ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    if (ImGui::Button("Add##breakpoint") || add) {
+        Debugger::Breakpoint breakpoint;
+        if (Debugger::parse_breakpoint(breakpoint_text.data(), breakpoint)) {
+            if (breakpoint.conditional) {
+                debugger.add_breakpoint(breakpoint.pc, breakpoint.condition);
+            } else {
+                debugger.add_breakpoint(breakpoint.pc);
+            }
+            breakpoint_text[0] = 0;
+        }
+    }
+    for (size_t b = 0; b < armed->breakpoints.size(); b++) {
+        ImGui::PushID((int)b);
+        if (ImGui::SmallButton("x")) debugger.remove_breakpoint(b);
+        ImGui::SameLine();
+        ImGui::TextUnformatted(Debugger::describe(armed->breakpoints[b]).c_str());
+        ImGui::PopID();
+    }
+
+    ImGui::SeparatorText("Watchpoints");
+    ImGui::SetNextItemWidth(220);
+    add = ImGui::InputTextWithHint("##watch", "0x300-0x30f:rw", watch_text.data(), watch_text.size(),
+                                   ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    if (ImGui::Button("Add##watch") || add) {
+        Debugger::Watchpoint watch;
+        if (Debugger::parse_watchpoint(watch_text.data(), watch)) {
+            debugger.add_watchpoint(watch);
+            watch_text[0] = 0;
+        }
+    }
+    for (size_t w = 0; w < armed->watchpoints.size(); w++) {
+        ImGui::PushID(1000 + (int)w);
+        if (ImGui::SmallButton("x")) debugger.remove_watchpoint(w);
+        ImGui::SameLine();
+        ImGui::TextUnformatted(Debugger::describe(armed->watchpoints[w]).c_str());
+        ImGui::PopID();
+    }
+
+    ImGui::SeparatorText("Frames");
+    if (ImGui::Checkbox("Break when the screen changes", &break_screen)) {
+        debugger.break_on_screen_change(break_screen);
+    }
+    ImGui::Text("Frame %llu", (unsigned long long)core.get_stats().frames);
+    ImGui::SetNextItemWidth(120);
+    ImGui::InputScalar("##frame", ImGuiDataType_U64, &target_frame);
+    ImGui::SameLine();
+    if (ImGui::Button("Run to frame") && target_frame > core.get_stats().frames) {
+        debugger.run_to_frame(target_frame);
+        core.resume();
+    }
+    ImGui::End();
+}
+
+// formats into stack buffers so drawing the overlay doesn't show up in the allocations it reports
+static void histogram_row(const char* label, const Histogram& histogram) {
+    std::array<uint64_t, HISTOGRAM_BUCKETS + 1> counts = histogram.counts();
+    std::array<float, HISTOGRAM_BUCKETS + 1> bars;
+    for (int b = 0; b <= HISTOGRAM_BUCKETS; b++) bars[b] = (float)counts[b];
+    char overlay[48];
+    std::snprintf(overlay, sizeof(overlay), "p50 %.3g ms  p99 %.3g ms", histogram.quantile(0.5),
+                  histogram.quantile(0.99));
+    ImGui::PlotHistogram(label, bars.data(), (int)bars.size(), 0, overlay, 0, FLT_MAX, ImVec2(260, 48));
+}
+
+// live frame pacing, lock contention and audio numbers; histogram buckets run from 0.25 ms to over 100 ms
+void GUI::overlay_window() {
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    ImGui::Begin("Performance overlay", &show_overlay, ImGuiWindowFlags_AlwaysAutoResize);
+    RuntimeMetrics& m = *metrics;
+
+    ImGui::Text("%.3f MIPS", m.mips.load());
+    ImGui::Text("%llu / %d instructions per frame", (unsigned long long)m.frame_instructions.load(), m.speed.load());
+
+    ImGui::SeparatorText("Frame times");
+    histogram_row("emulation work", m.emulation_work);
+    histogram_row("emulation interval", m.emulation_interval);
+    histogram_row("sleep oversleep", m.oversleep);
+    histogram_row("render work", m.render_work);
+    histogram_row("render interval", m.render_interval);
+    histogram_row("gpu", m.gpu_time);
+
+    ImGui::SeparatorText("Locks");
+    ImGui::Text("screen: %llu waits, %.3f ms", (unsigned long long)m.screen_waits.load(),
+                m.screen_wait_seconds.load() * 1000);
+    ImGui::Text("keys: %llu waits, %.3f ms", (unsigned long long)m.key_waits.load(), m.key_wait_seconds.load() * 1000);
+
+    ImGui::SeparatorText("Allocations");
+    if (alloc_counter::enabled()) {
+        ImGui::Text("emulation: %llu last frame, %llu total", (unsigned long long)m.emulation_allocations.load(),
+                    (unsigned long long)m.emulation_allocations_total.load());
+        ImGui::Text("render: %llu last frame, %llu total", (unsigned long long)m.render_allocations.load(),
+                    (unsigned long long)m.render_allocations_total.load());
+    } else {
+        ImGui::TextUnformatted("not counted (build with NACHO_COUNT_ALLOCS)");
+    }
+
+    ImGui::SeparatorText("Audio");
+    uint32_t capacity = std::max<uint32_t>(m.audio_capacity, 1);
+    char fill[48];
+    std::snprintf(fill, sizeof(fill), "%u / %u samples", m.audio_samples.load(), capacity);
+    ImGui::ProgressBar((float)m.audio_samples / capacity, ImVec2(260, 0), fill);
+    ImGui::Text("%llu underruns", (unsigned long long)m.audio_underruns.load());
+    ImGui::End();
+}
+
+// 64 KB of memory as 64 x 64 blocks of 16 bytes: red for executed (brighter is hotter), blue for written
+void GUI::guest_profile_window() {
+    ImGui::Begin("Guest profile", &show_guest_profile, ImGuiWindowFlags_AlwaysAutoResize);
+    GuestProfiler& guest = *guest_profiler;
+
+    ImGui::Text("%llu instructions", (unsigned long long)guest.instructions());
+    ImGui::SameLine();
+    // the emulation thread may be recording, so it clears the profile itself at its next frame
+    if (ImGui::Button("Reset")) {
+        guest.request_reset();
+        profile_refreshed = -VIEW_REFRESH;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export")) {
+        IGFD::FileDialogConfig config;
+        config.path = ".";
+        ImGuiFileDialog::Instance()->OpenDialog("ProfileFileDlg", "Export profile...", ".json", config);
+    }
+
+    const int block = PROFILE_BLOCK, columns = 64;
+    const float cell = 6.0f;
+    double now = ImGui::GetTime();
+    if (now - profile_refreshed >= VIEW_REFRESH) {
+        profile_refreshed = now;
+        refresh_profile(guest);
+    }
+    const auto& executed = profile_executed;
+    const auto& written = profile_written;
+
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    for (int b = 0; b < 0x10000 / block; b++) {
+        float heat = executed[b] ? std::log((double)executed[b] + 1) / std::log((double)profile_hottest + 1) : 0.0f;
+        ImU32 color = IM_COL32((int)(64 + 191 * heat) * (executed[b] > 0), 0, written[b] ? 200 : 0, 255);
+        ImVec2 min(origin.x + (b % columns) * cell, origin.y + (b / columns) * cell);
+        draw_list->AddRectFilled(min, ImVec2(min.x + cell - 1, min.y + cell - 1), color);
+    }
+    ImGui::InvisibleButton("heatmap", ImVec2(columns * cell, columns * cell));
+    if (ImGui::IsItemHovered()) {
+        ImVec2 mouse = ImGui::GetMousePos();
+        int b = (int)((mouse.y - origin.y) / cell) * columns + (int)((mouse.x - origin.x) / cell);
+        b = std::clamp(b, 0, 0x10000 / block - 1);
+        ImGui::SetTooltip("0x%04X-0x%04X\nexecuted %llu\n%s", b * block, b * block + block - 1,
+                          (unsigned long long)executed[b], written[b] ? "written" : "");
+    }
+
+    if (ImGui::BeginTabBar("profile")) {
+        if (ImGui::BeginTabItem("Opcodes")) {
+            for (int c : class_order) {
+                if (!class_histogram[c]) break;
+                ImGui::Text("%-8s %12llu  %5.1f%%", GuestProfiler::class_name(c),
+                            (unsigned long long)class_histogram[c],
+                            100.0 * class_histogram[c] / std::max<uint64_t>(guest.instructions(), 1));
+            }
+            ImGui::EndTabItem();
+        }
+        if (ImGui::BeginTabItem("Hot PCs")) {
+            for (const auto& [count, pc] : hot_pcs) {
+                ImGui::Text("0x%04X %04X %12llu", pc, core.read_memory(pc) << 8 | core.read_memory(pc + 1),
+                            (unsigned long long)count);
+            }
+            ImGui::EndTabItem();
+        }
+        if (ImGui::BeginTabItem("Subroutines")) {
+            for (const GuestProfiler::Subroutine& s : profile_subroutines) {
+                ImGui::Text("0x%04X calls %8llu  inclusive %12llu  self %12llu", s.addr, (unsigned long long)s.calls,
+                            (unsigned long long)s.inclusive, (unsigned long long)s.self);
+            }
+            ImGui::EndTabItem();
+        }
+        ImGui::EndTabBar();
+    }
+
+    if (!show_guest_profile) core.set_guest_profiler(nullptr);
+    ImGui::End();
+}
+
+// one pass over the per PC counters for the heatmap and the hot PCs; the buffers are reused between refreshes
+void GUI::refresh_profile(const GuestProfiler& guest) {
+    profile_executed.fill(0);
+    profile_written.fill(false);
+    hot_pcs.clear();
+    for (int addr = 0; addr < 0x10000; addr++) {
+        uint64_t count = guest.pc_count(addr);
+        profile_executed[addr / PROFILE_BLOCK] += count;
+        profile_written[addr / PROFILE_BLOCK] = profile_written[addr / PROFILE_BLOCK] || guest.written(addr);
+        if (count) hot_pcs.push_back({count, (uint16_t)addr});
+    }
+    profile_hottest = std::max<uint64_t>(1, *std::max_element(profile_executed.begin(), profile_executed.end()));
+    size_t shown = std::min<size_t>(hot_pcs.size(), HOT_PCS);
+    std::partial_sort(hot_pcs.begin(), hot_pcs.begin() + shown, hot_pcs.end(), std::greater<>());
+    hot_pcs.resize(shown);
+
+    class_histogram = guest.class_histogram();
+    for (int c = 0; c < OPCODE_CLASSES; c++) class_order[c] = c;
+    std::sort(class_order.begin(), class_order.end(),
+              [this](int a, int b) { return class_histogram[a] > class_histogram[b]; });
+    profile_subroutines = guest.subroutines();
+}
+
+// hash from the mapped file and resolve the config first, so the program is placed once at its start address
+void GUI::load_game(const std::string& path) {
+    RomFile rom;
+    if (!rom.open(path)) return;
+    // a detection still running is for a rom the user moved on from; it finishes (and is cached) unused
+    if (detecting.valid()) superseded.push_back(std::move(detecting));
+
+    std::string sha1 = rom.sha1();
+    CPU::Config config;
+    if (db.is_supported(sha1)) {
+        config = db.gen_config(sha1);
+    } else if (!detector.cached(sha1, config)) {
+        detecting_rom.assign(rom.data(), rom.data() + rom.size());
+        // the worker gets its own copy, so a later load can replace detecting_rom at once
+        detecting = std::async(std::launch::async, [this, data = detecting_rom, sha1] {
+            return detector.detect(data.data(), data.size(), sha1);
+        });
+        return;
+    }
+    core.set_config(config);
+    core.load_program_data(rom.data(), rom.size());
+}
+
+// searchable list of every program in the database; only the visible rows are submitted
+void GUI::catalog_window() {
+    ImGui::SetNextWindowSize(ImVec2(560, 480), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Catalog", &show_catalog);
+
+    if (!catalog) {
+        if (catalog_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ImGui::TextUnformatted("Indexing...");
+            ImGui::End();
+            return;
+        }
+        catalog = catalog_future.get();
+    }
+
+    ImGui::SetNextItemWidth(-FLT_MIN);
+    if (ImGui::InputTextWithHint("##search", "Title, author or description", search_text.data(), search_text.size())) {
+        catalog_query.text = search_text.data();
+        catalog_dirty = true;
+    }
+
+    const std::vector<std::string>& names = catalog->platform_names();
+    for (size_t p = 0; p < names.size() && p < 32; p++) {
+        bool on = catalog_query.platforms & 1u << p;
+        if (p % 3) ImGui::SameLine(p % 3 * 180.0f);
+        if (ImGui::Checkbox(names[p].c_str(), &on)) {
+            catalog_query.platforms ^= 1u << p;
+            catalog_dirty = true;
+        }
+    }
+    ImGui::SetNextItemWidth(200);
+    if (ImGui::DragIntRange2("Years", &catalog_query.min_year, &catalog_query.max_year, 0.2f, 0, 2100,
+                             catalog_query.min_year ? "%d" : "any", catalog_query.max_year ? "%d" : "any")) {
+        catalog_dirty = true;
+    }
+
+    if (catalog_dirty) {
+        auto start = std::chrono::steady_clock::now();
+        catalog->search(catalog_query, catalog_results);
+        search_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        catalog_dirty = false;
+    }
+    ImGui::Text("%zu of %zu programs (%.1f us)", catalog_results.size(), catalog->size(), search_us);
+
+    // leave room for the selected program's details
+    const float details = ImGui::GetTextLineHeightWithSpacing() * 6;
+    ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV |
+                            ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("programs", 4, flags, ImVec2(0, -details))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Title", ImGuiTableColumnFlags_WidthStretch, 2);
+        ImGui::TableSetupColumn("Year", ImGuiTableColumnFlags_WidthFixed, 40);
+        ImGui::TableSetupColumn("Authors", ImGuiTableColumnFlags_WidthStretch, 1.5f);
+        ImGui::TableSetupColumn("Platforms", ImGuiTableColumnFlags_WidthStretch, 1.5f);
+        ImGui::TableHeadersRow();
+
+        ImGuiListClipper clipper;
+        clipper.Begin(catalog_results.size());
+        while (clipper.Step()) {
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+                uint32_t id = catalog_results[row];
+                const CatalogIndex::Entry& entry = catalog->entry(id);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::PushID(id);
+                if (ImGui::Selectable(entry.title.c_str(), selected_program == (int)id,
+                                      ImGuiSelectableFlags_SpanAllColumns)) {
+                    selected_program = id;
+                }
+                ImGui::PopID();
+                ImGui::TableNextColumn();
+                if (entry.year) ImGui::Text("%d", entry.year);
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(entry.authors.c_str());
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(entry.platform_text.c_str());
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    if (selected_program >= 0) {
+        const CatalogIndex::Entry& entry = catalog->entry(selected_program);
+        ImGui::BeginChild("details");
+        ImGui::TextWrapped("%s", entry.description.empty() ? "No description" : entry.description.c_str());
+        // any copy of the rom found by the library scan, whatever its file name
+        for (size_t r = 0; r < entry.files.size(); r++) {
+            std::string path = library.find(entry.roms[r]);
+            ImGui::PushID(r);
+            ImGui::BeginDisabled(path.empty());
+            if (ImGui::SmallButton("Play")) load_game(path);
+            ImGui::EndDisabled();
+            ImGui::PopID();
+            ImGui::SameLine();
+            ImGui::TextUnformatted(entry.files[r].c_str());
+        }
+        ImGui::EndChild();
+    }
+
+    ImGui::End();
+}
+
 void GUI::render() {
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
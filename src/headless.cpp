@@ -0,0 +1,265 @@
+#include <headless/headless.h>
+#include <io/rom_file.h>
+#include <log/log.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+const std::array<std::pair<const char*, int>, 4> platform_names{{
+    {"chip8", CHIP8},
+    {"schip", SCHIP_MODERN},
+    {"schip1.1", SCHIP1_1},
+    {"xochip", XO_CHIP},
+}};
+
+Headless::Headless(CPU& cpu) : core(cpu) {}
+
+/*-----------------[Setup]-----------------*/
+
+// the file is hashed from its mapping and the config resolved first, so the program is placed once
+int Headless::load(std::string filepath, Database& db, int platform) {
+    NACHO_LOG(LOG_INFO, "Loading %s", filepath.c_str());
+    RomFile rom;
+    if (!rom.open(filepath)) return -1;
+    return load_data(rom.data(), rom.size(), db, platform, rom.sha1());
+}
+
+int Headless::load_data(const uint8_t* data, size_t size, Database& db, int platform) {
+    return load_data(data, size, db, platform, CPU::hash_data(data, size));
+}
+
+int Headless::load_data(const uint8_t* data, size_t size, Database& db, int platform, std::string sha1) {
+    hash = sha1;
+    if (platform >= 0) {
+        core.set_config(db.gen_platform_config(platform));
+    } else if (detector && !db.is_supported(hash)) {
+        core.set_config(detector->detect(data, size, hash));
+    } else {
+        core.set_config(db.gen_config(hash));
+    }
+    int loaded = core.load_program_data(data, size);
+    if (loaded < 0) {
+        return loaded;
+    }
+
+    frame = 0;
+    next_input = 0;
+    core.reset_stats();
+    // loading pauses the core; headless runs are never stepped so leave it running
+    core.resume();
+    return loaded;
+}
+
+void Headless::set_detector(QuirkDetector* quirk_detector) {
+    detector = quirk_detector;
+}
+
+void Headless::add_input(InputEvent event) {
+    // keep events ordered by frame so they can be replayed with a single cursor
+    auto it = std::upper_bound(inputs.begin(), inputs.end(), event,
+                               [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+    inputs.insert(it, event);
+}
+
+int Headless::load_input_script(std::string filepath) {
+    std::vector<InputEvent> events;
+    if (read_input_script(filepath, events) != 0) {
+        return -1;
+    }
+    for (const InputEvent& event : events) add_input(event);
+    return 0;
+}
+
+void Headless::add_condition(Condition condition) {
+    conditions.push_back(condition);
+}
+
+/*-----------------[Run]-----------------*/
+
+void Headless::apply_inputs() {
+    while (next_input < inputs.size() && inputs[next_input].frame <= frame) {
+        InputEvent& event = inputs[next_input++];
+        if (event.pressed) {
+            core.press_key(event.key);
+        } else {
+            core.release_key(event.key);
+        }
+    }
+}
+
+bool Headless::condition_met() {
+    for (Condition& c : conditions) {
+        if (check_condition(core, c)) return true;
+    }
+    return false;
+}
+
+uint64_t Headless::run(uint64_t max_frames) {
+    uint64_t start = frame;
+    // a debugger hit pauses the core, which ends the run like a condition
+    while (frame - start < max_frames && !core.check_stop() && !core.is_paused()) {
+        apply_inputs();
+        core.run_frame();
+        frame++;
+        if (condition_met()) break;
+    }
+    return frame - start;
+}
+
+std::string Headless::get_hash() {
+    return hash;
+}
+
+/*-----------------[Helpers]-----------------*/
+
+// script format: one "<frame> press|release <key>" per line, key in hex, '#' starts a comment
+int read_input_script(std::string filepath, std::vector<Headless::InputEvent>& events) {
+    std::ifstream script(filepath);
+    if (!script.is_open()) {
+        std::cerr << "Could not open input script " << filepath << std::endl;
+        return -1;
+    }
+
+    std::string line;
+    int line_num = 0;
+    while (std::getline(script, line)) {
+        line_num++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        Headless::InputEvent event;
+        std::string action;
+        int key;
+        if (!(iss >> event.frame)) continue;
+        if (!(iss >> action >> std::hex >> key) || (action != "press" && action != "release") || key < 0 ||
+            key > 0xF) {
+            std::cerr << "Invalid input script line " << line_num << ": " << line << std::endl;
+            return -1;
+        }
+        event.key = key;
+        event.pressed = action == "press";
+        events.push_back(event);
+    }
+    return 0;
+}
+
+bool check_condition(CPU& cpu, const Headless::Condition& c) {
+    switch (c.type) {
+        case Headless::Condition::PC:
+            return cpu.get_pc() == c.addr;
+
+        case Headless::Condition::HALT: {
+            // a jump to itself is the usual way for a program to stop
+            uint16_t pc = cpu.get_pc();
+            uint16_t instruction = (cpu.read_memory(pc) << 8) | cpu.read_memory(pc + 1);
+            return instruction == (0x1000 | (pc & 0xFFF));
+        }
+
+        case Headless::Condition::REG:
+            return cpu.get_register(c.addr) == c.val;
+
+        case Headless::Condition::MEM:
+            return cpu.read_memory(c.addr) == c.val;
+    }
+    return false;
+}
+
+int parse_platform(std::string name) {
+    for (const auto& [known, id] : platform_names) {
+        if (name == known) return id;
+    }
+    return -1;
+}
+
+std::string platform_name(int platform) {
+    for (const auto& [name, id] : platform_names) {
+        if (platform == id) return name;
+    }
+    return "unknown";
+}
+
+bool parse_condition(std::string text, Headless::Condition& condition) {
+    // "V3 == 0x10" reads the same as "v3=0x10"
+    text.erase(std::remove(text.begin(), text.end(), ' '), text.end());
+    size_t equals = text.find("==");
+    if (equals != std::string::npos) text.erase(equals, 1);
+
+    try {
+        if (text == "halt") {
+            condition.type = Headless::Condition::HALT;
+            return true;
+        }
+
+        size_t eq = text.find('=');
+        if (eq == std::string::npos) return false;
+        std::string lhs = text.substr(0, eq);
+        int rhs = std::stoi(text.substr(eq + 1), nullptr, 0);
+
+        if (lhs == "pc") {
+            condition.type = Headless::Condition::PC;
+            condition.addr = rhs;
+        } else if (lhs.size() == 2 && (lhs[0] == 'v' || lhs[0] == 'V')) {
+            condition.type = Headless::Condition::REG;
+            condition.addr = std::stoi(lhs.substr(1), nullptr, 16);
+            condition.val = rhs;
+        } else if (lhs.rfind("mem@", 0) == 0) {
+            condition.type = Headless::Condition::MEM;
+            condition.addr = std::stoi(lhs.substr(4), nullptr, 0);
+            condition.val = rhs;
+        } else {
+            return false;
+        }
+    } catch (const std::exception& e) {
+        return false;
+    }
+    return true;
+}
+
+uint64_t hash_screen(const std::array<uint8_t, SCREEN_SIZE>& screen) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint8_t pixel : screen) {
+        hash ^= pixel;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string hash_to_hex(uint64_t hash) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return hex;
+}
+
+bool write_screen_ppm(std::string filepath, const std::array<uint8_t, SCREEN_SIZE>& screen,
+                      const CPU::Config& config) {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << filepath << std::endl;
+        return false;
+    }
+
+    file << "P6\n" << WIDTH << " " << HEIGHT << "\n255\n";
+    for (uint8_t pixel : screen) {
+        const std::array<float, 3>& color = config.colors[pixel & 0xF];
+        for (float channel : color) {
+            file.put(static_cast<char>(channel * 255.0f + 0.5f));
+        }
+    }
+    return true;
+}
+
+std::string screen_to_ascii(const std::array<uint8_t, SCREEN_SIZE>& screen) {
+    static const char shades[] = " #+*";
+    std::string out;
+    out.reserve((WIDTH + 1) * HEIGHT);
+    for (int r = 0; r < HEIGHT; r++) {
+        for (int c = 0; c < WIDTH; c++) {
+            uint8_t pixel = screen[(r * WIDTH) + c];
+            out += pixel < 4 ? shades[pixel] : '@';
+        }
+        out += '\n';
+    }
+    return out;
+}
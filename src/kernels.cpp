@@ -0,0 +1,164 @@
+#include <cpu/kernels.h>
+
+/*-----------------[Sprites]-----------------*/
+
+void draw_sprite(uint8_t* screen, const uint8_t* sprite, uint8_t plane, uint8_t vx, uint8_t vy, uint8_t width,
+                 uint8_t height, bool lores, const CPU::Quirks& quirks, uint8_t& vf) {
+    int scale = lores ? 2 : 1;  // multiply everything by two if we in lores
+
+    width *= scale;
+    height *= scale;
+
+    uint8_t x = (vx * scale) % WIDTH;
+    uint8_t y = (vy * scale) % HEIGHT;
+
+    for (int r = y; r < (y + height); r += scale) {
+        int row = r;
+
+        // we went off of screen
+        if (row >= HEIGHT) {
+            // if we are on a system that sets number of collisions set it
+            if (quirks.set_collisions && !lores) {
+                vf += ((y + height) - HEIGHT);
+            }
+            // if we dont wrap we are done
+            if (!quirks.wrap) {
+                break;
+            }
+            // otherwise wrap around and continue
+            row = r % HEIGHT;
+        }
+
+        // flag for if we got a collision in this row
+        bool collision = false;
+
+        // index to select individual bits from the sprite
+        int sprite_row_index;
+
+        // if our width is 16 * scale we extract two bytes otherwise we just extract one
+        uint16_t sprite_row;
+        if (width == 16 * scale) {
+            sprite_row = (sprite[0] << 8) + sprite[1];
+            sprite += 2;
+            sprite_row_index = 15;
+        } else {
+            sprite_row = sprite[0];
+            sprite += 1;
+            sprite_row_index = 7;
+        }
+
+        for (int c = x; c < (x + width); c += scale) {
+            int col = c;
+            if (c >= WIDTH) {
+                if (!quirks.wrap) {
+                    break;
+                }
+                col = c % WIDTH;
+            }
+
+            uint8_t bit = (sprite_row >> sprite_row_index) & 1;
+            sprite_row_index -= 1;
+            // if bit is 0 we can skip there is nothing to draw
+            if (bit == 0) continue;
+            uint8_t draw_mask = plane;
+
+            // if we are in lores mode draw a 2x2 otherwise draw pixel by pixel
+            if (lores) {
+                int top_left = (row * WIDTH) + col;
+                int top_right = (row * WIDTH) + col + 1;
+                int bot_left = ((row + 1) * WIDTH) + col;
+                int bot_right = ((row + 1) * WIDTH) + col + 1;
+                if ((screen[top_left] & draw_mask) || (screen[top_right] & draw_mask) ||
+                    (screen[bot_left] & draw_mask) || (screen[bot_right] & draw_mask)) {
+                    collision = true;
+                }
+                screen[top_left] ^= draw_mask;
+                screen[top_right] ^= draw_mask;
+                screen[bot_left] ^= draw_mask;
+                screen[bot_right] ^= draw_mask;
+            } else {
+                int screen_index = (row * WIDTH) + col;
+                if (screen[screen_index] & draw_mask) {
+                    collision = true;
+                }
+                screen[screen_index] ^= draw_mask;
+            }
+        }
+        // if there is a collision either increase the vf register by 1 if we are on a system that counts them
+        // otherwise just set it to 1
+        if (collision) {
+            if (quirks.set_collisions && !lores) {
+                vf += 1;
+            } else {
+                vf = 1;
+            }
+        }
+    }
+}
+
+/*-----------------[Clear/Scroll]-----------------*/
+
+void clear_planes(uint8_t* screen, uint8_t planes) {
+    for (int r = 0; r < HEIGHT; r++) {
+        for (int c = 0; c < WIDTH; c++) {
+            int screen_index = (r * WIDTH) + c;
+            screen[screen_index] &= ~planes;
+        }
+    }
+}
+
+void scroll_planes_down(uint8_t* screen, uint8_t planes, uint8_t rows) {
+    // start from bottom and replace with n heigher if in bounds else set to 0
+    for (int row = HEIGHT - 1; row >= 0; row--) {
+        for (int col = WIDTH - 1; col >= 0; col--) {
+            int index = (row * WIDTH) + col;
+            screen[index] &= ~(planes);  // zeroes out bits that will be changed
+            if ((row - rows) >= 0) {
+                int replace_index = ((row - rows) * WIDTH) + col;
+                screen[index] |= planes & screen[replace_index];  // places the scrolled bits in correct bit spot
+            }
+        }
+    }
+}
+
+void scroll_planes_up(uint8_t* screen, uint8_t planes, uint8_t rows) {
+    // start from top and replace with n lower if in bounds else set to 0
+    for (int row = 0; row < HEIGHT; row++) {
+        for (int col = 0; col < WIDTH; col++) {
+            int index = (row * WIDTH) + col;
+            screen[index] &= ~(planes);  // zeroes out bits that will be changed
+            if ((row + rows) < HEIGHT) {
+                int replace_index = ((row + rows) * WIDTH) + col;
+                screen[index] |= planes & screen[replace_index];  // places the scrolled bits in correct bit spot
+            }
+        }
+    }
+}
+
+void scroll_planes_right(uint8_t* screen, uint8_t planes, uint8_t cols) {
+    // traverse right to left top to down
+    for (int row = 0; row < HEIGHT; row++) {
+        for (int col = WIDTH - 1; col >= 0; col--) {
+            int index = (row * WIDTH) + col;
+            screen[index] &= ~(planes);  // zeroes out bits that will be changed
+            if ((col - cols) >= 0) {
+                int replace_index = (row * WIDTH) + (col - cols);
+                screen[index] |= planes & screen[replace_index];  // places the scrolled bits in correct bit spot
+            }
+        }
+    }
+}
+
+void scroll_planes_left(uint8_t* screen, uint8_t planes, uint8_t cols) {
+    // traverse left to right top to down
+    for (int row = 0; row < HEIGHT; row++) {
+        for (int col = 0; col < WIDTH; col++) {
+            int index = (row * WIDTH) + col;
+            screen[index] &= ~(planes);  // zeroes out bits that will be changed
+            if ((col + cols) < WIDTH) {
+                int replace_index = (row * WIDTH) + (col + cols);
+                screen[index] |= planes & screen[replace_index];  // places the scrolled bits in correct bit spot
+            }
+        }
+    }
+}
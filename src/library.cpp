@@ -0,0 +1,220 @@
+#include <batch/batch.h>
+#include <io/mapped_file.h>
+#include <library/library.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+RomLibrary::RomLibrary(const Database& db, std::string cache_path, unsigned threads)
+    : db(db), cache_path(cache_path), pool(threads) {}
+
+RomLibrary::~RomLibrary() {
+    stop_watching();
+}
+
+void RomLibrary::add_directory(std::string dir) {
+    std::lock_guard<std::mutex> lock(scan_mtx);
+    directories.push_back(dir);
+}
+
+/*-----------------[Cache]-----------------*/
+
+// "<size>\t<mtime>\t<sha1>\t<path>" per line after the header; titles are looked up again on load in case
+// the database changed
+bool RomLibrary::load_cache() {
+    if (cache_path.empty()) return false;
+    std::lock_guard<std::mutex> lock(scan_mtx);
+    MappedFile file(cache_path);
+    const char* text = (const char*)file.data();
+    const char* end = text + file.size();
+    const size_t header = sizeof(LIBRARY_CACHE_HEADER) - 1;
+    if (!file.is_open() || file.size() <= header || std::memcmp(text, LIBRARY_CACHE_HEADER "\n", header + 1) != 0) {
+        return false;
+    }
+
+    std::vector<LibraryRom> roms;
+    for (const char* line = text + header + 1; line < end;) {
+        const char* eol = (const char*)std::memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        const char* fields[4] = {line};
+        int count = 1;
+        for (const char* p = line; p < eol && count < 4; p++) {
+            if (*p == '\t') fields[count++] = p + 1;
+        }
+        if (count == 4) {
+            LibraryRom rom;
+            rom.size = std::strtoull(fields[0], nullptr, 10);
+            rom.mtime = std::strtoll(fields[1], nullptr, 10);
+            rom.sha1.assign(fields[2], fields[3] - 1);
+            rom.path.assign(fields[3], eol);
+            roms.push_back(std::move(rom));
+        }
+        line = eol + 1;
+    }
+    auto identify = [&](size_t i) { roms[i].title = db.get_title(roms[i].sha1); };
+    pool.parallel_for(roms.size(), identify);
+    // written sorted, so this is only a check unless the file was edited by hand
+    auto by_path_order = [](const LibraryRom& x, const LibraryRom& y) { return x.path < y.path; };
+    if (!std::is_sorted(roms.begin(), roms.end(), by_path_order)) {
+        std::sort(roms.begin(), roms.end(), by_path_order);
+    }
+    publish(std::move(roms));
+    return true;
+}
+
+bool RomLibrary::save_cache(const std::vector<LibraryRom>& roms) {
+    if (cache_path.empty()) return true;
+    // write beside the cache and rename so a crash never leaves half of one
+    std::string temp = cache_path + ".tmp";
+    {
+        std::ofstream file(temp);
+        if (!file.is_open()) {
+            std::cerr << "Could not write library cache " << cache_path << std::endl;
+            return false;
+        }
+        file << LIBRARY_CACHE_HEADER << '\n';
+        for (const LibraryRom& rom : roms) {
+            file << rom.size << '\t' << rom.mtime << '\t' << rom.sha1 << '\t' << rom.path << '\n';
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, cache_path, ec);
+    if (ec) {
+        std::cerr << "Could not write library cache " << cache_path << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*-----------------[Scan]-----------------*/
+
+RomLibrary::ScanStats RomLibrary::scan() {
+    std::lock_guard<std::mutex> lock(scan_mtx);
+    auto start = std::chrono::steady_clock::now();
+    ScanStats stats;
+
+    std::vector<std::string> paths;
+    for (const std::string& dir : directories) {
+        std::error_code ec;
+        if (fs::is_directory(dir, ec)) paths.push_back(dir);
+    }
+    paths = paths.empty() ? paths : collect_roms(paths);
+
+    // only this thread ever replaces the library, so reading it without the lock is safe here
+    std::vector<LibraryRom> roms(paths.size());
+    std::vector<uint8_t> hashed(paths.size());
+    auto identify = [&](size_t i) {
+        LibraryRom& rom = roms[i];
+        rom.path = paths[i];
+        std::error_code ec;
+        rom.size = fs::file_size(rom.path, ec);
+        if (ec) return;
+        rom.mtime = fs::last_write_time(rom.path, ec).time_since_epoch().count();
+        if (ec) return;
+
+        auto known = by_path.find(rom.path);
+        if (known != by_path.end()) {
+            const LibraryRom& old = library[known->second];
+            if (old.size == rom.size && old.mtime == rom.mtime) {
+                rom.sha1 = old.sha1;
+                rom.title = old.title;
+                return;
+            }
+        }
+        MappedFile file(rom.path);
+        if (!file.is_open()) return;
+        rom.sha1 = CPU::hash_data(file.data(), file.size());
+        rom.title = db.get_title(rom.sha1);
+        hashed[i] = 1;
+    };
+    pool.parallel_for(roms.size(), identify);
+
+    // unreadable and empty files drop out
+    std::vector<LibraryRom> found;
+    found.reserve(roms.size());
+    for (size_t i = 0; i < roms.size(); i++) {
+        if (roms[i].sha1.empty()) continue;
+        stats.hashed += hashed[i];
+        stats.matched += !roms[i].title.empty();
+        found.push_back(std::move(roms[i]));
+    }
+    stats.files = found.size();
+    stats.cached = stats.files - stats.hashed;
+    size_t kept = 0;
+    for (const LibraryRom& rom : found) kept += by_path.count(rom.path);
+    stats.removed = library.size() - std::min(library.size(), kept);
+
+    if (stats.hashed || stats.removed || found.size() != library.size()) {
+        save_cache(found);
+        publish(std::move(found));
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+void RomLibrary::publish(std::vector<LibraryRom> roms) {
+    std::lock_guard<std::mutex> lock(library_mtx);
+    library = std::move(roms);
+    by_path.clear();
+    by_sha1.clear();
+    by_path.reserve(library.size());
+    by_sha1.reserve(library.size());
+    for (size_t i = 0; i < library.size(); i++) {
+        by_path[library[i].path] = i;
+        by_sha1.emplace(library[i].sha1, i);
+    }
+    changes++;
+}
+
+/*-----------------[Watch]-----------------*/
+
+// polls rather than using inotify and friends so it behaves the same everywhere; a warm rescan only stats
+void RomLibrary::watch(std::chrono::milliseconds interval) {
+    stop_watching();
+    watching = true;
+    watcher = std::thread([this, interval]() {
+        std::unique_lock<std::mutex> lock(watch_mtx);
+        while (watching) {
+            lock.unlock();
+            scan();
+            lock.lock();
+            watch_wake.wait_for(lock, interval, [this] { return !watching; });
+        }
+    });
+}
+
+void RomLibrary::stop_watching() {
+    {
+        std::lock_guard<std::mutex> lock(watch_mtx);
+        watching = false;
+    }
+    watch_wake.notify_all();
+    if (watcher.joinable()) watcher.join();
+}
+
+/*-----------------[Access Functions]-----------------*/
+
+std::vector<LibraryRom> RomLibrary::roms() const {
+    std::lock_guard<std::mutex> lock(library_mtx);
+    return library;
+}
+
+std::string RomLibrary::find(const std::string& sha1) const {
+    std::lock_guard<std::mutex> lock(library_mtx);
+    auto it = by_sha1.find(sha1);
+    return it == by_sha1.end() ? "" : library[it->second].path;
+}
+
+uint64_t RomLibrary::generation() const {
+    return changes;
+}
+
+unsigned RomLibrary::threads() {
+    return pool.size();
+}
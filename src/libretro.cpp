@@ -0,0 +1,253 @@
+#include <cpu/cpu.h>
+#include <database/database.h>
+#include <headless/headless.h>
+#include <log/log.h>
+#include <libretro.h>
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+// the core: emulation, database lookup and audio generation behind the libretro API, with video, audio
+// output, input and pacing left to the frontend. One game at a time, as libretro expects
+
+#define RETRO_LIBRARY_NAME "nacho"
+#define RETRO_LIBRARY_VERSION "1.0"
+#define RETRO_EXTENSIONS "ch8|sc8|xo8|c8"
+#define RETRO_FPS 60.0
+// the square wave the GLFW frontend plays for every platform but XO-CHIP
+#define RETRO_BEEP_FREQUENCY 600
+#define RETRO_BEEP_AMPLITUDE (0.05 * 32767)
+// 0 is silence for the unsigned samples gen_frame_samples writes
+#define RETRO_SAMPLE_ZERO 128
+
+namespace {
+
+struct Core {
+    CPU cpu;
+    Headless headless{cpu};
+    // <system directory>/nacho holds the database JSON files and catalog.bin; defaults without it
+    std::unique_ptr<Database> db;
+    std::vector<uint8_t> rom;
+
+    std::array<uint32_t, SCREEN_SIZE> frame{};
+    std::array<uint8_t, SAMPLE_SIZE> samples{};
+    std::array<int16_t, 2 * (SAMPLE_SIZE)> audio{};
+    bool sounding = false;
+    double beep_phase = 0;
+};
+
+std::unique_ptr<Core> core;
+
+retro_environment_t environment_cb = nullptr;
+retro_video_refresh_t video_cb = nullptr;
+retro_audio_sample_batch_t audio_batch_cb = nullptr;
+retro_input_poll_t input_poll_cb = nullptr;
+retro_input_state_t input_state_cb = nullptr;
+
+// keypad key for each joypad button: directions and actions on Octo's WASD/QE layout, the rest on
+// the keys games use for menus
+const std::array<std::pair<unsigned, uint8_t>, 12> joypad_keys = {{
+    {RETRO_DEVICE_ID_JOYPAD_UP, 0x5},
+    {RETRO_DEVICE_ID_JOYPAD_LEFT, 0x7},
+    {RETRO_DEVICE_ID_JOYPAD_DOWN, 0x8},
+    {RETRO_DEVICE_ID_JOYPAD_RIGHT, 0x9},
+    {RETRO_DEVICE_ID_JOYPAD_A, 0x6},
+    {RETRO_DEVICE_ID_JOYPAD_B, 0x4},
+    {RETRO_DEVICE_ID_JOYPAD_X, 0x1},
+    {RETRO_DEVICE_ID_JOYPAD_Y, 0x2},
+    {RETRO_DEVICE_ID_JOYPAD_L, 0x3},
+    {RETRO_DEVICE_ID_JOYPAD_R, 0xC},
+    {RETRO_DEVICE_ID_JOYPAD_SELECT, 0x0},
+    {RETRO_DEVICE_ID_JOYPAD_START, 0xF},
+}};
+
+// keypad key for each keyboard key, the same layout as the GLFW frontend
+const std::array<std::pair<unsigned, uint8_t>, 16> keyboard_keys = {{
+    {RETROK_1, 0x1}, {RETROK_2, 0x2}, {RETROK_3, 0x3}, {RETROK_4, 0xC},
+    {RETROK_q, 0x4}, {RETROK_w, 0x5}, {RETROK_e, 0x6}, {RETROK_r, 0xD},
+    {RETROK_a, 0x7}, {RETROK_s, 0x8}, {RETROK_d, 0x9}, {RETROK_f, 0xE},
+    {RETROK_z, 0xA}, {RETROK_x, 0x0}, {RETROK_c, 0xB}, {RETROK_v, 0xF},
+}};
+
+void open_database() {
+    const char* system_dir = nullptr;
+    if (!environment_cb || !environment_cb(RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY, &system_dir) || !system_dir) {
+        NACHO_LOG(LOG_INFO, "No system directory; using default configs");
+        return;
+    }
+    std::string dir = std::string(system_dir) + "/nacho";
+    try {
+        core->db = std::make_unique<Database>(dir, dir + "/catalog.bin");
+    } catch (const std::exception& e) {
+        NACHO_LOG(LOG_WARN, "No database in %s (%s); using default configs", dir.c_str(), e.what());
+    }
+}
+
+int load_rom() {
+    if (core->db) {
+        return core->headless.load_data(core->rom.data(), core->rom.size(), *core->db);
+    }
+    core->cpu.set_config(CPU::Config());
+    int loaded = core->cpu.load_program_data(core->rom.data(), core->rom.size());
+    core->cpu.reset_stats();
+    core->cpu.resume();
+    return loaded;
+}
+
+// runs from run_frame only on frames the sound timer is on
+void frame_audio(void*) {
+    Core& c = *core;
+    c.sounding = true;
+    if (c.cpu.config.system == XO_CHIP) {
+        c.cpu.gen_frame_samples(c.samples.data());
+        for (int i = 0; i < SAMPLE_SIZE; i++) {
+            int16_t sample = (int16_t)((c.samples[i] - RETRO_SAMPLE_ZERO) * 256);
+            c.audio[2 * i] = c.audio[2 * i + 1] = sample;
+        }
+        return;
+    }
+    double step = (double)RETRO_BEEP_FREQUENCY / DEVICE_SAMPLE_RATE;
+    for (int i = 0; i < SAMPLE_SIZE; i++) {
+        int16_t sample = (int16_t)(c.beep_phase < 0.5 ? RETRO_BEEP_AMPLITUDE : -RETRO_BEEP_AMPLITUDE);
+        c.audio[2 * i] = c.audio[2 * i + 1] = sample;
+        c.beep_phase = std::fmod(c.beep_phase + step, 1.0);
+    }
+}
+
+uint16_t poll_keys() {
+    uint16_t mask = 0;
+    input_poll_cb();
+    for (const auto& [id, key] : joypad_keys) {
+        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, id)) mask |= 1 << key;
+    }
+    for (const auto& [id, key] : keyboard_keys) {
+        if (input_state_cb(0, RETRO_DEVICE_KEYBOARD, 0, id)) mask |= 1 << key;
+    }
+    return mask;
+}
+
+void video_frame() {
+    Core& c = *core;
+    std::array<uint32_t, 16> palette;
+    for (size_t i = 0; i < palette.size(); i++) {
+        const auto& color = c.cpu.config.colors[i];
+        palette[i] = (uint32_t)std::lround(color[0] * 255) << 16 | (uint32_t)std::lround(color[1] * 255) << 8 |
+                     (uint32_t)std::lround(color[2] * 255);
+    }
+    const auto& screen = c.cpu.screen_view();
+    for (size_t i = 0; i < SCREEN_SIZE; i++) c.frame[i] = palette[screen[i] & 0xF];
+    video_cb(c.frame.data(), WIDTH, HEIGHT, WIDTH * sizeof(uint32_t));
+}
+
+}  // namespace
+
+/*-----------------[Callbacks]-----------------*/
+
+RETRO_API void retro_set_environment(retro_environment_t cb) { environment_cb = cb; }
+RETRO_API void retro_set_video_refresh(retro_video_refresh_t cb) { video_cb = cb; }
+// every frame's audio goes through the batch callback
+RETRO_API void retro_set_audio_sample(retro_audio_sample_t) {}
+RETRO_API void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb) { audio_batch_cb = cb; }
+RETRO_API void retro_set_input_poll(retro_input_poll_t cb) { input_poll_cb = cb; }
+RETRO_API void retro_set_input_state(retro_input_state_t cb) { input_state_cb = cb; }
+
+/*-----------------[Lifetime]-----------------*/
+
+RETRO_API void retro_init(void) {
+    core = std::make_unique<Core>();
+    core->cpu.set_audio_callback(frame_audio, nullptr);
+}
+
+RETRO_API void retro_deinit(void) {
+    core.reset();
+}
+
+RETRO_API unsigned retro_api_version(void) { return RETRO_API_VERSION; }
+
+RETRO_API void retro_get_system_info(struct retro_system_info* info) {
+    std::memset(info, 0, sizeof(*info));
+    info->library_name = RETRO_LIBRARY_NAME;
+    info->library_version = RETRO_LIBRARY_VERSION;
+    info->valid_extensions = RETRO_EXTENSIONS;
+    info->need_fullpath = false;
+    info->block_extract = false;
+}
+
+RETRO_API void retro_get_system_av_info(struct retro_system_av_info* info) {
+    std::memset(info, 0, sizeof(*info));
+    info->geometry.base_width = WIDTH;
+    info->geometry.base_height = HEIGHT;
+    info->geometry.max_width = WIDTH;
+    info->geometry.max_height = HEIGHT;
+    info->geometry.aspect_ratio = (float)WIDTH / HEIGHT;
+    info->timing.fps = RETRO_FPS;
+    info->timing.sample_rate = DEVICE_SAMPLE_RATE;
+}
+
+RETRO_API void retro_set_controller_port_device(unsigned, unsigned) {}
+
+RETRO_API bool retro_load_game(const struct retro_game_info* game) {
+    if (!game || !game->data || game->size == 0) return false;
+    enum retro_pixel_format format = RETRO_PIXEL_FORMAT_XRGB8888;
+    if (!environment_cb || !environment_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &format)) {
+        NACHO_LOG(LOG_ERROR, "Frontend does not support XRGB8888");
+        return false;
+    }
+    if (!core->db) open_database();
+    const uint8_t* data = (const uint8_t*)game->data;
+    core->rom.assign(data, data + game->size);
+    return load_rom() >= 0;
+}
+
+RETRO_API bool retro_load_game_special(unsigned, const struct retro_game_info*, size_t) { return false; }
+
+RETRO_API void retro_unload_game(void) {
+    core->rom.clear();
+    core->cpu.pause();
+}
+
+RETRO_API void retro_reset(void) {
+    if (!core->rom.empty()) load_rom();
+}
+
+/*-----------------[Frame]-----------------*/
+
+RETRO_API void retro_run(void) {
+    Core& c = *core;
+    c.cpu.set_keys(poll_keys());
+    c.sounding = false;
+    c.cpu.run_frame();
+    if (!c.sounding) c.audio.fill(0);
+    video_frame();
+    audio_batch_cb(c.audio.data(), SAMPLE_SIZE);
+}
+
+/*-----------------[Save States]-----------------*/
+
+RETRO_API size_t retro_serialize_size(void) { return core->cpu.state_size(); }
+
+RETRO_API bool retro_serialize(void* data, size_t size) {
+    if (size < core->cpu.state_size()) return false;
+    core->cpu.save_state((uint8_t*)data);
+    return true;
+}
+
+RETRO_API bool retro_unserialize(const void* data, size_t size) {
+    // frontends may hand back a larger buffer than serialize_size asked for
+    size_t state = core->cpu.state_size();
+    return size >= state && core->cpu.load_state((const uint8_t*)data, state);
+}
+
+/*-----------------[Unused]-----------------*/
+
+RETRO_API void retro_cheat_reset(void) {}
+RETRO_API void retro_cheat_set(unsigned, bool, const char*) {}
+RETRO_API unsigned retro_get_region(void) { return RETRO_REGION_NTSC; }
+// memory is paged copy on write, so there is no flat block to hand out
+RETRO_API void* retro_get_memory_data(unsigned) { return nullptr; }
+RETRO_API size_t retro_get_memory_size(unsigned) { return 0; }
@@ -0,0 +1,977 @@
+#include <lockstep/lockstep.h>
+#include <cpu/kernels.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*-----------------[SIMD]-----------------*/
+
+// Byte-wise operations on VEC_BYTES lanes at a time. Every row is MAX_LANES bytes and 32 byte aligned
+// so the row loops below are the same for AVX2, SSE2 and the portable fallback.
+#if defined(__AVX2__)
+#define VEC_BYTES 32
+typedef __m256i vec;
+static inline vec vload(const uint8_t* p) { return _mm256_load_si256((const vec*)p); }
+static inline void vstore(uint8_t* p, vec v) { _mm256_store_si256((vec*)p, v); }
+static inline vec vset(uint8_t b) { return _mm256_set1_epi8((char)b); }
+static inline vec vadd(vec a, vec b) { return _mm256_add_epi8(a, b); }
+static inline vec vsub(vec a, vec b) { return _mm256_sub_epi8(a, b); }
+static inline vec vsubs(vec a, vec b) { return _mm256_subs_epu8(a, b); }
+static inline vec vand(vec a, vec b) { return _mm256_and_si256(a, b); }
+static inline vec vor(vec a, vec b) { return _mm256_or_si256(a, b); }
+static inline vec vxor(vec a, vec b) { return _mm256_xor_si256(a, b); }
+static inline vec vandnot(vec a, vec b) { return _mm256_andnot_si256(a, b); }
+static inline vec vmax(vec a, vec b) { return _mm256_max_epu8(a, b); }
+static inline vec vcmpeq(vec a, vec b) { return _mm256_cmpeq_epi8(a, b); }
+// there is no 8 bit shift; shift 16 bit words and drop the bits that crossed into the neighbour byte
+static inline vec vsrl1(vec a) { return _mm256_and_si256(_mm256_srli_epi16(a, 1), vset(0x7F)); }
+static inline vec vsrl7(vec a) { return _mm256_and_si256(_mm256_srli_epi16(a, 7), vset(0x01)); }
+static inline uint64_t vmovemask(vec a) { return (uint32_t)_mm256_movemask_epi8(a); }
+#elif defined(__SSE2__)
+#define VEC_BYTES 16
+typedef __m128i vec;
+static inline vec vload(const uint8_t* p) { return _mm_load_si128((const vec*)p); }
+static inline void vstore(uint8_t* p, vec v) { _mm_store_si128((vec*)p, v); }
+static inline vec vset(uint8_t b) { return _mm_set1_epi8((char)b); }
+static inline vec vadd(vec a, vec b) { return _mm_add_epi8(a, b); }
+static inline vec vsub(vec a, vec b) { return _mm_sub_epi8(a, b); }
+static inline vec vsubs(vec a, vec b) { return _mm_subs_epu8(a, b); }
+static inline vec vand(vec a, vec b) { return _mm_and_si128(a, b); }
+static inline vec vor(vec a, vec b) { return _mm_or_si128(a, b); }
+static inline vec vxor(vec a, vec b) { return _mm_xor_si128(a, b); }
+static inline vec vandnot(vec a, vec b) { return _mm_andnot_si128(a, b); }
+static inline vec vmax(vec a, vec b) { return _mm_max_epu8(a, b); }
+static inline vec vcmpeq(vec a, vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline vec vsrl1(vec a) { return _mm_and_si128(_mm_srli_epi16(a, 1), vset(0x7F)); }
+static inline vec vsrl7(vec a) { return _mm_and_si128(_mm_srli_epi16(a, 7), vset(0x01)); }
+static inline uint64_t vmovemask(vec a) { return (uint32_t)_mm_movemask_epi8(a); }
+#else
+#define VEC_BYTES 8
+struct vec {
+    uint8_t b[VEC_BYTES];
+};
+template <typename F>
+static inline vec vmap(vec a, vec b, F f) {
+    vec r;
+    for (int i = 0; i < VEC_BYTES; i++) r.b[i] = f(a.b[i], b.b[i]);
+    return r;
+}
+static inline vec vload(const uint8_t* p) {
+    vec v;
+    std::memcpy(v.b, p, VEC_BYTES);
+    return v;
+}
+static inline void vstore(uint8_t* p, vec v) { std::memcpy(p, v.b, VEC_BYTES); }
+static inline vec vset(uint8_t b) {
+    vec v;
+    std::memset(v.b, b, VEC_BYTES);
+    return v;
+}
+static inline vec vadd(vec a, vec b) { return vmap(a, b, [](uint8_t x, uint8_t y) { return uint8_t(x + y); }); }
+static inline vec vsub(vec a, vec b) { return vmap(a, b, [](uint8_t x, uint8_t y) { return uint8_t(x - y); }); }
+static inline vec vsubs(vec a, vec b) {
+    return vmap(a, b, [](uint8_t x, uint8_t y) { return uint8_t(x > y ? x - y : 0); });
+}
+static inline vec vand(vec a, vec b) { return vmap(a, b, [](uint8_t x, uint8_t y) { return uint8_t(x & y); }); }
+static inline vec vor(vec a, vec b) { return vmap(a, b, [](uint8_t x, uint8_t y) { return uint8_t(x | y); }); }
+static inline vec vxor(vec a, vec b) { return vmap(a, b, [](uint8_t x, uint8_t y) { return uint8_t(x ^ y); }); }
+static inline vec vandnot(vec a, vec b) { return vmap(a, b, [](uint8_t x, uint8_t y) { return uint8_t(~x & y); }); }
+static inline vec vmax(vec a, vec b) { return vmap(a, b, [](uint8_t x, uint8_t y) { return std::max(x, y); }); }
+static inline vec vcmpeq(vec a, vec b) {
+    return vmap(a, b, [](uint8_t x, uint8_t y) { return uint8_t(x == y ? 0xFF : 0); });
+}
+static inline vec vsrl1(vec a) { return vmap(a, a, [](uint8_t x, uint8_t) { return uint8_t(x >> 1); }); }
+static inline vec vsrl7(vec a) { return vmap(a, a, [](uint8_t x, uint8_t) { return uint8_t(x >> 7); }); }
+static inline uint64_t vmovemask(vec a) {
+    uint64_t bits = 0;
+    for (int i = 0; i < VEC_BYTES; i++) bits |= uint64_t(a.b[i] >> 7) << i;
+    return bits;
+}
+#endif
+
+// mask ? b : a
+static inline vec vblend(vec mask, vec a, vec b) {
+    return vor(vand(mask, b), vandnot(mask, a));
+}
+
+// one bit per lane where row a equals b
+static inline uint64_t equal_bits(const uint8_t* a, vec b) {
+    uint64_t bits = 0;
+    for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+        bits |= vmovemask(vcmpeq(vload(a + c), b)) << c;
+    }
+    return bits;
+}
+
+static inline uint64_t equal_bits(const uint8_t* a, const uint8_t* b) {
+    uint64_t bits = 0;
+    for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+        bits |= vmovemask(vcmpeq(vload(a + c), vload(b + c))) << c;
+    }
+    return bits;
+}
+
+static inline size_t lowest_lane(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+static inline uint64_t count_lanes(uint64_t bits) {
+#ifdef _MSC_VER
+    return __popcnt64(bits);
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+/*-----------------[Special Member Functions]-----------------*/
+
+LockstepEngine::LockstepEngine(CPU::Config config, size_t lanes)
+    : config(config), lanes(std::min<size_t>(std::max<size_t>(lanes, 1), MAX_LANES)) {
+    for (size_t i = 0; i < LockstepEngine::lanes; i++) {
+        cold.push_back(std::make_unique<Lane>());
+        cold.back()->memory = boot_memory();
+    }
+}
+
+/*-----------------[Setup]-----------------*/
+
+int LockstepEngine::load(const uint8_t* data, size_t size) {
+    if (size > (size_t)(MAX_MEM - config.start_address)) {
+        std::cerr << "File size exceeds max program size" << std::endl;
+        return -2;
+    }
+    // every lane starts on the same pages and only copies the ones it writes
+    PagedMemory image = CPU::build_image(data, size, config.start_address);
+    for (size_t lane = 0; lane < lanes; lane++) {
+        Lane& s = *cold[lane];
+        uint32_t rng_state = s.rng_state;
+        CPU::Stats lane_stats = s.stats;
+        s = Lane{};
+        s.rng_state = rng_state;
+        s.stats = lane_stats;
+        s.memory = image;
+
+        PC[lane] = I[lane] = config.start_address;
+        delay[lane] = sound[lane] = 0;
+        for (int r = 0; r < 16; r++) {
+            V[r][lane] = 0;
+        }
+    }
+    drawn = 0;
+    return size;
+}
+
+void LockstepEngine::seed(size_t lane, uint32_t seed) {
+    cold[lane]->rng_state = seed ? seed : 1;
+}
+
+// same edge handling as CPU::set_keys so FX0A sees presses and releases
+void LockstepEngine::set_keys(size_t lane, uint16_t mask) {
+    Lane& s = *cold[lane];
+    uint16_t changed = s.keys ^ mask;
+    for (uint8_t key = 0; key < 16; key++) {
+        if (!((changed >> key) & 1)) continue;
+        if ((mask >> key) & 1) {
+            s.keys |= (1 << key);
+            s.pressed |= (1 << key);
+        } else {
+            s.keys ^= (1 << key);
+            s.released = key;
+        }
+    }
+}
+
+/*-----------------[Access Functions]-----------------*/
+
+size_t LockstepEngine::size() {
+    return lanes;
+}
+
+LockstepEngine::Stats LockstepEngine::get_stats() {
+    return stats;
+}
+
+void LockstepEngine::reset_stats() {
+    stats = Stats{};
+    for (size_t lane = 0; lane < lanes; lane++) {
+        cold[lane]->stats = CPU::Stats{};
+        retired[lane] = 0;
+    }
+}
+
+CPU::Stats LockstepEngine::get_lane_stats(size_t lane) {
+    CPU::Stats lane_stats = cold[lane]->stats;
+    lane_stats.instructions = retired[lane];
+    return lane_stats;
+}
+
+uint16_t LockstepEngine::get_pc(size_t lane) {
+    return PC[lane];
+}
+
+uint16_t LockstepEngine::get_index(size_t lane) {
+    return I[lane];
+}
+
+uint8_t LockstepEngine::get_register(size_t lane, uint8_t reg) {
+    return V[reg & 0xF][lane];
+}
+
+uint8_t LockstepEngine::get_delay(size_t lane) {
+    return delay[lane];
+}
+
+uint8_t LockstepEngine::get_sound(size_t lane) {
+    return sound[lane];
+}
+
+int LockstepEngine::get_sp(size_t lane) {
+    return cold[lane]->SP;
+}
+
+uint16_t LockstepEngine::get_stack(size_t lane, int level) {
+    return cold[lane]->stack[level & (MAX_STACK - 1)];
+}
+
+uint8_t LockstepEngine::read_memory(size_t lane, uint16_t addr) {
+    return cold[lane]->memory.read(addr);
+}
+
+const std::array<uint8_t, SCREEN_SIZE>& LockstepEngine::screen_view(size_t lane) {
+    return cold[lane]->screen;
+}
+
+const PagedMemory& LockstepEngine::get_memory(size_t lane) {
+    return cold[lane]->memory;
+}
+
+/*-----------------[Main Functionality]-----------------*/
+
+// every lane executes the same slots as CPU::run_frame would, leaving the frame early after a vblank draw
+void LockstepEngine::run_frame() {
+    vec one = vset(1);
+    for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+        vstore(delay + c, vsubs(vload(delay + c), one));
+        vstore(sound + c, vsubs(vload(sound + c), one));
+    }
+
+    uint64_t running = all_lanes();
+    for (int i = 0; i < config.speed; i++) {
+        uint64_t hit = running & drawn;
+        drawn &= ~hit;
+        running &= ~hit;
+        if (!running) break;
+        step(running);
+    }
+
+    stats.frames += 1;
+    for (size_t lane = 0; lane < lanes; lane++) {
+        cold[lane]->stats.frames += 1;
+    }
+}
+
+uint64_t LockstepEngine::all_lanes() {
+    return lanes == MAX_LANES ? ~0ull : (1ull << lanes) - 1;
+}
+
+void LockstepEngine::set_mask(uint64_t running) {
+    mask_bits = running;
+    for (int lane = 0; lane < MAX_LANES; lane++) {
+        lane_mask[lane] = ((running >> lane) & 1) ? 0xFF : 0;
+    }
+}
+
+uint16_t LockstepEngine::opcode_at(size_t lane, uint16_t addr) {
+    return cold[lane]->memory.read16(addr);
+}
+
+// register-only opcodes with no per lane branching besides skips
+bool LockstepEngine::vectorizable(uint16_t instruction) {
+    switch (instruction >> 12) {
+        case 0x1:
+        case 0x3:
+        case 0x4:
+        case 0x6:
+        case 0x7:
+        case 0x9:
+        case 0xA:
+            return true;
+
+        case 0x5:
+            return (instruction & 0xF) == 0x0;
+
+        case 0x8: {
+            uint8_t op = instruction & 0xF;
+            return op <= 0x7 || op == 0xE;
+        }
+
+        case 0xF: {
+            uint8_t op = instruction & 0xFF;
+            return op == 0x07 || op == 0x15 || op == 0x18 || op == 0x1E;
+        }
+    }
+    return false;
+}
+
+// lanes of pending sitting on pc with the same instruction there (self-modifying code can differ)
+uint64_t LockstepEngine::group_of(uint64_t pending, uint16_t pc, uint16_t instruction) {
+    uint64_t group = 0;
+    for (uint64_t bits = pending; bits; bits &= bits - 1) {
+        size_t lane = lowest_lane(bits);
+        if (PC[lane] == pc && opcode_at(lane, pc) == instruction) {
+            group |= 1ull << lane;
+        }
+    }
+    return group;
+}
+
+// execute one instruction on every running lane. Lanes sharing the lowest lane's instruction go through
+// the vector path together; as soon as that group is a single lane the rest are stepped one by one
+void LockstepEngine::step(uint64_t running) {
+    uint64_t pending = running;
+    while (pending) {
+        size_t leader = lowest_lane(pending);
+        uint16_t pc = PC[leader];
+        if (pc > MAX_MEM - 2) break;
+
+        uint16_t instruction = opcode_at(leader, pc);
+        if (!vectorizable(instruction)) break;
+        uint64_t group = group_of(pending, pc, instruction);
+        if (count_lanes(group) < 2) break;
+
+        if (group != mask_bits) set_mask(group);
+        for (int lane = 0; lane < MAX_LANES; lane++) {
+            PC[lane] = lane_mask[lane] ? pc + 2 : PC[lane];
+            retired[lane] += lane_mask[lane] & 1;
+        }
+        execute_vector(instruction, group);
+        stats.vector_steps += 1;
+        stats.vector_instructions += count_lanes(group);
+        pending &= ~group;
+    }
+
+    for (uint64_t bits = pending; bits; bits &= bits - 1) {
+        size_t lane = lowest_lane(bits);
+        execute(lane, fetch(lane));
+        retired[lane] += 1;
+    }
+    stats.scalar_instructions += count_lanes(pending);
+}
+
+/*-----------------[Vector Path]-----------------*/
+
+// PC has already moved past the instruction for every lane in group (and lane_mask matches group)
+void LockstepEngine::execute_vector(uint16_t instruction, uint64_t group) {
+    uint8_t x_reg = (instruction >> 8) & 0xF;
+    uint8_t y_reg = (instruction >> 4) & 0xF;
+    uint8_t val = instruction & 0xFF;
+    uint16_t addr = instruction & 0xFFF;
+    uint8_t* vx = V[x_reg];
+    uint8_t* vy = V[y_reg];
+    uint8_t* vf = V[0xF];
+    vec one = vset(1);
+
+    switch (instruction >> 12) {
+        // 1NNN jump
+        case 0x1:
+            for (int lane = 0; lane < MAX_LANES; lane++) {
+                PC[lane] = lane_mask[lane] ? addr : PC[lane];
+            }
+            break;
+
+        // 3XNN / 4XNN skip if VX == / != NN
+        case 0x3:
+            skip_lanes(group & equal_bits(vx, vset(val)));
+            break;
+
+        case 0x4:
+            skip_lanes(group & ~equal_bits(vx, vset(val)));
+            break;
+
+        // 5XY0 / 9XY0 skip if VX == / != VY
+        case 0x5:
+            skip_lanes(group & equal_bits(vx, vy));
+            break;
+
+        case 0x9:
+            skip_lanes(group & ~equal_bits(vx, vy));
+            break;
+
+        // 6XNN / 7XNN set / add NN
+        case 0x6:
+            for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+                vstore(vx + c, vblend(vload(lane_mask + c), vload(vx + c), vset(val)));
+            }
+            break;
+
+        case 0x7:
+            for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+                vec a = vload(vx + c);
+                vstore(vx + c, vblend(vload(lane_mask + c), a, vadd(a, vset(val))));
+            }
+            break;
+
+        case 0x8: {
+            uint8_t op = instruction & 0xF;
+            // each chunk loads every input before storing so X == Y or X == F alias correctly,
+            // and VF is stored last like the scalar opcodes
+            for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+                vec m = vload(lane_mask + c);
+                vec a = vload(vx + c);
+                vec b = vload(vy + c);
+                vec res = a, flag = a;
+                bool set_flag = true;
+                switch (op) {
+                    case 0x0:
+                        res = b;
+                        set_flag = false;
+                        break;
+
+                    case 0x1:
+                    case 0x2:
+                    case 0x3:
+                        res = op == 0x1 ? vor(a, b) : op == 0x2 ? vand(a, b) : vxor(a, b);
+                        flag = vset(0);
+                        set_flag = config.quirks.logic;
+                        break;
+
+                    case 0x4:
+                        res = vadd(a, b);
+                        // wrapped around when the sum is smaller than VX
+                        flag = vandnot(vcmpeq(vmax(res, a), res), one);
+                        break;
+
+                    case 0x5:
+                        res = vsub(a, b);
+                        flag = vand(vcmpeq(vmax(a, b), a), one);
+                        break;
+
+                    case 0x7:
+                        res = vsub(b, a);
+                        flag = vand(vcmpeq(vmax(a, b), b), one);
+                        break;
+
+                    case 0x6: {
+                        vec src = config.quirks.shift ? a : b;
+                        res = vsrl1(src);
+                        flag = vand(src, one);
+                        break;
+                    }
+
+                    default: {  // 0xE
+                        vec src = config.quirks.shift ? a : b;
+                        res = vadd(src, src);
+                        flag = vsrl7(src);
+                        break;
+                    }
+                }
+                vstore(vx + c, vblend(m, a, res));
+                if (set_flag) {
+                    vstore(vf + c, vblend(m, vload(vf + c), flag));
+                }
+            }
+            break;
+        }
+
+        // ANNN set index
+        case 0xA:
+            for (int lane = 0; lane < MAX_LANES; lane++) {
+                I[lane] = lane_mask[lane] ? addr : I[lane];
+            }
+            break;
+
+        case 0xF:
+            switch (val) {
+                // FX07 set VX to delay timer
+                case 0x07:
+                    for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+                        vstore(vx + c, vblend(vload(lane_mask + c), vload(vx + c), vload(delay + c)));
+                    }
+                    break;
+
+                // FX15 / FX18 set delay / sound timer to VX
+                case 0x15:
+                    for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+                        vstore(delay + c, vblend(vload(lane_mask + c), vload(delay + c), vload(vx + c)));
+                    }
+                    break;
+
+                case 0x18:
+                    for (int c = 0; c < MAX_LANES; c += VEC_BYTES) {
+                        vstore(sound + c, vblend(vload(lane_mask + c), vload(sound + c), vload(vx + c)));
+                    }
+                    break;
+
+                // FX1E add VX to I; 16 bit rows are left to the compiler's auto-vectorizer
+                default:
+                    for (int lane = 0; lane < MAX_LANES; lane++) {
+                        I[lane] += vx[lane] & lane_mask[lane];
+                    }
+                    break;
+            }
+            break;
+    }
+}
+
+void LockstepEngine::skip_lanes(uint64_t group) {
+    for (uint64_t bits = group; bits; bits &= bits - 1) {
+        skip(lowest_lane(bits));
+    }
+}
+
+/*-----------------[Scalar Path]-----------------*/
+
+// faults are counted but not printed; with many lanes the same fault would be reported over and over
+uint16_t LockstepEngine::fetch(size_t lane) {
+    if (PC[lane] > MAX_MEM - 2) {
+        cold[lane]->stats.fetch_faults += 1;
+        return 0;
+    }
+    uint16_t instruction = opcode_at(lane, PC[lane]);
+    PC[lane] += 2;
+    return instruction;
+}
+
+// skip the next instruction, including both words of F000 NNNN
+void LockstepEngine::skip(size_t lane) {
+    if (fetch(lane) == 0xF000) {
+        fetch(lane);
+    }
+}
+
+void LockstepEngine::write(size_t lane, uint16_t addr, uint8_t val) {
+    cold[lane]->memory.write(addr, val);
+}
+
+// mirrors CPU::decode and the opcode handlers for one lane
+void LockstepEngine::execute(size_t lane, uint16_t instruction) {
+    Lane& s = *cold[lane];
+    uint8_t x_reg = (instruction >> 8) & 0xF;
+    uint8_t y_reg = (instruction >> 4) & 0xF;
+    uint8_t val = instruction & 0xFF;
+    uint16_t addr = instruction & 0xFFF;
+    uint8_t& vx = V[x_reg][lane];
+    uint8_t& vy = V[y_reg][lane];
+    uint8_t& vf = V[0xF][lane];
+
+    switch (instruction >> 12) {
+        case 0x0:
+            execute_system(lane, instruction);
+            break;
+
+        // 1NNN jump
+        case 0x1:
+            PC[lane] = addr;
+            break;
+
+        // 2NNN start subroutine
+        case 0x2:
+            if (s.SP == MAX_STACK - 1) {
+                s.stats.stack_faults += 1;
+            } else {
+                s.stack[++s.SP] = PC[lane];
+            }
+            PC[lane] = addr;
+            break;
+
+        case 0x3:
+            if (vx == val) skip(lane);
+            break;
+
+        case 0x4:
+            if (vx != val) skip(lane);
+            break;
+
+        case 0x5:
+            switch (instruction & 0xF) {
+                // 5XY0 skip if VX == VY
+                case 0x0:
+                    if (vx == vy) skip(lane);
+                    break;
+
+                // 5XY2 / 5XY3 write / read registers X to Y at I
+                case 0x2:
+                case 0x3: {
+                    uint16_t mem = I[lane];
+                    int8_t inc = x_reg <= y_reg ? 1 : -1;
+                    bool write_mem = (instruction & 0xF) == 0x2;
+                    for (uint8_t reg = x_reg;; reg += inc) {
+                        if (write_mem) {
+                            write(lane, mem, V[reg][lane]);
+                        } else {
+                            V[reg][lane] = read_memory(lane, mem);
+                        }
+                        if (reg == y_reg) break;
+                        mem += 1;
+                    }
+                    break;
+                }
+
+                default:
+                    s.stats.invalid_opcodes += 1;
+            }
+            break;
+
+        case 0x6:
+            vx = val;
+            break;
+
+        case 0x7:
+            vx += val;
+            break;
+
+        case 0x8:
+            switch (instruction & 0xF) {
+                case 0x0:
+                    vx = vy;
+                    break;
+
+                case 0x1:
+                    vx |= vy;
+                    if (config.quirks.logic) vf = 0;
+                    break;
+
+                case 0x2:
+                    vx &= vy;
+                    if (config.quirks.logic) vf = 0;
+                    break;
+
+                case 0x3:
+                    vx ^= vy;
+                    if (config.quirks.logic) vf = 0;
+                    break;
+
+                case 0x4: {
+                    uint8_t x = vx;
+                    vx += vy;
+                    vf = (vx < x || vx < vy) ? 1 : 0;
+                    break;
+                }
+
+                case 0x5: {
+                    uint8_t underflow = vy > vx ? 0 : 1;
+                    vx -= vy;
+                    vf = underflow;
+                    break;
+                }
+
+                case 0x6: {
+                    if (!config.quirks.shift) vx = vy;
+                    uint8_t out = vx & 1;
+                    vx >>= 1;
+                    vf = out;
+                    break;
+                }
+
+                case 0x7: {
+                    uint8_t underflow = vx > vy ? 0 : 1;
+                    vx = vy - vx;
+                    vf = underflow;
+                    break;
+                }
+
+                case 0xE: {
+                    if (!config.quirks.shift) vx = vy;
+                    uint8_t out = (vx >> 7) & 1;
+                    vx <<= 1;
+                    vf = out;
+                    break;
+                }
+
+                default:
+                    s.stats.invalid_opcodes += 1;
+            }
+            break;
+
+        case 0x9:
+            if (vx != vy) skip(lane);
+            break;
+
+        case 0xA:
+            I[lane] = addr;
+            break;
+
+        // BNNN jump to NNN + V0 (BXNN jump to XNN + VX with the jump quirk)
+        case 0xB:
+            PC[lane] = addr + (config.quirks.jump ? vx : V[0x0][lane]);
+            break;
+
+        // CXNN random byte AND NN, same xorshift32 stream as the CPU
+        case 0xC:
+            s.rng_state ^= s.rng_state << 13;
+            s.rng_state ^= s.rng_state >> 17;
+            s.rng_state ^= s.rng_state << 5;
+            vx = (s.rng_state % 256) & val;
+            break;
+
+        case 0xD:
+            draw(lane, x_reg, y_reg, instruction & 0xF);
+            break;
+
+        case 0xE:
+            switch (val) {
+                // EX9E / EXA1 skip if key VX is / is not pressed
+                case 0x9E:
+                    if ((s.keys >> (vx & 0xF)) & 1) skip(lane);
+                    break;
+
+                case 0xA1:
+                    if (!((s.keys >> (vx & 0xF)) & 1)) skip(lane);
+                    break;
+
+                default:
+                    s.stats.invalid_opcodes += 1;
+            }
+            break;
+
+        case 0xF:
+            execute_misc(lane, instruction);
+            break;
+    }
+}
+
+// 0NNN group: screen and mode opcodes
+void LockstepEngine::execute_system(size_t lane, uint16_t instruction) {
+    Lane& s = *cold[lane];
+    uint8_t n = instruction & 0xF;
+
+    switch ((instruction >> 4) & 0xF) {
+        case 0xE:
+            if (n == 0x0) {
+                // 00E0 clear
+                clear_planes(s.screen.data(), s.bit_plane);
+            } else if (n == 0xE) {
+                // 00EE return
+                if (s.SP == -1) {
+                    s.stats.stack_faults += 1;
+                    PC[lane] = 0;
+                } else {
+                    PC[lane] = s.stack[s.SP--];
+                }
+            } else {
+                s.stats.invalid_opcodes += 1;
+            }
+            break;
+
+        // 00CN scroll down
+        case 0xC:
+            if (s.lores && !config.quirks.half_scroll_lores) n *= 2;
+            scroll_planes_down(s.screen.data(), s.bit_plane, n);
+            break;
+
+        // 00DN scroll up
+        case 0xD:
+            if (s.lores) n *= 2;
+            scroll_planes_up(s.screen.data(), s.bit_plane, n);
+            break;
+
+        case 0xF: {
+            uint8_t four = s.lores && !config.quirks.half_scroll_lores ? 8 : 4;
+            switch (n) {
+                // 00FB / 00FC scroll right / left
+                case 0xB:
+                    scroll_planes_right(s.screen.data(), s.bit_plane, four);
+                    break;
+
+                case 0xC:
+                    scroll_planes_left(s.screen.data(), s.bit_plane, four);
+                    break;
+
+                // 00FD exit (ignored like the CPU)
+                case 0xD:
+                    break;
+
+                // 00FE / 00FF lores / hires
+                case 0xE:
+                case 0xF:
+                    if (config.quirks.clean_screen) {
+                        std::fill(s.screen.begin(), s.screen.end(), 0);
+                    }
+                    s.lores = n == 0xE;
+                    break;
+
+                default:
+                    s.stats.invalid_opcodes += 1;
+            }
+            break;
+        }
+
+        default:
+            s.stats.invalid_opcodes += 1;
+    }
+}
+
+// FXNN group: timers, keypad, index, memory and audio
+void LockstepEngine::execute_misc(size_t lane, uint16_t instruction) {
+    Lane& s = *cold[lane];
+    uint8_t x_reg = (instruction >> 8) & 0xF;
+    uint8_t& vx = V[x_reg][lane];
+
+    switch (instruction & 0xFF) {
+        // F000 NNNN long index
+        case 0x00:
+            I[lane] = fetch(lane);
+            break;
+
+        // FX01 select plane X
+        case 0x01:
+            s.bit_plane = x_reg;
+            break;
+
+        // F002 load the 16 byte audio pattern at I
+        case 0x02:
+            s.phase = 0;
+            for (uint16_t i = 0; i < 16; i++) {
+                uint8_t pattern = read_memory(lane, I[lane] + i);
+                for (int b = 7; b >= 0; b--) {
+                    s.audio_pattern[8 * i + (7 - b)] = (pattern >> b) & 1;
+                }
+            }
+            break;
+
+        case 0x07:
+            vx = delay[lane];
+            break;
+
+        // FX0A wait for a key press and release
+        case 0x0A:
+            if (!s.waiting) {
+                s.pressed = NO_PRESS;
+                s.released = NO_RELEASE;
+            }
+            s.waiting = true;
+            if (s.pressed == NO_PRESS || s.released == NO_RELEASE || !(s.pressed & (1 << s.released))) {
+                PC[lane] -= 2;
+            } else {
+                vx = s.released;
+                s.pressed = NO_PRESS;
+                s.released = NO_RELEASE;
+                s.waiting = false;
+            }
+            break;
+
+        case 0x15:
+            delay[lane] = vx;
+            break;
+
+        case 0x18:
+            sound[lane] = vx;
+            break;
+
+        case 0x1E:
+            I[lane] += vx;
+            break;
+
+        // FX29 / FX30 small / big font digit
+        case 0x29:
+            I[lane] = 0x050 + 5 * (vx & 0xF);
+            break;
+
+        case 0x30:
+            I[lane] = 0x0A0 + 10 * (vx & 0xF);
+            break;
+
+        // FX33 BCD
+        case 0x33: {
+            int num = vx;
+            for (int offset = 2; offset >= 0; offset--) {
+                write(lane, I[lane] + offset, num % 10);
+                num /= 10;
+            }
+            break;
+        }
+
+        // FX3A pitch
+        case 0x3A:
+            s.playback_rate = 4000 * pow(2, (vx - 64) / 48.0);
+            break;
+
+        // FX55 / FX65 store / load V0..VX at I
+        case 0x55:
+        case 0x65: {
+            uint16_t addr = I[lane];
+            uint16_t* addr_ptr = config.quirks.memory_leave_I_unchanged ? &addr : &I[lane];
+            bool store = (instruction & 0xFF) == 0x55;
+            for (uint8_t reg = 0; reg <= x_reg; reg++) {
+                if (store) {
+                    write(lane, *addr_ptr, V[reg][lane]);
+                } else {
+                    V[reg][lane] = read_memory(lane, *addr_ptr);
+                }
+                *addr_ptr += 1;
+            }
+            if (config.quirks.memory_increment_by_X) {
+                *addr_ptr -= 1;
+            }
+            break;
+        }
+
+        // FX75 / FX85 store / load flags
+        case 0x75:
+            for (uint8_t i = 0; i <= x_reg; i++) {
+                s.flags[i] = V[i][lane];
+            }
+            break;
+
+        case 0x85:
+            for (uint8_t i = 0; i <= x_reg; i++) {
+                V[i][lane] = s.flags[i];
+            }
+            break;
+
+        default:
+            s.stats.invalid_opcodes += 1;
+    }
+}
+
+// DXYN on every selected plane, same as the CPU's decode + display
+void LockstepEngine::draw(size_t lane, uint8_t x_reg, uint8_t y_reg, uint8_t height) {
+    Lane& s = *cold[lane];
+    uint8_t width = 8;
+    V[0xF][lane] = 0;
+    if (height == 0) {
+        if (config.quirks.draw_zero) {
+            if (config.quirks.vblank) drawn |= 1ull << lane;
+            return;
+        }
+        if (!(s.lores && config.quirks.lores_8x16)) {
+            width = 16;
+        }
+        height = 16;
+    }
+
+    uint16_t mem_index = I[lane];
+    int sprite_bytes = height * (width == 16 ? 2 : 1);
+    std::array<uint8_t, 32> sprite;
+    for (int i = 0; i < 4; i++) {
+        uint8_t plane = s.bit_plane & (1 << i);
+        if (!plane) continue;
+        for (int b = 0; b < sprite_bytes; b++) {
+            sprite[b] = read_memory(lane, mem_index + b);
+        }
+        draw_sprite(s.screen.data(), sprite.data(), plane, V[x_reg][lane], V[y_reg][lane], width, height, s.lores,
+                    config.quirks, V[0xF][lane]);
+        if (s.lores && config.quirks.vblank) {
+            drawn |= 1ull << lane;
+        }
+        mem_index += sprite_bytes;
+    }
+}
@@ -0,0 +1,193 @@
+#include <log/log.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+static const char* level_names[LOG_OFF + 1] = {"debug", "info", "warn", "error", "off"};
+
+static int initial_level() {
+    const char* env = std::getenv("NACHO_LOG");
+    if (env) {
+        for (int l = LOG_DEBUG; l <= LOG_OFF; l++) {
+            if (std::strcmp(env, level_names[l]) == 0) return l;
+        }
+    }
+    return LOG_INFO;
+}
+
+std::atomic<int> logging::level{initial_level()};
+
+/*-----------------[Sites]-----------------*/
+
+static std::atomic<LogSite*> sites{nullptr};
+
+LogSite::LogSite(const char* file, int line, int level) : file(file), line(line), level(level) {
+    next = sites.load(std::memory_order_relaxed);
+    while (!sites.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+/*-----------------[Queue]-----------------*/
+
+// Bounded multi producer queue (Vyukov): each slot's sequence says whether it is free for the producer
+// at that position or full for the consumer. Plain static storage, so late messages during shutdown
+// still have somewhere to go.
+struct LogRecord {
+    std::atomic<uint64_t> sequence;
+    const LogSite* site;
+    uint32_t skipped;
+    char text[LOG_MESSAGE_SIZE];
+};
+
+static LogRecord queue[LOG_QUEUE_SIZE];
+static std::atomic<uint64_t> tail{0};
+static uint64_t head = 0;  // consumer only
+static std::atomic<uint64_t> written{0};
+static std::atomic<uint64_t> dropped_messages{0};
+
+static bool init_queue() {
+    for (uint64_t i = 0; i < LOG_QUEUE_SIZE; i++) queue[i].sequence.store(i, std::memory_order_relaxed);
+    return true;
+}
+
+static LogRecord* claim() {
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+        LogRecord& slot = queue[pos % LOG_QUEUE_SIZE];
+        int64_t diff = (int64_t)slot.sequence.load(std::memory_order_acquire) - (int64_t)pos;
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return &slot;
+        } else if (diff < 0) {
+            return nullptr;  // full
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+static void publish(LogRecord* slot) {
+    uint64_t pos = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+static bool drain_one() {
+    LogRecord& slot = queue[head % LOG_QUEUE_SIZE];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1) return false;
+
+    const char* file = slot.site->file;
+    for (const char* c = file; *c; c++) {
+        if (*c == '/' || *c == '\\') file = c + 1;
+    }
+    std::cerr << "[" << level_names[slot.site->level] << "] " << file << ":" << slot.site->line << " " << slot.text;
+    if (slot.skipped) std::cerr << " (" << slot.skipped << " similar suppressed)";
+    std::cerr << "\n";
+
+    slot.sequence.store(head + LOG_QUEUE_SIZE, std::memory_order_release);
+    head += 1;
+    written.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+// background writer, started by the first message
+class Drainer {
+   public:
+    Drainer() : worker(&Drainer::loop, this) {}
+    ~Drainer() {
+        stop = true;
+        worker.join();
+        while (drain_one()) {
+        }
+        std::cerr.flush();
+    }
+
+   private:
+    std::atomic<bool> stop{false};
+    std::thread worker;
+
+    void loop() {
+        while (!stop) {
+            bool any = false;
+            while (drain_one()) any = true;
+            if (any) std::cerr.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+};
+
+static void start_drainer() {
+    static bool ready = init_queue();
+    static Drainer drainer;
+    (void)ready;
+}
+
+/*-----------------[Logging]-----------------*/
+
+void logging::write(LogSite& site, const char* format, ...) {
+    start_drainer();
+    site.count.fetch_add(1, std::memory_order_relaxed);
+
+    // at most LOG_SITE_RATE messages per site per second; the rest are counted and reported with the
+    // next message that gets through
+    int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+    int64_t window = site.window.load(std::memory_order_relaxed);
+    if (window != second && site.window.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        site.in_window.store(0, std::memory_order_relaxed);
+    }
+    if (site.in_window.fetch_add(1, std::memory_order_relaxed) >= LOG_SITE_RATE) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        site.pending.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogRecord* slot = claim();
+    if (!slot) {
+        dropped_messages.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    slot->site = &site;
+    slot->skipped = site.pending.exchange(0, std::memory_order_relaxed);
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(slot->text, sizeof(slot->text), format, args);
+    va_end(args);
+    publish(slot);
+}
+
+bool logging::set_level(std::string name) {
+    for (int l = LOG_DEBUG; l <= LOG_OFF; l++) {
+        if (name == level_names[l]) {
+            level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+void logging::flush() {
+    uint64_t target = tail.load(std::memory_order_acquire);
+    if (target == 0) return;
+    start_drainer();
+    // dropped messages never claimed a slot, so everything up to the tail gets written
+    while (written.load(std::memory_order_acquire) < target) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+uint64_t logging::dropped() {
+    return dropped_messages.load(std::memory_order_relaxed);
+}
+
+std::vector<LogCounter> logging::counters() {
+    std::vector<LogCounter> list;
+    for (LogSite* site = sites.load(std::memory_order_acquire); site; site = site->next) {
+        list.push_back({site->file, site->line, site->level, site->count.load(), site->suppressed.load()});
+    }
+    return list;
+}
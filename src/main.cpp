@@ -1,44 +1,62 @@
 #include <cpu/cpu.h>
 #include <display/display.h>
+#include <embedded/intro_rom.h>
+#include <shm/shared_state.h>
 
 #include <stdexcept>
 #include <thread>
 
-#define INTRO_SCREEN "happy.ch8"
 #define BENCHMARK_PROG "1dcell.ch8"
 
 
 int main(int argc, char* argv[]) {
     CPU cpu;
-    Display display(cpu);
-    
+
     bool bench = false;
     if (argc > 1 && std::string(argv[1]) == "--benchmark") {
         bench = true;
     }
-    
-    std::string program = bench ? BENCHMARK_PROG : INTRO_SCREEN;
-    if (cpu.loadProgram("games/" + program) < 0) {
-        throw std::runtime_error("Bootup program failed to load");
-    } else {
+
+    if (bench) {
+        // benchmark runs headless on this thread; no window or audio device needed
+        std::string program = argc > 2 ? argv[2] : "games/" + std::string(BENCHMARK_PROG);
+        if (cpu.loadProgram(program) < 0) {
+            throw std::runtime_error("Benchmark program failed to load");
+        }
         cpu.resume();
+        cpu.benchmark();
+        return 0;
     }
-     
-    if (bench) {
-        //start benchmark loop
-        std::thread benchmark(&CPU::benchmark, &cpu);
-        benchmark.detach();
+
+    Display display(cpu);
+
+    // --metrics FILE or --metrics unix:PATH publishes live metrics in Prometheus text format
+    // --shm NAME publishes every frame to shared memory and takes keypad input from it
+    SharedState shared;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--metrics") display.export_metrics(argv[i + 1]);
+        if (std::string(argv[i]) == "--shm" && shared.open(argv[i + 1])) cpu.set_shared_state(&shared);
+    }
+
+    // games/happy.ch8, compiled in
+    if (cpu.load_program_data(intro_rom, intro_rom_size) < 0) {
+        throw std::runtime_error("Bootup program failed to load");
     } else {
-        // create new thread to run emulation loop
-        std::thread emulate(&CPU::emulate_loop, &cpu);
-        emulate.detach();
+        cpu.resume();
     }
 
+    // create new thread to run emulation loop
+    std::thread emulate(&CPU::emulate_loop, &cpu);
+
     // render screen on main thread
     display.render_loop();
 
-    // if we stop we stop rendering screen
-    // cpu.terminate();
+    // if we stop rendering we stop emulating; wait for the emulation thread so it is not inside a hook
+    // (metrics, audio, shared memory) when the display and the shared state go away
+    // the exit key and menu already stopped it; closing the window did not
+    if (!cpu.check_stop()) cpu.terminate();
+    emulate.join();
     display.terminate();
+    cpu.set_shared_state(nullptr);
     return 0;
 }
@@ -0,0 +1,257 @@
+#include <perf/metrics.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const double bounds[HISTOGRAM_BUCKETS] = HISTOGRAM_BOUNDS;
+
+/*-----------------[Histogram]-----------------*/
+
+void Histogram::observe(double ms) {
+    int bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS && ms > bounds[bucket]) bucket++;
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum_us.fetch_add((uint64_t)(ms * 1000), std::memory_order_relaxed);
+}
+
+uint64_t Histogram::count() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+double Histogram::sum() const {
+    return sum_us.load(std::memory_order_relaxed) / 1000.0;
+}
+
+double Histogram::quantile(double q) const {
+    std::array<uint64_t, HISTOGRAM_BUCKETS + 1> snapshot = counts();
+    uint64_t all = 0;
+    for (uint64_t c : snapshot) all += c;
+    if (all == 0) return 0;
+
+    uint64_t rank = (uint64_t)(q * (all - 1)) + 1, seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += snapshot[b];
+        if (seen >= rank) return bounds[b];
+    }
+    return bounds[HISTOGRAM_BUCKETS - 1];
+}
+
+std::array<uint64_t, HISTOGRAM_BUCKETS + 1> Histogram::counts() const {
+    std::array<uint64_t, HISTOGRAM_BUCKETS + 1> snapshot;
+    for (int b = 0; b <= HISTOGRAM_BUCKETS; b++) snapshot[b] = buckets[b].load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+double Histogram::bound(int bucket) {
+    return bounds[bucket];
+}
+
+/*-----------------[Recording]-----------------*/
+
+void RuntimeMetrics::emulation_frame(double work_ms, double interval_ms, double oversleep_ms, uint64_t executed,
+                                     int frame_speed, uint64_t allocations) {
+    emulation_work.observe(work_ms);
+    if (interval_ms > 0) emulation_interval.observe(interval_ms);
+    oversleep.observe(oversleep_ms);
+    frames.fetch_add(1, std::memory_order_relaxed);
+    instructions.fetch_add(executed, std::memory_order_relaxed);
+    frame_instructions = executed;
+    speed = frame_speed;
+    emulation_allocations = allocations;
+    emulation_allocations_total.fetch_add(allocations, std::memory_order_relaxed);
+
+    // MIPS over whole seconds so one slow frame doesn't make the number jump
+    auto now = std::chrono::steady_clock::now();
+    if (window_start == std::chrono::steady_clock::time_point{}) window_start = now;
+    window_instructions += executed;
+    double seconds = std::chrono::duration<double>(now - window_start).count();
+    if (seconds >= 1.0) {
+        mips = window_instructions / seconds / 1e6;
+        window_start = now;
+        window_instructions = 0;
+    }
+}
+
+void RuntimeMetrics::lock_waits(const ContendedMutex& screen, const ContendedMutex& keys) {
+    screen_waits = screen.contended();
+    screen_wait_seconds = screen.wait_seconds();
+    key_waits = keys.contended();
+    key_wait_seconds = keys.wait_seconds();
+}
+
+void RuntimeMetrics::render_frame(double work_ms, double interval_ms, double gpu_ms, uint64_t allocations) {
+    render_work.observe(work_ms);
+    if (interval_ms > 0) render_interval.observe(interval_ms);
+    if (gpu_ms >= 0) gpu_time.observe(gpu_ms);
+    render_allocations = allocations;
+    render_allocations_total.fetch_add(allocations, std::memory_order_relaxed);
+}
+
+void RuntimeMetrics::audio_fill(uint32_t samples, uint32_t capacity) {
+    audio_samples = samples;
+    audio_capacity = capacity;
+}
+
+void RuntimeMetrics::audio_underrun() {
+    audio_underruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*-----------------[Prometheus]-----------------*/
+
+static void write_metric(std::ostream& out, const char* name, const char* type, const char* help, double value) {
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n" << name << " " << value
+        << "\n";
+}
+
+// histograms are recorded in milliseconds and exported in seconds, as Prometheus expects
+static void write_histogram(std::ostream& out, const char* name, const char* help, const Histogram& histogram) {
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+    std::array<uint64_t, HISTOGRAM_BUCKETS + 1> counts = histogram.counts();
+    uint64_t cumulative = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        cumulative += counts[b];
+        out << name << "_bucket{le=\"" << Histogram::bound(b) / 1000 << "\"} " << cumulative << "\n";
+    }
+    cumulative += counts[HISTOGRAM_BUCKETS];
+    out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    out << name << "_sum " << histogram.sum() / 1000 << "\n";
+    out << name << "_count " << cumulative << "\n";
+}
+
+std::string RuntimeMetrics::to_prometheus() const {
+    std::ostringstream out;
+    // counters reach billions; the default six digits would round them
+    out.precision(15);
+    write_metric(out, "nacho_frames_total", "counter", "Emulated frames run by the paced loop.", frames);
+    write_metric(out, "nacho_instructions_total", "counter", "Emulated instructions executed.", instructions);
+    write_metric(out, "nacho_mips", "gauge", "Emulated million instructions per second over the last second.",
+                 mips);
+    write_metric(out, "nacho_frame_instructions", "gauge", "Instructions executed in the last frame.",
+                 frame_instructions);
+    write_metric(out, "nacho_speed", "gauge", "Configured instructions per frame.", speed);
+    write_histogram(out, "nacho_emulation_frame_seconds", "Time spent running each emulated frame.",
+                    emulation_work);
+    write_histogram(out, "nacho_emulation_interval_seconds", "Time between the starts of emulated frames.",
+                    emulation_interval);
+    write_histogram(out, "nacho_pacing_oversleep_seconds", "How much later than asked the pacing sleep returned.",
+                    oversleep);
+    write_histogram(out, "nacho_render_frame_seconds", "CPU time of each render loop iteration before swap.",
+                    render_work);
+    write_histogram(out, "nacho_render_interval_seconds", "Time between presented frames.", render_interval);
+    write_histogram(out, "nacho_gpu_frame_seconds", "GPU time per frame from GL_TIME_ELAPSED queries.", gpu_time);
+    write_metric(out, "nacho_screen_lock_waits_total", "counter", "Contended acquisitions of the screen mutex.",
+                 screen_waits);
+    write_metric(out, "nacho_screen_lock_wait_seconds_total", "counter", "Time spent waiting on the screen mutex.",
+                 screen_wait_seconds);
+    write_metric(out, "nacho_key_lock_waits_total", "counter", "Contended acquisitions of the key mutex.", key_waits);
+    write_metric(out, "nacho_key_lock_wait_seconds_total", "counter", "Time spent waiting on the key mutex.",
+                 key_wait_seconds);
+    write_metric(out, "nacho_emulation_allocations_total", "counter",
+                 "Heap allocations made by the emulation thread while running frames (NACHO_COUNT_ALLOCS builds).",
+                 emulation_allocations_total);
+    write_metric(out, "nacho_render_allocations_total", "counter",
+                 "Heap allocations made by the render loop (NACHO_COUNT_ALLOCS builds).", render_allocations_total);
+    write_metric(out, "nacho_audio_ring_samples", "gauge", "Samples queued in the audio ring buffer.",
+                 audio_samples);
+    write_metric(out, "nacho_audio_ring_capacity", "gauge", "Capacity of the audio ring buffer in samples.",
+                 audio_capacity);
+    write_metric(out, "nacho_audio_underruns_total", "counter", "Device callbacks that ran out of queued samples.",
+                 audio_underruns);
+    return out.str();
+}
+
+/*-----------------[Exporter]-----------------*/
+
+MetricsExporter::MetricsExporter(const RuntimeMetrics& metrics, std::string target, int interval_ms)
+    : metrics(metrics), target(target), interval_ms(interval_ms) {
+    if (target.rfind("unix:", 0) == 0) {
+        worker = std::thread(&MetricsExporter::serve_socket_loop, this, target.substr(5));
+    } else {
+        worker = std::thread(&MetricsExporter::write_file_loop, this);
+    }
+}
+
+MetricsExporter::~MetricsExporter() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+// write next to the target and rename over it so scrapers never read half a file
+void MetricsExporter::write_file_loop() {
+    std::string temp = target + ".tmp";
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stop) {
+        lock.unlock();
+        {
+            std::ofstream file(temp);
+            file << metrics.to_prometheus();
+        }
+        if (std::rename(temp.c_str(), target.c_str()) != 0) {
+            std::cerr << "Could not write metrics to " << target << std::endl;
+        }
+        lock.lock();
+        wake.wait_for(lock, std::chrono::milliseconds(interval_ms), [this] { return stop; });
+    }
+}
+
+void MetricsExporter::serve_socket_loop(std::string path) {
+#ifndef _WIN32
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (server < 0 || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Could not open metrics socket " << path << std::endl;
+        if (server >= 0) close(server);
+        return;
+    }
+    path.copy(addr.sun_path, path.size());
+    unlink(path.c_str());
+    if (bind(server, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(server, 4) != 0) {
+        std::cerr << "Could not listen on metrics socket " << path << std::endl;
+        close(server);
+        return;
+    }
+
+    // poll with a timeout so the destructor never waits long for the thread
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (stop) break;
+        }
+        pollfd ready{server, POLLIN, 0};
+        if (poll(&ready, 1, 200) <= 0) continue;
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) continue;
+        std::string text = metrics.to_prometheus();
+        size_t sent = 0;
+        while (sent < text.size()) {
+            ssize_t n = send(client, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        close(client);
+    }
+    close(server);
+    unlink(path.c_str());
+#else
+    std::cerr << "Unix socket metrics are not supported on this platform: " << path << std::endl;
+#endif
+}
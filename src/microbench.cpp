@@ -0,0 +1,341 @@
+#include <bench/bench.h>
+#include <cpu/cpu.h>
+#include <perf/perf_counters.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <json.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+// instructions executed per frame; high enough that frame overhead (timers, flags) disappears
+#define MICRO_SPEED 50000
+// code lives in 0x200-0x3EF, a return for call benchmarks at 0x3FE and sprite data from 0x400
+#define CODE_END 0x3F0
+#define RETURN_ADDR 0x3FE
+#define DATA_ADDR 0x400
+
+struct MicroCase {
+    // the case table leaves the trailing fields out, so they get defaults here rather than in the braces
+    MicroCase(std::string group, std::string name, std::vector<uint16_t> setup, std::vector<uint16_t> body,
+              int weight = 0, std::function<void(CPU::Config&)> configure = nullptr, bool frontend = false)
+        : group(std::move(group)), name(std::move(name)), setup(std::move(setup)), body(std::move(body)),
+          weight(weight), configure(std::move(configure)), frontend(frontend) {}
+
+    std::string group;
+    std::string name;
+    std::vector<uint16_t> setup;  // runs once
+    std::vector<uint16_t> body;   // repeated as often as fits, then jumped back to
+    int weight = 0;               // instructions one body executes, when it differs from body.size()
+    std::function<void(CPU::Config&)> configure;
+    bool frontend = false;  // run with a second thread polling the CPU like the render and input threads
+};
+
+struct MicroResult {
+    std::string group;
+    std::string name;
+    BenchSummary ns;
+    // host cache misses per op on the emulating thread, -1 without hardware counters
+    double l1d_misses = -1;
+    double llc_misses = -1;
+};
+
+void usage() {
+    std::cerr << "usage: nacho-microbench [options]\n"
+                 "  --filter TEXT       only run cases whose group or name contains TEXT\n"
+                 "  --runs N            measured runs per case (default 5)\n"
+                 "  --min-time SEC      minimum time per run (default 0.05)\n"
+                 "  --json FILE         write ns/op per case as json"
+              << std::endl;
+}
+
+// how many copies of the body fit between the setup and the jump back
+size_t body_repeats(const MicroCase& c) {
+    if (c.body.empty()) return 0;
+    size_t words = c.setup.size() + 1;
+    size_t repeats = 0;
+    while (0x200 + 2 * (words + c.body.size()) <= CODE_END) {
+        words += c.body.size();
+        repeats += 1;
+    }
+    return repeats;
+}
+
+// setup, then the body repeated until the code area is full, then a jump back to the first body
+std::vector<uint8_t> build_program(const MicroCase& c) {
+    std::vector<uint16_t> words = c.setup;
+    uint16_t loop = 0x200 + 2 * words.size();
+    for (size_t i = 0; i < body_repeats(c); i++) {
+        words.insert(words.end(), c.body.begin(), c.body.end());
+    }
+    words.push_back(0x1000 | loop);
+
+    std::vector<uint8_t> program(DATA_ADDR + 128 - 0x200, 0);
+    for (size_t i = 0; i < words.size(); i++) {
+        program[2 * i] = words[i] >> 8;
+        program[2 * i + 1] = words[i] & 0xFF;
+    }
+    program[RETURN_ADDR - 0x200] = 0x00;
+    program[RETURN_ADDR - 0x200 + 1] = 0xEE;
+    // sprite rows for up to four planes of 16x16
+    for (int i = 0; i < 128; i++) {
+        program[DATA_ADDR - 0x200 + i] = i % 2 ? 0xA5 : 0xFF;
+    }
+    return program;
+}
+
+// Stands in for the frontend threads: polls the flags and copies the screen like Display::render_loop and
+// presses and releases key F like the key callback, as fast as it can so every shared line it touches
+// keeps moving between cores
+void poll_frontend(CPU& cpu, std::atomic<bool>& done) {
+    while (!done.load(std::memory_order_relaxed)) {
+        cpu.check_stop();
+        cpu.check_color();
+        cpu.is_paused();
+        if (cpu.check_screen()) cpu.get_screen();
+        cpu.press_key(0xF);
+        cpu.release_key(0xF);
+    }
+}
+
+// ns per body execution; the jump back is spread over the repeated bodies
+MicroResult run_program(const MicroCase& c, unsigned runs, double min_time) {
+    CPU::Config config;
+    config.speed = MICRO_SPEED;
+    config.quirks.vblank = false;
+    if (c.configure) c.configure(config);
+
+    std::vector<uint8_t> program = build_program(c);
+    size_t repeats = body_repeats(c);
+    size_t weight = c.weight ? c.weight : c.body.size();
+    // instructions per pass around the loop and body executions per pass (the jump itself when empty)
+    double pass_instructions = repeats * weight + 1;
+    double pass_bodies = repeats ? repeats : 1;
+
+    std::vector<double> samples;
+    PerfCounters counters;
+    PerfCounters::Values misses{};
+    double measured_bodies = 0;
+    CPU cpu;
+    for (unsigned r = 0; r <= runs; r++) {
+        cpu.set_config(config);
+        cpu.load_program_data(program.data(), program.size());
+        cpu.resume();
+        cpu.run_frame();  // setup and warm caches
+        cpu.reset_stats();
+
+        std::atomic<bool> done = false;
+        std::thread frontend;
+        if (c.frontend) frontend = std::thread(poll_frontend, std::ref(cpu), std::ref(done));
+
+        double seconds = 0;
+        PerfCounters::Values before = counters.read();
+        auto start = std::chrono::steady_clock::now();
+        while (seconds < min_time) {
+            cpu.run_frame();
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        PerfCounters::Values after = counters.read();
+
+        done = true;
+        if (frontend.joinable()) frontend.join();
+        if (r == 0) continue;  // warmup run
+
+        double bodies = cpu.get_stats().instructions / pass_instructions * pass_bodies;
+        samples.push_back(seconds * 1e9 / bodies);
+        for (int e = 0; e < PERF_EVENTS; e++) misses[e] += after[e] - before[e];
+        measured_bodies += bodies;
+    }
+
+    MicroResult result{c.group, c.name, summarize(samples)};
+    if (counters.available() && measured_bodies > 0) {
+        result.l1d_misses = misses[PerfCounters::L1D_MISSES] / measured_bodies;
+        result.llc_misses = misses[PerfCounters::LLC_MISSES] / measured_bodies;
+    }
+    return result;
+}
+
+// time a host call directly
+BenchSummary run_call(std::function<void()> call, unsigned runs, double min_time) {
+    std::vector<double> samples;
+    for (unsigned r = 0; r <= runs; r++) {
+        uint64_t calls = 0;
+        double seconds = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (seconds < min_time) {
+            for (int i = 0; i < 64; i++) call();
+            calls += 64;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (r > 0) samples.push_back(seconds * 1e9 / calls);
+    }
+    return summarize(samples);
+}
+
+std::vector<MicroCase> build_cases() {
+    auto quirks = [](std::function<void(CPU::Quirks&)> set) {
+        return [set](CPU::Config& config) { set(config.quirks); };
+    };
+    auto wrap = quirks([](CPU::Quirks& q) { q.wrap = true; });
+    auto xochip = [](CPU::Config& config) {
+        config.system = XO_CHIP;
+        config.quirks.wrap = true;
+    };
+
+    // V0/V1 at the centre or across the bottom right corner of a 64x32 (lores) or 128x64 (hires) screen
+    const std::vector<uint16_t> lores_centre{0xA000 | DATA_ADDR, 0x6010, 0x6108};
+    const std::vector<uint16_t> lores_edge{0xA000 | DATA_ADDR, 0x603C, 0x611C};
+    const std::vector<uint16_t> hires_centre{0x00FF, 0xA000 | DATA_ADDR, 0x6030, 0x6118};
+    const std::vector<uint16_t> hires_edge{0x00FF, 0xA000 | DATA_ADDR, 0x607C, 0x613C};
+    const std::vector<uint16_t> planes{0x00FF, 0xF301, 0xA000 | DATA_ADDR, 0x6030, 0x6118};
+
+    std::vector<MicroCase> cases{
+        // decode dispatch per opcode class
+        {"decode", "1NNN jump", {}, {}},
+        {"decode", "2NNN+00EE call/return", {}, {0x2000 | RETURN_ADDR}, 2},
+        {"decode", "3XNN not taken", {}, {0x3001}},
+        {"decode", "4XNN taken", {}, {0x4001, 0x6000}, 1},
+        {"decode", "6XNN", {}, {0x6A12}},
+        {"decode", "7XNN", {}, {0x7A01}},
+        {"decode", "8XY1 or", {}, {0x8AB1}},
+        {"decode", "8XY4 add", {}, {0x8AB4}},
+        {"decode", "8XY5 sub", {}, {0x8AB5}},
+        {"decode", "8XY6 shift", {}, {0x8AB6}},
+        {"decode", "ANNN", {}, {0xA400}},
+        {"decode", "CXNN random", {}, {0xCAFF}},
+        {"decode", "EX9E key", {}, {0xE09E}},
+        {"decode", "FX07 delay", {}, {0xFA07}},
+        {"decode", "FX1E add index", {}, {0xFA1E}},
+        {"decode", "FX29 font", {}, {0xFA29}},
+        {"decode", "FX33 BCD", {0xA400}, {0xFA33}},
+
+        // FX55/FX65 for V0-VF with each memory quirk
+        {"memory", "FX55 modern (I unchanged)", {0xA400}, {0xFF55}, 0,
+         quirks([](CPU::Quirks& q) { q.memory_leave_I_unchanged = true; })},
+        {"memory", "FX65 modern (I unchanged)", {0xA400}, {0xFF65}, 0,
+         quirks([](CPU::Quirks& q) { q.memory_leave_I_unchanged = true; })},
+        {"memory", "ANNN+FX55 classic (I += X+1)", {}, {0xA400, 0xFF55}},
+        {"memory", "ANNN+FX65 classic (I += X+1)", {}, {0xA400, 0xFF65}},
+        {"memory", "ANNN+FX55 schip1.1 (I += X)", {}, {0xA400, 0xFF55}, 0,
+         quirks([](CPU::Quirks& q) { q.memory_increment_by_X = true; })},
+        {"memory", "ANNN+FX65 schip1.1 (I += X)", {}, {0xA400, 0xFF65}, 0,
+         quirks([](CPU::Quirks& q) { q.memory_increment_by_X = true; })},
+
+        // sprites
+        {"display", "8x15 lores", lores_centre, {0xD01F}},
+        {"display", "8x15 lores edge clip", lores_edge, {0xD01F}},
+        {"display", "8x15 lores edge wrap", lores_edge, {0xD01F}, 0, wrap},
+        {"display", "16x16 lores", lores_centre, {0xD010}},
+        {"display", "8x15 hires", hires_centre, {0xD01F}},
+        {"display", "8x15 hires edge clip", hires_edge, {0xD01F}},
+        {"display", "8x15 hires edge wrap", hires_edge, {0xD01F}, 0, wrap},
+        {"display", "16x16 hires", hires_centre, {0xD010}},
+        {"display", "16x16 hires edge clip", hires_edge, {0xD010}},
+        {"display", "16x16 hires edge wrap", hires_edge, {0xD010}, 0, wrap},
+        {"display", "16x16 hires two planes", planes, {0xD010}, 0, xochip},
+        {"display", "8x15 hires collisions counted", hires_centre, {0xD01F}, 0,
+         quirks([](CPU::Quirks& q) { q.set_collisions = true; })},
+
+        // whole screen ops, hires so every pixel is touched
+        {"screen", "00E0 clear", {0x00FF}, {0x00E0}},
+        {"screen", "00C4 scroll down", {0x00FF}, {0x00C4}},
+        {"screen", "00D4 scroll up", {0x00FF}, {0x00D4}},
+        {"screen", "00FB scroll right", {0x00FF}, {0x00FB}},
+        {"screen", "00FC scroll left", {0x00FF}, {0x00FC}},
+        {"screen", "00C4 scroll down lores", {}, {0x00C4}},
+
+        // the same loops alone and while another thread polls the CPU the way the frontend does; the
+        // difference is what sharing cache lines with the render and input threads costs. EX9E reads the
+        // key mailbox the other thread writes (V0 is 0, key F toggles, so it never skips)
+        {"shared", "7XNN alone", {}, {0x7A01}},
+        {"shared", "7XNN with frontend", {}, {0x7A01}, 0, nullptr, true},
+        {"shared", "DXYN+EX9E alone", hires_centre, {0xD01F, 0xE09E}},
+        {"shared", "DXYN+EX9E with frontend", hires_centre, {0xD01F, 0xE09E}, 0, nullptr, true},
+    };
+    return cases;
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter, json_file;
+    unsigned runs = 5;
+    double min_time = 0.05;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--filter") {
+            filter = argv[++i];
+        } else if (arg == "--runs") {
+            runs = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--min-time") {
+            min_time = std::stod(argv[++i]);
+        } else if (arg == "--json") {
+            json_file = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    auto selected = [&filter](const std::string& group, const std::string& name) {
+        return filter.empty() || group.find(filter) != std::string::npos || name.find(filter) != std::string::npos;
+    };
+
+    std::vector<MicroResult> results;
+    for (const MicroCase& c : build_cases()) {
+        if (!selected(c.group, c.name)) continue;
+        results.push_back(run_program(c, runs, min_time));
+    }
+
+    // host side calls the frontend makes every frame
+    CPU cpu;
+    if (selected("host", "gen_frame_samples")) {
+        std::array<uint8_t, SAMPLE_SIZE> samples;
+        results.push_back({"host", "gen_frame_samples",
+                           run_call([&cpu, &samples] { cpu.gen_frame_samples(samples.data()); }, runs, min_time)});
+    }
+    if (selected("host", "get_screen")) {
+        results.push_back({"host", "get_screen", run_call([&cpu] { cpu.get_screen(); }, runs, min_time)});
+    }
+
+    std::cout << std::left << std::setw(10) << "group" << std::setw(36) << "case" << std::right << std::setw(12)
+              << "ns/op" << std::setw(10) << "p10" << std::setw(10) << "p90" << std::setw(10) << "L1D/op" << std::setw(10)
+              << "LLC/op" << std::endl;
+    json out = json::array();
+    for (const MicroResult& r : results) {
+        std::cout << std::left << std::setw(10) << r.group << std::setw(36) << r.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << r.ns.median << std::setw(10) << r.ns.p10 << std::setw(10)
+                  << r.ns.p90;
+        if (r.l1d_misses >= 0) {
+            std::cout << std::setprecision(3) << std::setw(10) << r.l1d_misses << std::setw(10) << r.llc_misses;
+        } else {
+            std::cout << std::setw(10) << "-" << std::setw(10) << "-";
+        }
+        std::cout << std::endl;
+        json entry = {{"group", r.group}, {"name", r.name}, {"ns_per_op", r.ns.median}, {"p10", r.ns.p10},
+                      {"p90", r.ns.p90}, {"stddev", r.ns.stddev}};
+        if (r.l1d_misses >= 0) {
+            entry["l1d_misses_per_op"] = r.l1d_misses;
+            entry["llc_misses_per_op"] = r.llc_misses;
+        }
+        out.push_back(entry);
+    }
+
+    if (!json_file.empty()) {
+        std::ofstream file(json_file);
+        if (!file.is_open()) {
+            std::cerr << "Could not write " << json_file << std::endl;
+            return 1;
+        }
+        file << out.dump(2) << std::endl;
+    }
+    return 0;
+}
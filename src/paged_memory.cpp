@@ -0,0 +1,80 @@
+#include <cpu/paged_memory.h>
+
+#include <algorithm>
+#include <cstring>
+
+PagedMemory::PagedMemory() {
+    clear();
+}
+
+PagedMemory::PagedMemory(const PagedMemory& other) : pages(other.pages), data(other.data) {}
+
+PagedMemory& PagedMemory::operator=(const PagedMemory& other) {
+    if (this == &other) return *this;
+    for (size_t page = 0; page < PAGE_COUNT; page++) {
+        if (pages[page] != other.pages[page] && pages[page].use_count() == 1 && spare.size() < spare.capacity()) {
+            spare.push_back(std::move(pages[page]));
+        }
+        pages[page] = other.pages[page];
+    }
+    data = other.data;
+    return *this;
+}
+
+void PagedMemory::reserve(size_t count) {
+    spare.reserve(count);
+    while (spare.size() < count) spare.push_back(std::make_shared<Page>());
+}
+
+void PagedMemory::clear() {
+    // every untouched page of every instance points here
+    static const std::shared_ptr<Page> zero = std::make_shared<Page>();
+    pages.fill(zero);
+    data.fill(zero->bytes.data());
+}
+
+void PagedMemory::copy_in(uint16_t addr, const uint8_t* src, size_t size) {
+    size_t pos = addr;
+    size_t end = std::min<size_t>(pos + size, 0x10000);
+    while (pos < end) {
+        size_t page = pos >> PAGE_BITS;
+        size_t offset = pos & (PAGE_SIZE - 1);
+        size_t count = std::min(end - pos, PAGE_SIZE - offset);
+        if (std::memcmp(data[page] + offset, src, count) != 0) {
+            if (pages[page].use_count() != 1) own(page);
+            std::memcpy(data[page] + offset, src, count);
+        }
+        src += count;
+        pos += count;
+    }
+}
+
+void PagedMemory::copy_out(uint16_t addr, uint8_t* dst, size_t size) const {
+    size_t pos = addr;
+    size_t end = std::min<size_t>(pos + size, 0x10000);
+    while (pos < end) {
+        size_t page = pos >> PAGE_BITS;
+        size_t offset = pos & (PAGE_SIZE - 1);
+        size_t count = std::min(end - pos, PAGE_SIZE - offset);
+        std::memcpy(dst, data[page] + offset, count);
+        dst += count;
+        pos += count;
+    }
+}
+
+size_t PagedMemory::private_pages() const {
+    return std::count_if(pages.begin(), pages.end(), [](const std::shared_ptr<Page>& p) { return p.use_count() == 1; });
+}
+
+// replace a shared page with a private copy before the first write, from the spares when there are any
+void PagedMemory::own(size_t page) {
+    if (spare.empty()) {
+        pages[page] = std::make_shared<Page>(*pages[page]);
+    } else {
+        std::shared_ptr<Page> copy = std::move(spare.back());
+        spare.pop_back();
+        copy->bytes = pages[page]->bytes;
+        pages[page] = std::move(copy);
+    }
+    data[page] = pages[page]->bytes.data();
+}
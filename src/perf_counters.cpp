@@ -0,0 +1,165 @@
+#include <perf/perf_counters.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+static const char* event_names[PERF_EVENTS] = {"cycles", "instructions", "branch_misses", "l1d_misses",
+                                               "llc_misses"};
+static const char* phase_names[PERF_PHASES] = {"execute", "draw", "scroll", "audio", "handoff"};
+
+/*-----------------[Counters]-----------------*/
+
+#ifdef __linux__
+static int open_event(uint32_t type, uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd == -1;
+    // user space only, which is all perf_event_paranoid=2 allows
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+PerfCounters::PerfCounters() {
+    fds.fill(-1);
+    slots.fill(-1);
+#ifdef __linux__
+    const uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const std::array<std::pair<uint32_t, uint64_t>, PERF_EVENTS> events{{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, l1d_read_miss},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    }};
+
+    // cycles lead the group; without them nothing else is worth reading
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        fds[e] = open_event(events[e].first, events[e].second, group_fd);
+        if (fds[e] < 0) {
+            if (e == CYCLES) return;
+            continue;
+        }
+        if (e == CYCLES) group_fd = fds[e];
+        slots[e] = opened++;
+    }
+    ioctl(group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds) {
+        if (fd >= 0) close(fd);
+    }
+#endif
+}
+
+bool PerfCounters::available() const {
+    return group_fd >= 0;
+}
+
+PerfCounters::Values PerfCounters::read() {
+    Values values{};
+#ifdef __linux__
+    if (group_fd < 0) return values;
+    // nr, time enabled, time running, then one value per opened event
+    std::array<uint64_t, 3 + PERF_EVENTS> buffer{};
+    if (::read(group_fd, buffer.data(), sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t))) return values;
+
+    double scale = buffer[2] > 0 ? (double)buffer[1] / buffer[2] : 1.0;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (slots[e] >= 0 && (uint64_t)slots[e] < buffer[0]) values[e] = (uint64_t)(buffer[3 + slots[e]] * scale);
+    }
+#endif
+    return values;
+}
+
+const char* PerfCounters::event_name(int event) {
+    return event_names[event];
+}
+
+/*-----------------[Phases]-----------------*/
+
+PerfCounters& FrameProfiler::thread_counters() {
+    static thread_local PerfCounters counters;
+    return counters;
+}
+
+void FrameProfiler::add(Phase phase, const PerfCounters::Values& start) {
+    PerfCounters& counters = thread_counters();
+    PerfCounters::Values end = counters.read();
+    if (counters.available()) available = true;
+    calls[phase].fetch_add(1, std::memory_order_relaxed);
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        totals[phase][e].fetch_add(end[e] - start[e], std::memory_order_relaxed);
+    }
+}
+
+void FrameProfiler::frame_done(uint64_t executed) {
+    frames.fetch_add(1, std::memory_order_relaxed);
+    instructions.fetch_add(executed, std::memory_order_relaxed);
+}
+
+FrameProfiler::Report FrameProfiler::report() const {
+    Report report;
+    report.available = available;
+    report.frames = frames;
+    report.instructions = instructions;
+    for (int p = 0; p < PERF_PHASES; p++) {
+        report.calls[p] = calls[p];
+        for (int e = 0; e < PERF_EVENTS; e++) report.totals[p][e] = totals[p][e];
+    }
+    // execute is measured around the whole instruction loop, which includes draws and scrolls
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        uint64_t nested = report.totals[DRAW][e] + report.totals[SCROLL][e];
+        report.totals[EXECUTE][e] = report.totals[EXECUTE][e] > nested ? report.totals[EXECUTE][e] - nested : 0;
+    }
+    return report;
+}
+
+void FrameProfiler::reset() {
+    frames = 0;
+    instructions = 0;
+    for (int p = 0; p < PERF_PHASES; p++) {
+        calls[p] = 0;
+        for (int e = 0; e < PERF_EVENTS; e++) totals[p][e] = 0;
+    }
+}
+
+const char* FrameProfiler::phase_name(int phase) {
+    return phase_names[phase];
+}
+
+/*-----------------[Output]-----------------*/
+
+nlohmann::json perf_report_to_json(const FrameProfiler::Report& report) {
+    nlohmann::json out;
+    out["available"] = report.available;
+    out["frames"] = report.frames;
+    out["instructions"] = report.instructions;
+    for (int p = 0; p < PERF_PHASES; p++) {
+        nlohmann::json phase;
+        phase["calls"] = report.calls[p];
+        for (int e = 0; e < PERF_EVENTS; e++) {
+            double total = (double)report.totals[p][e];
+            phase["per_frame"][event_names[e]] = report.frames ? total / report.frames : 0.0;
+            phase["per_minstr"][event_names[e]] = report.instructions ? total * 1e6 / report.instructions : 0.0;
+        }
+        out["phases"][phase_names[p]] = phase;
+    }
+    return out;
+}
@@ -0,0 +1,316 @@
+#include <libretro.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// Minimal libretro frontend for checking a core without RetroArch: loads the core, runs a rom with
+// a held joypad button, checks every frame delivers one 128x64 picture, a frame of audio and one input
+// poll, and that a state saved halfway replays to the same picture and sound.
+
+void usage() {
+    std::cerr << "usage: nacho-retro <core> <rom> [options]\n"
+                 "  --frames N          frames to run (default 600)\n"
+                 "  --hold ID           joypad button held on every frame (RETRO_DEVICE_ID_JOYPAD_*)\n"
+                 "  --system DIR        system directory handed to the core (database in DIR/nacho)\n"
+                 "  --screen FILE       write the final frame as a PPM image"
+              << std::endl;
+}
+
+/*-----------------[Core]-----------------*/
+
+struct CoreApi {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    unsigned (*api_version)(void);
+    void (*get_system_info)(struct retro_system_info*);
+    void (*get_system_av_info)(struct retro_system_av_info*);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+};
+
+#ifdef _WIN32
+void* open_core(const std::string& path) { return (void*)LoadLibraryA(path.c_str()); }
+void* core_symbol(void* handle, const char* name) { return (void*)GetProcAddress((HMODULE)handle, name); }
+#else
+void* open_core(const std::string& path) { return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL); }
+void* core_symbol(void* handle, const char* name) { return dlsym(handle, name); }
+#endif
+
+template <typename Function>
+bool bind(void* handle, Function& function, const char* name) {
+    function = (Function)core_symbol(handle, name);
+    if (!function) std::cerr << "Core has no " << name << std::endl;
+    return function != nullptr;
+}
+
+bool load_api(void* handle, CoreApi& api) {
+    return bind(handle, api.set_environment, "retro_set_environment") &&
+           bind(handle, api.set_video_refresh, "retro_set_video_refresh") &&
+           bind(handle, api.set_audio_sample, "retro_set_audio_sample") &&
+           bind(handle, api.set_audio_sample_batch, "retro_set_audio_sample_batch") &&
+           bind(handle, api.set_input_poll, "retro_set_input_poll") &&
+           bind(handle, api.set_input_state, "retro_set_input_state") &&
+           bind(handle, api.init, "retro_init") && bind(handle, api.deinit, "retro_deinit") &&
+           bind(handle, api.api_version, "retro_api_version") &&
+           bind(handle, api.get_system_info, "retro_get_system_info") &&
+           bind(handle, api.get_system_av_info, "retro_get_system_av_info") &&
+           bind(handle, api.run, "retro_run") &&
+           bind(handle, api.serialize_size, "retro_serialize_size") &&
+           bind(handle, api.serialize, "retro_serialize") &&
+           bind(handle, api.unserialize, "retro_unserialize") &&
+           bind(handle, api.load_game, "retro_load_game") &&
+           bind(handle, api.unload_game, "retro_unload_game");
+}
+
+/*-----------------[Frontend State]-----------------*/
+
+namespace {
+std::string system_dir;
+int hold = -1;
+retro_pixel_format pixel_format = RETRO_PIXEL_FORMAT_0RGB1555;
+
+// what the core handed over during the current frame
+struct FrameOutput {
+    unsigned video_calls = 0;
+    unsigned width = 0, height = 0;
+    size_t pitch = 0;
+    std::vector<uint8_t> picture;
+    size_t audio_frames = 0;
+    unsigned polls = 0;
+    // FNV-1a over every sample so far, to compare a replay with the first run
+    uint64_t audio_hash = 0xcbf29ce484222325ull;
+} output;
+
+uint64_t fnv1a(const uint8_t* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+}  // namespace
+
+bool RETRO_CALLCONV environment(unsigned cmd, void* data) {
+    switch (cmd) {
+        case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+            *(const char**)data = system_dir.empty() ? nullptr : system_dir.c_str();
+            return !system_dir.empty();
+        case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+            pixel_format = *(const retro_pixel_format*)data;
+            return pixel_format == RETRO_PIXEL_FORMAT_XRGB8888;
+        default:
+            return false;
+    }
+}
+
+void RETRO_CALLCONV video_refresh(const void* data, unsigned width, unsigned height, size_t pitch) {
+    output.video_calls++;
+    output.width = width;
+    output.height = height;
+    output.pitch = pitch;
+    // NULL repeats the last picture
+    if (data) output.picture.assign((const uint8_t*)data, (const uint8_t*)data + pitch * height);
+}
+
+void RETRO_CALLCONV audio_sample(int16_t left, int16_t right) {
+    int16_t frame[2] = {left, right};
+    output.audio_hash = fnv1a((const uint8_t*)frame, sizeof(frame), output.audio_hash);
+    output.audio_frames++;
+}
+
+size_t RETRO_CALLCONV audio_sample_batch(const int16_t* data, size_t frames) {
+    output.audio_hash = fnv1a((const uint8_t*)data, frames * 2 * sizeof(int16_t), output.audio_hash);
+    output.audio_frames += frames;
+    return frames;
+}
+
+void RETRO_CALLCONV input_poll() { output.polls++; }
+
+int16_t RETRO_CALLCONV input_state(unsigned port, unsigned device, unsigned, unsigned id) {
+    return port == 0 && device == RETRO_DEVICE_JOYPAD && (int)id == hold;
+}
+
+/*-----------------[Checks]-----------------*/
+
+// runs one frame and checks the core produced exactly one frame of everything
+bool run_frame(const CoreApi& api, const retro_system_av_info& av, uint64_t frame) {
+    output.video_calls = 0;
+    output.audio_frames = 0;
+    output.polls = 0;
+    api.run();
+    size_t audio_per_frame = (size_t)(av.timing.sample_rate / av.timing.fps);
+    if (output.video_calls != 1 || output.width != av.geometry.base_width ||
+        output.height != av.geometry.base_height || output.pitch < output.width * sizeof(uint32_t)) {
+        std::cerr << "Frame " << frame << ": " << output.video_calls << " video calls, " << output.width << "x"
+                  << output.height << " pitch " << output.pitch << std::endl;
+        return false;
+    }
+    if (output.audio_frames != audio_per_frame) {
+        std::cerr << "Frame " << frame << ": " << output.audio_frames << " audio frames, expected "
+                  << audio_per_frame << std::endl;
+        return false;
+    }
+    if (output.polls != 1) {
+        std::cerr << "Frame " << frame << ": input polled " << output.polls << " times" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool write_ppm(const std::string& filepath) {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) return false;
+    file << "P6\n" << output.width << " " << output.height << "\n255\n";
+    for (unsigned y = 0; y < output.height; y++) {
+        const uint8_t* row = output.picture.data() + y * output.pitch;
+        for (unsigned x = 0; x < output.width; x++) {
+            uint32_t pixel;
+            std::memcpy(&pixel, row + x * sizeof(pixel), sizeof(pixel));
+            char rgb[3] = {(char)(pixel >> 16), (char)(pixel >> 8), (char)pixel};
+            file.write(rgb, sizeof(rgb));
+        }
+    }
+    return (bool)file;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    std::string core_path = argv[1], rom_path = argv[2], screen_file;
+    uint64_t frames = 600;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (arg == "--frames") {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--hold") {
+            hold = std::stoi(argv[++i]);
+        } else if (arg == "--system") {
+            system_dir = argv[++i];
+        } else if (arg == "--screen") {
+            screen_file = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (frames < 2) frames = 2;
+
+    void* handle = open_core(core_path);
+    CoreApi api;
+    if (!handle) {
+        std::cerr << "Could not load core " << core_path << std::endl;
+        return 1;
+    }
+    if (!load_api(handle, api)) return 1;
+    if (api.api_version() != RETRO_API_VERSION) {
+        std::cerr << "Core API version " << api.api_version() << ", expected " << RETRO_API_VERSION << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(rom_path, std::ios::binary);
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file || rom.empty()) {
+        std::cerr << "Could not read " << rom_path << std::endl;
+        return 1;
+    }
+
+    api.set_environment(environment);
+    api.set_video_refresh(video_refresh);
+    api.set_audio_sample(audio_sample);
+    api.set_audio_sample_batch(audio_sample_batch);
+    api.set_input_poll(input_poll);
+    api.set_input_state(input_state);
+    api.init();
+
+    retro_system_info info;
+    api.get_system_info(&info);
+    retro_game_info game = {rom_path.c_str(), rom.data(), rom.size(), nullptr};
+    if (!api.load_game(&game)) {
+        std::cerr << info.library_name << " could not load " << rom_path << std::endl;
+        return 1;
+    }
+    if (pixel_format != RETRO_PIXEL_FORMAT_XRGB8888) {
+        std::cerr << "Core did not ask for XRGB8888" << std::endl;
+        return 1;
+    }
+    retro_system_av_info av;
+    api.get_system_av_info(&av);
+
+    // first run, saving a state halfway
+    uint64_t half = frames / 2;
+    std::vector<uint8_t> state(api.serialize_size());
+    uint64_t audio_at_half = 0;
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        if (frame == half) {
+            if (!api.serialize(state.data(), state.size())) {
+                std::cerr << "Serialize failed at frame " << frame << std::endl;
+                return 1;
+            }
+            audio_at_half = output.audio_hash;
+        }
+        if (!run_frame(api, av, frame)) return 1;
+    }
+    std::vector<uint8_t> picture = output.picture;
+    uint64_t audio_hash = output.audio_hash;
+
+    // a short buffer must be refused, then the saved state replays to the same picture and sound
+    if (api.unserialize(state.data(), state.size() - 1)) {
+        std::cerr << "Truncated state was accepted" << std::endl;
+        return 1;
+    }
+    if (!api.unserialize(state.data(), state.size())) {
+        std::cerr << "Unserialize failed" << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> reloaded(state.size());
+    if (!api.serialize(reloaded.data(), reloaded.size()) || reloaded != state) {
+        std::cerr << "State changed across unserialize and serialize" << std::endl;
+        return 1;
+    }
+    output.audio_hash = audio_at_half;
+    for (uint64_t frame = half; frame < frames; frame++) {
+        if (!run_frame(api, av, frame)) return 1;
+    }
+    bool replayed = output.picture == picture && output.audio_hash == audio_hash;
+
+    if (!screen_file.empty() && !write_ppm(screen_file)) {
+        std::cerr << "Could not write " << screen_file << std::endl;
+        return 1;
+    }
+    std::cout << info.library_name << " " << info.library_version << ": " << frames << " frames of "
+              << av.geometry.base_width << "x" << av.geometry.base_height << " at " << av.timing.fps << " fps, "
+              << av.timing.sample_rate << " Hz; state " << state.size() << " bytes; picture "
+              << std::hex << fnv1a(picture.data(), picture.size()) << ", audio " << audio_hash << std::dec
+              << "; replay from frame " << half << (replayed ? " matches" : " DIFFERS") << std::endl;
+
+    api.unload_game();
+    api.deinit();
+    return replayed ? 0 : 1;
+}
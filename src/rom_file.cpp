@@ -0,0 +1,48 @@
+#include <io/rom_file.h>
+
+#include <algorithm>
+#include <iostream>
+
+// bytes handed to the digest at a time, so it walks the mapping page by page
+#define HASH_CHUNK 4096
+
+Sha1Stream::Sha1Stream() : ctx(EVP_MD_CTX_new()) {
+    EVP_DigestInit_ex(ctx, EVP_sha1(), nullptr);
+}
+
+Sha1Stream::~Sha1Stream() {
+    EVP_MD_CTX_free(ctx);
+}
+
+void Sha1Stream::update(const uint8_t* data, size_t size) {
+    EVP_DigestUpdate(ctx, data, size);
+}
+
+std::string Sha1Stream::hex() {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx, digest, &length);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string text(length * 2, '0');
+    for (unsigned int i = 0; i < length; i++) {
+        text[i * 2] = digits[digest[i] >> 4];
+        text[i * 2 + 1] = digits[digest[i] & 0xF];
+    }
+    return text;
+}
+
+bool RomFile::open(const std::string& path) {
+    hash.clear();
+    if (!file.open(path)) {
+        std::cerr << "Invalid file" << std::endl;
+        return false;
+    }
+
+    Sha1Stream digest;
+    for (size_t offset = 0; offset < file.size(); offset += HASH_CHUNK) {
+        digest.update(file.data() + offset, std::min<size_t>(HASH_CHUNK, file.size() - offset));
+    }
+    hash = digest.hex();
+    return true;
+}
@@ -0,0 +1,148 @@
+#include <shm/shared_state.h>
+
+#include <cpu/cpu.h>
+#include <log/log.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// readers compile against the C header, so it has to describe the same machine
+static_assert(NACHO_SHM_WIDTH == WIDTH && NACHO_SHM_HEIGHT == HEIGHT, "shared framebuffer size");
+static_assert(NACHO_SHM_MEMORY == CPU_STATE_MEMORY, "shared memory view size");
+static_assert(sizeof(nacho_shm_header) == 64, "header is one cache line");
+static_assert(offsetof(nacho_shm_state, frame) == 64, "frame follows the header");
+static_assert(offsetof(nacho_shm_frame, planes) == 78 && offsetof(nacho_shm_frame, memory) == 4174,
+              "frame layout changed; bump NACHO_SHM_VERSION");
+
+SharedState::~SharedState() {
+    close();
+}
+
+bool SharedState::is_open() const {
+    return shared != nullptr;
+}
+
+const nacho_shm_state* SharedState::state() const {
+    return shared;
+}
+
+nacho_shm_input* SharedState::input() {
+    return channel;
+}
+
+/*-----------------[Region]-----------------*/
+
+#ifdef _WIN32
+
+bool SharedState::open(std::string) {
+    NACHO_LOG(LOG_ERROR, "Shared memory export needs POSIX shared memory");
+    return false;
+}
+
+void SharedState::close() {}
+
+#else
+
+bool SharedState::open(std::string region_name) {
+    close();
+    if (region_name.empty() || region_name[0] != '/') region_name = "/" + region_name;
+    int fd = shm_open(region_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        NACHO_LOG(LOG_ERROR, "Cannot create shared memory %s: %s", region_name.c_str(), strerror(errno));
+        return false;
+    }
+    // zero a region left behind by an earlier run so readers never see its frames as ours
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, NACHO_SHM_SIZE) != 0) {
+        NACHO_LOG(LOG_ERROR, "Cannot size shared memory %s: %s", region_name.c_str(), strerror(errno));
+        ::close(fd);
+        shm_unlink(region_name.c_str());
+        return false;
+    }
+    void* mapped = mmap(nullptr, NACHO_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        NACHO_LOG(LOG_ERROR, "Cannot map shared memory %s: %s", region_name.c_str(), strerror(errno));
+        shm_unlink(region_name.c_str());
+        return false;
+    }
+
+    name = region_name;
+    region = mapped;
+    shared = (nacho_shm_state*)mapped;
+    channel = (nacho_shm_input*)((uint8_t*)mapped + NACHO_SHM_INPUT_OFFSET);
+    applied = 0;
+    shared->header.version = NACHO_SHM_VERSION;
+    shared->header.size = NACHO_SHM_SIZE;
+    shared->header.input_offset = NACHO_SHM_INPUT_OFFSET;
+    shared->header.pid = (uint32_t)getpid();
+    // readers check the magic last
+    __atomic_store_n(&shared->header.magic, NACHO_SHM_MAGIC, __ATOMIC_RELEASE);
+    NACHO_LOG(LOG_INFO, "Publishing frames to shared memory %s (%zu bytes)", name.c_str(), (size_t)NACHO_SHM_SIZE);
+    return true;
+}
+
+void SharedState::close() {
+    if (!region) return;
+    munmap(region, NACHO_SHM_SIZE);
+    shm_unlink(name.c_str());
+    region = nullptr;
+    shared = nullptr;
+    channel = nullptr;
+}
+
+#endif
+
+/*-----------------[Frames]-----------------*/
+
+void SharedState::publish(CPU& cpu) {
+    if (!shared) return;
+    nacho_shm_frame& frame = shared->frame;
+    uint64_t sequence = shared->header.sequence;
+    __atomic_store_n(&shared->header.sequence, sequence + 1, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    CPU::Stats stats = cpu.get_stats();
+    frame.frame = stats.frames;
+    frame.instructions = stats.instructions;
+    frame.pc = cpu.get_pc();
+    frame.i = cpu.get_index();
+    frame.keys = cpu.get_keys();
+    for (int level = 0; level < MAX_STACK; level++) frame.stack[level] = cpu.get_stack(level);
+    frame.sp = (int8_t)cpu.get_sp();
+    frame.delay = cpu.get_delay();
+    frame.sound = cpu.get_sound();
+    frame.plane = cpu.get_plane();
+    frame.system = (uint8_t)cpu.config.system;
+    frame.hires = !cpu.is_lores();
+    for (uint8_t reg = 0; reg < 16; reg++) frame.v[reg] = cpu.get_register(reg);
+
+    const std::array<uint8_t, SCREEN_SIZE>& screen = cpu.screen_view();
+    for (int plane = 0; plane < NACHO_SHM_PLANES; plane++) {
+        uint8_t* out = frame.planes[plane];
+        for (int i = 0; i < NACHO_SHM_PLANE_BYTES; i++) {
+            const uint8_t* pixels = &screen[i * 8];
+            uint8_t byte = 0;
+            for (int b = 0; b < 8; b++) byte = (byte << 1) | ((pixels[b] >> plane) & 1);
+            out[i] = byte;
+        }
+    }
+    cpu.get_memory().copy_out(0, frame.memory, NACHO_SHM_MEMORY);
+
+    __atomic_store_n(&shared->header.sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void SharedState::apply_input(CPU& cpu) {
+    if (!channel) return;
+    uint32_t sequence = __atomic_load_n(&channel->sequence, __ATOMIC_ACQUIRE);
+    if (sequence == applied) return;
+    cpu.set_keys(__atomic_load_n(&channel->keys, __ATOMIC_RELAXED));
+    applied = sequence;
+    __atomic_store_n(&channel->applied, sequence, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,105 @@
+/* Reads the region an emulator started with --shm NAME publishes, and optionally sets its keypad.
+ * Plain C against shm/nacho_shm.h only, as an example for external tools. */
+#include <shm/nacho_shm.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: nacho-shm NAME [options]\n"
+            "  --frames N          print N consecutive published frames (default 1)\n"
+            "  --keys MASK         set the keypad to hex MASK (bit n for key n) and wait until it is applied\n");
+}
+
+static void sleep_ms(long ms) {
+    struct timespec delay = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&delay, NULL);
+}
+
+static void print_frame(const nacho_shm_frame* frame) {
+    int lit = 0;
+    for (int i = 0; i < NACHO_SHM_PLANE_BYTES; i++) lit += __builtin_popcount(frame->planes[0][i]);
+    printf("frame %llu pc %04X i %04X sp %d dt %u st %u keys %04X v", (unsigned long long)frame->frame,
+           frame->pc, frame->i, frame->sp, frame->delay, frame->sound, frame->keys);
+    for (int r = 0; r < 16; r++) printf(" %02X", frame->v[r]);
+    printf(" lit %d mem[pc] %02X%02X\n", lit, frame->memory[frame->pc], frame->memory[(frame->pc + 1) & 0xFFFF]);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    char name[256];
+    snprintf(name, sizeof(name), "%s%s", argv[1][0] == '/' ? "" : "/", argv[1]);
+    long frames = 1;
+    long keys = -1;
+    for (int i = 2; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (!strcmp(argv[i], "--frames")) {
+            frames = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--keys")) {
+            keys = strtol(argv[++i], NULL, 16) & 0xFFFF;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        perror(name);
+        return 1;
+    }
+    /* the state read only, the input pages writable */
+    const nacho_shm_state* state = mmap(NULL, NACHO_SHM_INPUT_OFFSET, PROT_READ, MAP_SHARED, fd, 0);
+    nacho_shm_input* input = mmap(NULL, NACHO_SHM_ALIGN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, NACHO_SHM_INPUT_OFFSET);
+    close(fd);
+    if (state == MAP_FAILED || input == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    if (__atomic_load_n(&state->header.magic, __ATOMIC_ACQUIRE) != NACHO_SHM_MAGIC ||
+        state->header.version != NACHO_SHM_VERSION || state->header.size != NACHO_SHM_SIZE) {
+        fprintf(stderr, "%s is not a nacho region of version %d\n", name, NACHO_SHM_VERSION);
+        return 1;
+    }
+
+    if (keys >= 0) {
+        uint32_t sequence = nacho_shm_set_keys(input, (uint16_t)keys);
+        int waited = 0;
+        while (__atomic_load_n(&input->applied, __ATOMIC_ACQUIRE) != sequence && waited++ < 1000) sleep_ms(1);
+        if (waited > 1000) {
+            fprintf(stderr, "keys were not applied; is the emulator running?\n");
+            return 1;
+        }
+    }
+
+    /* copy each new frame out under the seqlock and print the copy */
+    static nacho_shm_frame frame;
+    uint64_t last = 0;
+    for (long printed = 0; printed < frames;) {
+        uint64_t sequence;
+        do {
+            sequence = nacho_shm_read_begin(state);
+            memcpy(&frame, (const void*)&state->frame, sizeof(frame));
+        } while (nacho_shm_read_retry(state, sequence));
+        if (sequence == last) {
+            sleep_ms(1);
+            continue;
+        }
+        last = sequence;
+        print_frame(&frame);
+        printed++;
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include <perf/startup.h>
+
+#include <cstdio>
+
+StartupTimeline::StartupTimeline() : start(std::chrono::steady_clock::now()) {}
+
+double StartupTimeline::mark(const std::string& phase) {
+    double ms = elapsed();
+    std::lock_guard<std::mutex> lock(mtx);
+    phases.emplace_back(phase, ms);
+    return ms;
+}
+
+double StartupTimeline::elapsed() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string StartupTimeline::report() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string text;
+    char entry[96];
+    for (const auto& [phase, ms] : phases) {
+        std::snprintf(entry, sizeof(entry), "%s%s %.1f ms", text.empty() ? "" : ", ", phase.c_str(), ms);
+        text += entry;
+    }
+    return text;
+}
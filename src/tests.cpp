@@ -0,0 +1,691 @@
+#include <cpu/cpu.h>
+#include <database/catalog_index.h>
+#include <database/database.h>
+#include <detect/detector.h>
+#include <env/vec_env.h>
+#include <headless/headless.h>
+#include <lockstep/validator.h>
+#include <perf/alloc_counter.h>
+#include <perf/guest_profiler.h>
+#include <perf/metrics.h>
+#include <shm/shared_state.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Golden-frame conformance suite. Every case runs a ROM headless for a fixed number of frames with scripted
+// input under one platform config, then compares hashes of the framebuffer and the machine state against
+// recorded values and checks the run finished inside its time budget. The same run is also replayed on the
+// lockstep engine, which must match the interpreter frame by frame. Run with --update after an intended
+// behaviour change and paste the printed table over `golden` below.
+// games/happy.ch8 is the only program checked in to games/. Catalog games, including 1dcell.ch8 that the
+// benchmark defaults to, are third-party ROMs the tree doesn't carry, so they have no golden entries here.
+
+/*-----------------[Programs]-----------------*/
+
+// code at 200 followed by data at 280
+static std::vector<uint8_t> with_data(std::vector<uint8_t> code, const std::vector<uint8_t>& data) {
+    code.resize(0x80, 0);
+    code.insert(code.end(), data.begin(), data.end());
+    return code;
+}
+
+// ALU, shifts, logic, BCD and register store/load; the shift, logic and memory quirks all show up in the
+// final registers and digits drawn
+const std::vector<uint8_t> alu_rom{
+    0x6A, 0x05,  // 200 VA = 05
+    0x6B, 0x07,  // 202 VB = 07
+    0x8A, 0xB4,  // 204 VA += VB
+    0x60, 0xFF,  // 206 V0 = FF
+    0x61, 0x02,  // 208 V1 = 02
+    0x80, 0x14,  // 20A V0 += V1 (carry)
+    0x82, 0xF0,  // 20C V2 = VF
+    0x63, 0x81,  // 20E V3 = 81
+    0x64, 0x10,  // 210 V4 = 10
+    0x83, 0x46,  // 212 V3 >>= 1 (VX or VY by quirk)
+    0x85, 0xF0,  // 214 V5 = VF
+    0x86, 0x30,  // 216 V6 = V3
+    0x86, 0x4E,  // 218 V6 <<= 1 (VX or VY by quirk)
+    0x87, 0xF0,  // 21A V7 = VF
+    0x88, 0xA0,  // 21C V8 = VA
+    0x88, 0xB1,  // 21E V8 |= VB (VF reset by quirk)
+    0x89, 0xF0,  // 220 V9 = VF
+    0x8A, 0xB5,  // 222 VA -= VB
+    0x8B, 0xA7,  // 224 VB = VA - VB (borrow)
+    0x8C, 0xB3,  // 226 VC ^= VB
+    0x8D, 0xB2,  // 228 VD &= VB
+    0xA3, 0x00,  // 22A I = 300
+    0xFB, 0x33,  // 22C BCD of VB at I
+    0xFD, 0x55,  // 22E store V0..VD (I advanced by quirk)
+    0xF2, 0x65,  // 230 load V0..V2
+    0xF0, 0x29,  // 232 I = digit V0
+    0x6E, 0x02,  // 234 VE = 02
+    0xDE, 0xE5,  // 236 draw at (VE, VE)
+    0xF1, 0x29,  // 238 I = digit V1
+    0x6E, 0x08,  // 23A VE = 08
+    0xDE, 0xE5,  // 23C draw
+    0xF2, 0x29,  // 23E I = digit V2
+    0x6E, 0x0E,  // 240 VE = 0E
+    0xDE, 0xE5,  // 242 draw
+    0xF5, 0x1E,  // 244 I += V5
+    0x6E, 0x14,  // 246 VE = 14
+    0xDE, 0xE5,  // 248 draw
+    0x12, 0x4A,  // 24A halt
+};
+
+// clipping and wrapping at the edges, collisions, 16x16 sprites, hires and scrolling
+const std::vector<uint8_t> draw_rom = with_data({
+    0x00, 0xE0,  // 200 clear
+    0xA2, 0x80,  // 202 I = 280
+    0x60, 0x3C,  // 204 V0 = 3C (4 pixels from the right edge)
+    0x61, 0x1C,  // 206 V1 = 1C (4 rows from the bottom)
+    0xD0, 0x18,  // 208 draw, clipped or wrapped by quirk
+    0x82, 0xF0,  // 20A V2 = VF
+    0xD0, 0x18,  // 20C draw again, erasing (collision)
+    0x83, 0xF0,  // 20E V3 = VF
+    0x60, 0x10,  // 210 V0 = 10
+    0xD0, 0x18,  // 212 draw
+    0x00, 0xC2,  // 214 scroll down 2 (half in lores by quirk)
+    0x00, 0xFB,  // 216 scroll right 4
+    0x00, 0xFF,  // 218 hires
+    0x60, 0x7C,  // 21A V0 = 7C
+    0x61, 0x3C,  // 21C V1 = 3C
+    0xD0, 0x10,  // 21E 16x16 at the corner
+    0x84, 0xF0,  // 220 V4 = VF
+    0x60, 0x20,  // 222 V0 = 20
+    0xD0, 0x10,  // 224 16x16
+    0x00, 0xC3,  // 226 scroll down 3
+    0x00, 0xFC,  // 228 scroll left 4
+    0x12, 0x2A,  // 22A halt
+}, {
+    0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, 0x18, 0x3C, 0x7E, 0xFF, 0xFF, 0x7E, 0x3C, 0x18,
+    0x0F, 0xF0, 0x33, 0xCC, 0x55, 0xAA, 0x0F, 0xF0, 0x33, 0xCC, 0x55, 0xAA, 0x0F, 0xF0, 0x33, 0xCC,
+});
+
+// nested subroutines, key wait, key skips and timers, driven by the scripted presses below
+const std::vector<uint8_t> input_rom{
+    0x22, 0x20,  // 200 call 220
+    0xF0, 0x0A,  // 202 V0 = next key
+    0xE0, 0x9E,  // 204 skip if V0 is held
+    0x71, 0x01,  // 206 V1 += 1
+    0xE0, 0xA1,  // 208 skip if V0 is not held
+    0x72, 0x01,  // 20A V2 += 1
+    0xF0, 0x29,  // 20C I = digit V0
+    0xD3, 0x35,  // 20E draw at (V3, V3)
+    0x73, 0x06,  // 210 V3 += 6
+    0x65, 0x05,  // 212 V5 = 05
+    0xF5, 0x15,  // 214 delay = V5
+    0xF6, 0x07,  // 216 V6 = delay
+    0x36, 0x00,  // 218 skip if V6 == 0
+    0x12, 0x16,  // 21A loop until the delay runs out
+    0x12, 0x02,  // 21C next key
+    0x00, 0x00,  // 21E
+    0x63, 0x01,  // 220 V3 = 01
+    0x22, 0x28,  // 222 call 228
+    0x00, 0xEE,  // 224 return
+    0x00, 0x00,  // 226
+    0x64, 0x05,  // 228 V4 = 05
+    0x00, 0xEE,  // 22A return
+};
+
+// XO-CHIP: long I, register ranges, bit planes, plane scrolls, audio pattern, pitch and timers
+const std::vector<uint8_t> xo_rom = with_data({
+    0xF0, 0x00, 0x10, 0x00,  // 200 I = 1000
+    0x60, 0x11,              // 204 V0 = 11
+    0x61, 0x22,              // 206 V1 = 22
+    0x62, 0x33,              // 208 V2 = 33
+    0x63, 0x44,              // 20A V3 = 44
+    0x50, 0x32,              // 20C store V0..V3 at I
+    0x53, 0x03,              // 20E load V3..V0 (reversed)
+    0xF3, 0x01,              // 210 planes 1 and 2
+    0xA2, 0x80,              // 212 I = 280
+    0x64, 0x08,              // 214 V4 = 08
+    0x65, 0x04,              // 216 V5 = 04
+    0xD4, 0x58,              // 218 draw on both planes
+    0xF1, 0x01,              // 21A plane 1
+    0x00, 0xD2,              // 21C scroll plane 1 up 2
+    0xF2, 0x01,              // 21E plane 2
+    0x00, 0xC1,              // 220 scroll plane 2 down 1
+    0xA2, 0x80,              // 222 I = 280
+    0xF0, 0x02,              // 224 audio pattern from I
+    0x66, 0x70,              // 226 V6 = 70
+    0xF6, 0x3A,              // 228 pitch
+    0x67, 0x0A,              // 22A V7 = 0A
+    0xF7, 0x18,              // 22C sound = V7
+    0xF7, 0x15,              // 22E delay = V7
+    0xF8, 0x07,              // 230 V8 = delay
+    0x38, 0x00,              // 232 skip if V8 == 0
+    0x12, 0x30,              // 234 loop until the delay runs out
+    0xF0, 0x00, 0xFF, 0xF0,  // 236 I = FFF0
+    0xF3, 0x55,              // 23A store V0..V3 at the top of memory
+    0x12, 0x3C,              // 23C halt
+}, {
+    // plane 1 rows then plane 2 rows
+    0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, 0x18, 0x3C, 0x7E, 0xFF, 0xFF, 0x7E, 0x3C, 0x18,
+});
+
+/*-----------------[Cases]-----------------*/
+
+const std::vector<int> all_platforms{CHIP8, SCHIP1_1, SCHIP_MODERN, XO_CHIP};
+
+struct TestRom {
+    std::string name;
+    std::vector<uint8_t> data;  // empty: read from path
+    std::string path;
+    std::vector<int> platforms;  // -1 uses the database config
+    uint64_t frames;
+    std::vector<Headless::InputEvent> inputs;
+    double budget_ms;  // for the fastest of the timed runs of an optimized build
+};
+
+const std::vector<TestRom> roms{
+    {"alu", alu_rom, "", all_platforms, 30, {}, 5},
+    {"draw", draw_rom, "", all_platforms, 30, {}, 5},
+    {"input", input_rom, "", all_platforms, 90, {{10, 0x5, true}, {14, 0x5, false}, {40, 0xA, true},
+                                                 {43, 0xA, false}, {70, 0x3, true}}, 5},
+    {"xo", xo_rom, "", {XO_CHIP}, 30, {}, 5},
+    {"happy", {}, "games/happy.ch8", all_platforms, 600, {{120, 0x5, true}, {180, 0x5, false}}, 10},
+};
+
+struct Golden {
+    const char* name;  // rom/platform
+    const char* screen;
+    const char* state;
+};
+
+const std::vector<Golden> golden{
+    {"alu/chip8", "d7a110cff2275905", "1568f0ce389e9509"},
+    {"alu/schip1.1", "a7cb5124172173f9", "ffe56d78ff2bf92a"},
+    {"alu/schip", "d7a110cff2275905", "9a52591ebf14bf5d"},
+    {"alu/xochip", "d7a110cff2275905", "b5f5eddf88528f2d"},
+    {"draw/chip8", "33c630439a749a35", "b866df7594258ec2"},
+    {"draw/schip1.1", "8f941524366623f3", "129b6b9a79f850a0"},
+    {"draw/schip", "d5319ed71c35f543", "7a71044493935f40"},
+    {"draw/xochip", "b886a2fe28564fa3", "ae0e73816b00a290"},
+    {"input/chip8", "bdb734d61309e695", "82d34379a4ab13ce"},
+    {"input/schip1.1", "bdb734d61309e695", "6a5989c5ab854de6"},
+    {"input/schip", "bdb734d61309e695", "08672abf6469ac02"},
+    {"input/xochip", "bdb734d61309e695", "b7e4d827da76c412"},
+    {"xo/xochip", "e682f4a26d969bc5", "1c797a098b045381"},
+    {"happy/chip8", "b9d103fd6854a325", "96512d5f909b6734"},
+    {"happy/schip1.1", "5f2e79e56c5ba1c5", "fbee842a0d86812d"},
+    {"happy/schip", "932d73e67383a4a5", "3c8d1db078794c6a"},
+    {"happy/xochip", "932d73e67383a4a5", "337bbc7169de7a2a"},
+};
+
+/*-----------------[Runner]-----------------*/
+
+// FNV-1a over the registers, I, PC, all of memory and the fault counters
+static uint64_t hash_state(CPU& cpu) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](uint64_t value) {
+        hash ^= value;
+        hash *= 0x100000001b3ULL;
+    };
+    for (uint8_t r = 0; r < 16; r++) mix(cpu.get_register(r));
+    mix(cpu.get_index());
+    mix(cpu.get_pc());
+    mix(cpu.get_plane());
+    for (uint32_t addr = 0; addr < MAX_MEM; addr++) mix(cpu.read_memory(addr));
+    CPU::Stats stats = cpu.get_stats();
+    mix(stats.instructions);
+    mix(stats.invalid_opcodes);
+    mix(stats.stack_faults);
+    mix(stats.fetch_faults);
+    return hash;
+}
+
+struct Outcome {
+    std::string screen;
+    std::string state;
+    double ms = 0;
+    std::string error;
+};
+
+// lanes the lockstep engine runs each case with; more than one so diverged lanes get exercised too
+#define VALIDATE_LANES 4
+
+// empty when the lockstep engine matched the interpreter for every frame
+static std::string validate_case(const TestRom& rom, const std::vector<uint8_t>& data, int platform,
+                                 Database& db) {
+    CPU::Config config = platform >= 0 ? db.gen_platform_config(platform)
+                                       : db.gen_config(CPU::hash_data(data.data(), data.size()));
+    auto validator = std::make_unique<LockstepValidator>(config, VALIDATE_LANES);
+    if (validator->load(data.data(), data.size()) < 0) return "lockstep engine could not load";
+    for (const Headless::InputEvent& event : rom.inputs) validator->add_input(event);
+    if (validator->run(rom.frames)) return "";
+    return divergence_to_text(validator->divergence());
+}
+
+// FX55, FX33 and FX65 with I = FFFD on XO-CHIP touch the last byte of memory (and FX55 wraps to 0000)
+static std::string lockstep_top_case(Database& db) {
+    std::vector<uint8_t> rom = {0x60, 0x12, 0x61, 0x34, 0x62, 0x56, 0x63, 0x78,  // V0..V3
+                                0xF0, 0x00, 0xFF, 0xFD, 0xF3, 0x55,              // I = FFFD, store V0..V3
+                                0xF0, 0x00, 0xFF, 0xFD, 0x64, 0xFE, 0xF4, 0x33,  // BCD of 254 at FFFD
+                                0xF0, 0x00, 0xFF, 0xFD, 0xF3, 0x65,              // load V0..V3 back
+                                0x12, 0x1C};
+    auto validator = std::make_unique<LockstepValidator>(db.gen_platform_config(XO_CHIP), VALIDATE_LANES);
+    if (validator->load(rom.data(), rom.size()) < 0) return "lockstep engine could not load";
+    if (!validator->run(3)) return divergence_to_text(validator->divergence());
+    if (validator->engine().read_memory(0, 0xFFFF) != 4) return "BCD ones digit not at FFFF";
+    return "";
+}
+
+static Outcome run_case(const TestRom& rom, const std::vector<uint8_t>& data, int platform, Database& db) {
+    Outcome outcome;
+    auto cpu = std::make_unique<CPU>();
+    Headless headless(*cpu);
+    if (headless.load_data(data.data(), data.size(), db, platform) < 0) {
+        outcome.error = "could not load";
+        return outcome;
+    }
+    cpu->seed(1);
+    for (const Headless::InputEvent& event : rom.inputs) headless.add_input(event);
+
+    auto start = std::chrono::steady_clock::now();
+    headless.run(rom.frames);
+    auto end = std::chrono::steady_clock::now();
+    outcome.ms = std::chrono::duration<double, std::milli>(end - start).count();
+    outcome.screen = hash_to_hex(hash_screen(cpu->screen_view()));
+    outcome.state = hash_to_hex(hash_state(*cpu));
+    return outcome;
+}
+
+void usage() {
+    std::cerr << "usage: nacho-tests [options]\n"
+                 "  --update            print the golden table for the current behaviour instead of checking\n"
+                 "  --runs N            timed runs per case, the fastest counts against the budget (default 3)\n"
+                 "  --budget-scale X    multiply every time budget, e.g. for debug or sanitizer builds\n"
+                 "  --filter TEXT       only cases whose name contains TEXT\n"
+                 "  --db DIR            database directory (default: database)"
+              << std::endl;
+}
+
+/*-----------------[Extra Cases]-----------------*/
+
+#define HAPPY_ROM "games/happy.ch8"
+
+// whole file, empty if it can't be read
+static std::vector<uint8_t> read_rom(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// checks outside the golden table; run returns an empty string on success or the problem
+struct ExtraCase {
+    std::string name;
+    std::function<std::string()> run;
+    // why the case can't run in this build; empty runs it
+    std::string skip = "";
+};
+
+#ifdef NACHO_COUNT_ALLOCS
+#define COUNTED_ONLY ""
+#else
+#define COUNTED_ONLY "needs -DNACHO_COUNT_ALLOCS=ON"
+#endif
+
+#ifdef _WIN32
+#define POSIX_ONLY "needs POSIX shared memory"
+#else
+#define POSIX_ONLY ""
+#endif
+
+// catalog search over the compiled catalog and the JSON must agree; empty on success
+static std::string catalog_case(const Database& db, const std::string& db_dir) {
+    CatalogIndex compiled(db);
+    CatalogIndex parsed(Database(db_dir, ""));
+    std::vector<uint32_t> a, b;
+    for (const char* text : {"", "blinky", "hans egeberg", "pong 19", "xo", "no such program"}) {
+        CatalogIndex::Query query;
+        query.text = text;
+        compiled.search(query, a);
+        parsed.search(query, b);
+        bool same = a.size() == b.size();
+        for (size_t i = 0; same && i < a.size(); i++) same = compiled.entry(a[i]).title == parsed.entry(b[i]).title;
+        if (!same) return std::string("query '") + text + "' differs between catalog and JSON";
+    }
+    CatalogIndex::Query query;
+    query.text = "BLINKY";
+    query.min_year = 1990;
+    query.max_year = 1991;
+    compiled.search(query, a);
+    if (a.empty() || compiled.entry(a[0]).title != "Blinky") return "'BLINKY' 1990-1991 did not find Blinky";
+    return "";
+}
+
+// happy draws a 16x16 SCHIP sprite, which plain CHIP-8 skips, so detection must not settle on CHIP-8
+static std::string detect_case(const Database& db) {
+    std::vector<uint8_t> data = read_rom(HAPPY_ROM);
+    if (data.empty()) return "could not open " HAPPY_ROM;
+    QuirkDetector detector(db, "");
+    std::vector<QuirkDetector::Result> results = detector.rank(data.data(), data.size());
+    if (results.front().candidate.config.system == CHIP8) {
+        return "picked " + results.front().candidate.name + " for happy";
+    }
+    return "";
+}
+
+// once warmed up, frames and the frontend's per-frame calls (screen handoff, audio, metrics) must not
+// touch the heap. Needs NACHO_COUNT_ALLOCS; elsewhere nothing is counted
+static std::string allocations_case() {
+    std::vector<uint8_t> data = read_rom(HAPPY_ROM);
+    if (data.empty()) return "could not open " HAPPY_ROM;
+    auto cpu = std::make_unique<CPU>();
+    static std::array<uint8_t, SAMPLE_SIZE> samples;
+    cpu->set_audio_callback([](void* core) { ((CPU*)core)->gen_frame_samples(samples.data()); }, cpu.get());
+    cpu->load_program_data(data.data(), data.size());
+    cpu->resume();
+    auto metrics = std::make_unique<RuntimeMetrics>();
+    for (int frame = 0; frame < 60; frame++) cpu->run_frame();
+
+    uint64_t start = alloc_counter::thread_counts().allocations;
+    for (int frame = 0; frame < 120; frame++) {
+        cpu->run_frame();
+        metrics->emulation_frame(1.0, 16.7, 0.1, 100, 12, 0);
+        if (cpu->check_screen()) cpu->get_screen();
+        cpu->check_color();
+        cpu->check_stop();
+        metrics->render_frame(1.0, 16.7, 0.5, 0);
+    }
+    uint64_t allocations = alloc_counter::thread_counts().allocations - start;
+    if (allocations) return std::to_string(allocations) + " allocations in 120 steady state frames";
+    return "";
+}
+
+// VecEnv promises that reset and step never allocate, also when every episode writes to memory pages
+// it shares with the image. Needs NACHO_COUNT_ALLOCS
+static std::string vecenv_allocations_case() {
+    // I = 0x300; loop: V0 += 1, BCD of V0 at I
+    std::vector<uint8_t> rom = {0xA3, 0x00, 0x70, 0x01, 0xF0, 0x33, 0x12, 0x02};
+    VecEnv env(rom, CPU::Config(), 8, VecEnv::PACKED, 2);
+    std::vector<uint8_t> frames(env.size() * env.frame_bytes());
+    std::vector<uint16_t> actions(env.size(), 0);
+    std::vector<float> rewards(env.size());
+
+    uint64_t start = alloc_counter::total_counts().allocations;
+    for (int episode = 0; episode < 3; episode++) {
+        env.reset(frames.data());
+        for (int step = 0; step < 10; step++) env.step(actions.data(), nullptr, frames.data(), rewards.data(), nullptr);
+    }
+    uint64_t allocations = alloc_counter::total_counts().allocations - start;
+    if (allocations) return std::to_string(allocations) + " allocations in 3 episodes of 8 instances";
+    return "";
+}
+
+// a DELTA reward covers one step even when the step before it asked for no rewards
+static std::string vecenv_rewards_case() {
+    // loop: V0 += 1, I = 0x300, store V0 at I; the counter at 0x300 goes up at a constant rate
+    std::vector<uint8_t> rom = {0x70, 0x01, 0xA3, 0x00, 0xF0, 0x55, 0x12, 0x00};
+    VecEnv env(rom, CPU::Config(), 1, VecEnv::PACKED, 1);
+    VecEnv::RewardHook hook;
+    hook.addr = 0x300;
+    env.add_reward_hook(hook);
+    std::vector<uint8_t> frame(env.frame_bytes());
+    uint16_t action = 0;
+    float first = 0, third = 0;
+    env.reset(frame.data());
+    env.step(&action, nullptr, frame.data(), &first, nullptr);
+    env.step(&action, nullptr, frame.data(), nullptr, nullptr);
+    env.step(&action, nullptr, frame.data(), &third, nullptr);
+    if (first <= 0 || third != first) {
+        return "rewards " + std::to_string(first) + " then " + std::to_string(third) + " after a skipped step";
+    }
+    return "";
+}
+
+// a reset requested while a subroutine is open takes effect at the next frame and drops that call, so
+// its return can't be charged against the cleared instruction count
+static std::string profiler_reset_case() {
+    // loop: V0 = 0, call 0x206, which counts V0 to 16 over several frames before returning
+    std::vector<uint8_t> rom = {0x60, 0x00, 0x22, 0x06, 0x12, 0x00, 0x70, 0x01, 0x30, 0x10, 0x12, 0x06, 0x00, 0xEE};
+    auto cpu = std::make_unique<CPU>();
+    auto profiler = std::make_unique<GuestProfiler>();
+    cpu->load_program_data(rom.data(), rom.size());
+    cpu->resume();
+    cpu->set_guest_profiler(profiler.get());
+    cpu->run_frame();
+    profiler->request_reset();
+    if (profiler->instructions() == 0) return "reset before the next frame";
+    for (int frame = 0; frame < 10; frame++) cpu->run_frame();
+    cpu->set_guest_profiler(nullptr);
+
+    for (const GuestProfiler::Subroutine& sub : profiler->subroutines()) {
+        if (sub.inclusive > profiler->instructions()) {
+            return "subroutine " + std::to_string(sub.addr) + " has " + std::to_string(sub.inclusive) +
+                   " inclusive instructions of " + std::to_string(profiler->instructions());
+        }
+    }
+    if (profiler->subroutines().empty()) return "no call completed after the reset";
+    return "";
+}
+
+// reloads from another thread while emulate_loop runs long frames; pause() must wait out the frame in
+// flight before the load swaps memory pages
+static std::string reload_case() {
+    // I = 300, store V0 there, loop: every frame writes a private page
+    std::vector<uint8_t> rom = {0xA3, 0x00, 0xF0, 0x55, 0x12, 0x00};
+    auto cpu = std::make_unique<CPU>();
+    CPU::Config config;
+    config.speed = 200000;
+    cpu->set_config(config);
+    cpu->load_program_data(rom.data(), rom.size());
+    cpu->resume();
+    std::thread emulate(&CPU::emulate_loop, cpu.get());
+
+    std::string problem;
+    for (int load = 0; load < 20 && problem.empty(); load++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(load % 7 + 1));
+        cpu->pause();
+        uint64_t instructions = cpu->get_stats().instructions;
+        cpu->load_program_data(rom.data(), rom.size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (cpu->get_stats().instructions != instructions) problem = "a frame ran after pause() returned";
+        cpu->resume();
+    }
+    cpu->terminate();
+    emulate.join();
+    return problem;
+}
+
+// a binary state loaded into a fresh CPU must run on exactly like the CPU it was saved from
+static std::string state_case() {
+    std::vector<uint8_t> data = read_rom(HAPPY_ROM);
+    if (data.empty()) return "could not open " HAPPY_ROM;
+    auto saved = std::make_unique<CPU>();
+    auto restored = std::make_unique<CPU>();
+    saved->load_program_data(data.data(), data.size());
+    saved->resume();
+    for (int frame = 0; frame < 60; frame++) saved->run_frame();
+
+    std::vector<uint8_t> state(saved->state_size());
+    saved->save_state(state.data());
+    if (restored->load_state(state.data(), state.size() - 1)) return "accepted a truncated state";
+    state[0] ^= 1;
+    if (restored->load_state(state.data(), state.size())) return "accepted a state with a bad magic";
+    state[0] ^= 1;
+    if (!restored->load_state(state.data(), state.size())) return "rejected its own state";
+
+    for (int frame = 0; frame < 60; frame++) {
+        saved->run_frame();
+        restored->run_frame();
+    }
+    if (hash_state(*saved) != hash_state(*restored)) return "state diverged after loading";
+    if (hash_screen(saved->screen_view()) != hash_screen(restored->screen_view())) return "screen diverged after loading";
+    return "";
+}
+
+// the shared region must hold the frame that just ran, and keys written to its input block must reach
+// the keypad before the next frame
+static std::string shm_case() {
+#ifndef _WIN32
+    std::vector<uint8_t> data = read_rom(HAPPY_ROM);
+    if (data.empty()) return "could not open " HAPPY_ROM;
+    SharedState shared;
+    if (!shared.open("nacho-tests-" + std::to_string(getpid()))) return "could not create the region";
+    auto cpu = std::make_unique<CPU>();
+    cpu->load_program_data(data.data(), data.size());
+    cpu->resume();
+    cpu->set_shared_state(&shared);
+    for (int frame = 0; frame < 30; frame++) cpu->run_frame();
+
+    const nacho_shm_state* state = shared.state();
+    uint64_t sequence = nacho_shm_read_begin(state);
+    if (state->header.magic != NACHO_SHM_MAGIC || sequence != 60) return "header not published every frame";
+    const nacho_shm_frame& frame = state->frame;
+    if (frame.frame != 30 || frame.pc != cpu->get_pc() || frame.i != cpu->get_index()) return "registers differ";
+    const std::array<uint8_t, SCREEN_SIZE>& screen = cpu->screen_view();
+    for (int i = 0; i < SCREEN_SIZE; i++) {
+        if (((frame.planes[0][i / 8] >> (7 - i % 8)) & 1) != (screen[i] & 1)) return "plane 0 differs at pixel " + std::to_string(i);
+    }
+    for (uint16_t addr : {0x50, 0x200, 0x2ff}) {
+        if (frame.memory[addr] != cpu->read_memory(addr)) return "memory differs at " + std::to_string(addr);
+    }
+
+    uint32_t keys_sequence = nacho_shm_set_keys(shared.input(), 0x0120);
+    cpu->run_frame();
+    if (cpu->get_keys() != 0x0120 || frame.keys != 0x0120) return "injected keys were not applied";
+    if (shared.input()->applied != keys_sequence) return "applied sequence not reported";
+    cpu->set_shared_state(nullptr);
+#endif
+    return "";
+}
+
+int main(int argc, char* argv[]) {
+    bool update = false;
+    int runs = 3;
+    double budget_scale = 1;
+    std::string filter, db_dir = "database";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--update") {
+            update = true;
+        } else if (i + 1 >= argc) {
+            usage();
+            return 1;
+        } else if (arg == "--runs") {
+            runs = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--budget-scale") {
+            budget_scale = std::stod(argv[++i]);
+        } else if (arg == "--filter") {
+            filter = argv[++i];
+        } else if (arg == "--db") {
+            db_dir = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    Database db(db_dir);
+    int failures = 0, passed = 0, skipped = 0;
+
+    for (const TestRom& rom : roms) {
+        std::vector<uint8_t> data = rom.data.empty() ? read_rom(rom.path) : rom.data;
+        if (data.empty()) {
+            std::cerr << "FAIL " << rom.name << ": could not open " << rom.path << std::endl;
+            failures++;
+            continue;
+        }
+
+        for (int platform : rom.platforms) {
+            std::string name = rom.name + "/" + (platform < 0 ? "database" : platform_name(platform));
+            if (name.find(filter) == std::string::npos) continue;
+
+            Outcome outcome = run_case(rom, data, platform, db);
+            // timing repeats the whole run; the fastest is the least disturbed by the host
+            for (int r = 1; r < runs && outcome.error.empty(); r++) {
+                outcome.ms = std::min(outcome.ms, run_case(rom, data, platform, db).ms);
+            }
+            if (!outcome.error.empty()) {
+                std::cerr << "FAIL " << name << ": " << outcome.error << std::endl;
+                failures++;
+                continue;
+            }
+            if (update) {
+                std::cout << "    {\"" << name << "\", \"" << outcome.screen << "\", \"" << outcome.state << "\"},"
+                          << std::endl;
+                continue;
+            }
+
+            auto expected = std::find_if(golden.begin(), golden.end(),
+                                         [&name](const Golden& g) { return name == g.name; });
+            double budget = rom.budget_ms * budget_scale;
+            std::vector<std::string> problems;
+            if (expected == golden.end()) {
+                problems.push_back("no golden values (run --update)");
+            } else {
+                if (outcome.screen != expected->screen) {
+                    problems.push_back("screen " + outcome.screen + " != " + expected->screen);
+                }
+                if (outcome.state != expected->state) {
+                    problems.push_back("state " + outcome.state + " != " + expected->state);
+                }
+            }
+            if (outcome.ms > budget) {
+                problems.push_back("took " + std::to_string(outcome.ms) + " ms, budget " + std::to_string(budget));
+            }
+            std::string divergence = validate_case(rom, data, platform, db);
+            if (!divergence.empty()) problems.push_back(divergence);
+
+            char timing[32];
+            std::snprintf(timing, sizeof(timing), "%.2f ms", outcome.ms);
+            if (problems.empty()) {
+                std::cout << "ok   " << name << " (" << timing << ")" << std::endl;
+                passed++;
+            } else {
+                for (const std::string& problem : problems) {
+                    std::cerr << "FAIL " << name << ": " << problem << std::endl;
+                }
+                failures++;
+            }
+        }
+    }
+
+    const std::vector<ExtraCase> extras = {
+        {"catalog", [&] { return catalog_case(db, db_dir); }},
+        {"detect", [&] { return detect_case(db); }},
+        {"state", state_case},
+        {"lockstep/top", [&] { return lockstep_top_case(db); }},
+        {"reload", reload_case},
+        {"vecenv/rewards", vecenv_rewards_case},
+        {"profiler/reset", profiler_reset_case},
+        {"shm", shm_case, POSIX_ONLY},
+        {"allocations", allocations_case, COUNTED_ONLY},
+        {"allocations/vecenv", vecenv_allocations_case, COUNTED_ONLY},
+    };
+    for (const ExtraCase& extra : extras) {
+        if (update || extra.name.find(filter) == std::string::npos) continue;
+        if (!extra.skip.empty()) {
+            std::cout << "skip " << extra.name << " (" << extra.skip << ")" << std::endl;
+            skipped++;
+            continue;
+        }
+        std::string problem = extra.run();
+        if (problem.empty()) {
+            std::cout << "ok   " << extra.name << std::endl;
+            passed++;
+        } else {
+            std::cerr << "FAIL " << extra.name << ": " << problem << std::endl;
+            failures++;
+        }
+    }
+
+    if (!update) std::cout << passed << " passed, " << skipped << " skipped, " << failures << " failed" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+#include <pool/thread_pool.h>
+
+// lets submit() find the calling worker's own deque
+thread_local ThreadPool* current_pool = nullptr;
+thread_local unsigned current_index = 0;
+
+/*-----------------[Special Member Functions]-----------------*/
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    for (unsigned i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mtx);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/*-----------------[Tasks]-----------------*/
+
+void ThreadPool::submit(std::function<void()> task) {
+    pending += 1;
+
+    unsigned index = current_pool == this ? current_index : next_queue++ % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mtx);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mtx);
+        queued += 1;
+    }
+    wake.notify_one();
+}
+
+// must not be called from inside a task
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(wake_mtx);
+    idle.wait(lock, [this] { return pending == 0; });
+}
+
+// must not be called from inside a task
+void ThreadPool::run_bulk(size_t count, void (*call)(void*, size_t), void* ctx) {
+    if (count == 0) return;
+    // one bulk job at a time; the job lives on this stack frame
+    std::lock_guard<std::mutex> serial(bulk_mtx);
+
+    Bulk job;
+    job.call = call;
+    job.ctx = ctx;
+    job.count = count;
+    {
+        std::lock_guard<std::mutex> lock(wake_mtx);
+        bulk = &job;
+        bulk_epoch += 1;
+    }
+    wake.notify_all();
+
+    work_bulk(job);
+
+    // retract the job and wait for workers still holding it before the frame goes away
+    std::unique_lock<std::mutex> lock(wake_mtx);
+    bulk = nullptr;
+    idle.wait(lock, [this, &job] { return bulk_workers == 0 && job.done == job.count; });
+}
+
+void ThreadPool::work_bulk(Bulk& job) {
+    size_t i;
+    while ((i = job.next++) < job.count) {
+        job.call(job.ctx, i);
+        job.done += 1;
+    }
+}
+
+unsigned ThreadPool::size() {
+    return workers.size();
+}
+
+// newest task from our own deque, otherwise the oldest task of another worker
+bool ThreadPool::pop_task(unsigned index, std::function<void()>& task) {
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue& victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(unsigned index) {
+    current_pool = this;
+    current_index = index;
+    uint64_t seen_epoch = 0;
+
+    while (1) {
+        Bulk* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(wake_mtx);
+            wake.wait(lock, [this, seen_epoch] { return stop || queued > 0 || (bulk && bulk_epoch != seen_epoch); });
+            if (bulk && bulk_epoch != seen_epoch) {
+                job = bulk;
+                seen_epoch = bulk_epoch;
+                bulk_workers += 1;
+            } else if (queued == 0) {
+                return;
+            } else {
+                // claim one task; there is always at least one unclaimed task per claim in the deques
+                queued -= 1;
+            }
+        }
+
+        if (job) {
+            work_bulk(*job);
+            std::lock_guard<std::mutex> lock(wake_mtx);
+            bulk_workers -= 1;
+            idle.notify_all();
+            continue;
+        }
+
+        std::function<void()> task;
+        while (!pop_task(index, task)) {
+            std::this_thread::yield();
+        }
+        task();
+
+        if (--pending == 0) {
+            std::lock_guard<std::mutex> lock(wake_mtx);
+            idle.notify_all();
+        }
+    }
+}
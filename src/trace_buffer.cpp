@@ -0,0 +1,112 @@
+#include <perf/trace_buffer.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+TraceBuffer::TraceBuffer(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    entries.reset(new TraceEntry[size]());
+    mask = size - 1;
+}
+
+size_t TraceBuffer::capacity() const {
+    return mask + 1;
+}
+
+uint64_t TraceBuffer::recorded() const {
+    return head.load(std::memory_order_acquire);
+}
+
+// only from the writing thread or while nothing records
+void TraceBuffer::clear() {
+    head.store(0, std::memory_order_release);
+}
+
+std::vector<TraceEntry> TraceBuffer::snapshot(size_t max_entries) const {
+    std::vector<TraceEntry> copy;
+    snapshot(copy, max_entries);
+    return copy;
+}
+
+void TraceBuffer::snapshot(std::vector<TraceEntry>& copy, size_t max_entries) const {
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>({end, capacity(), max_entries});
+    uint64_t begin = end - count;
+
+    copy.resize(count);
+    for (uint64_t i = 0; i < count; i++) copy[i] = entries[(begin + i) & mask];
+
+    // the writer may have lapped the oldest entries while we copied (including the one it is writing
+    // right now); those slots hold later instructions, so drop them
+    uint64_t now = head.load(std::memory_order_acquire);
+    uint64_t first_intact = now + 1 > capacity() ? now + 1 - capacity() : 0;
+    uint64_t lapped = first_intact > begin ? first_intact - begin : 0;
+    copy.erase(copy.begin(), copy.begin() + std::min(lapped, count));
+}
+
+bool TraceBuffer::dump(std::string filepath) const {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not write " << filepath << std::endl;
+        return false;
+    }
+    std::vector<TraceEntry> trace = snapshot();
+    uint32_t header[4] = {TRACE_MAGIC, TRACE_VERSION, (uint32_t)sizeof(TraceEntry), (uint32_t)trace.size()};
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)trace.data(), trace.size() * sizeof(TraceEntry));
+    return file.good();
+}
+
+uint8_t TraceBuffer::written_register(uint16_t opcode) {
+    uint8_t x = (opcode >> 8) & 0xF;
+    switch (opcode >> 12) {
+        case 0x5:
+            // 5XY3 loads VX..VY
+            return (opcode & 0xF) == 0x3 ? (opcode >> 4) & 0xF : TRACE_NO_REG;
+        case 0x6:
+        case 0x7:
+        case 0x8:
+        case 0xC:
+            return x;
+        case 0xF:
+            switch (opcode & 0xFF) {
+                case 0x07:
+                case 0x0A:
+                case 0x65:
+                case 0x85:
+                    return x;
+            }
+    }
+    return TRACE_NO_REG;
+}
+
+bool load_trace(std::string filepath, std::vector<TraceEntry>& entries) {
+    std::ifstream file(filepath, std::ios::binary);
+    uint32_t header[4];
+    if (!file.read((char*)header, sizeof(header)) || header[0] != TRACE_MAGIC || header[1] != TRACE_VERSION ||
+        header[2] != sizeof(TraceEntry)) {
+        std::cerr << filepath << " is not a trace file" << std::endl;
+        return false;
+    }
+    entries.resize(header[3]);
+    if (!file.read((char*)entries.data(), entries.size() * sizeof(TraceEntry))) {
+        std::cerr << filepath << " is truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string trace_entry_to_text(const TraceEntry& entry) {
+    char line[80];
+    if (entry.reg == TRACE_NO_REG) {
+        std::snprintf(line, sizeof(line), "%8u %04X %04X I=%04X       VF=%02X", entry.frame, entry.pc, entry.opcode,
+                      entry.index, entry.vf);
+    } else {
+        std::snprintf(line, sizeof(line), "%8u %04X %04X I=%04X V%X=%02X VF=%02X", entry.frame, entry.pc,
+                      entry.opcode, entry.index, entry.reg, entry.value, entry.vf);
+    }
+    return line;
+}
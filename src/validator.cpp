@@ -0,0 +1,178 @@
+#include <lockstep/validator.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+LockstepValidator::LockstepValidator(CPU::Config config, size_t lanes)
+    : config(config), fast(config, lanes), reference_bytes(0x10000), engine_bytes(0x10000) {
+    for (size_t lane = 0; lane < fast.size(); lane++) {
+        reference.push_back(std::make_unique<CPU>());
+        traces.push_back(std::make_unique<TraceBuffer>(VALIDATE_TRACE));
+    }
+}
+
+/*-----------------[Setup]-----------------*/
+
+int LockstepValidator::load(const uint8_t* data, size_t size) {
+    int loaded = fast.load(data, size);
+    if (loaded < 0) {
+        return loaded;
+    }
+    for (size_t lane = 0; lane < reference.size(); lane++) {
+        CPU& cpu = *reference[lane];
+        cpu.set_config(config);
+        cpu.load_program_data(data, size);
+        cpu.seed(lane + 1);
+        cpu.reset_stats();
+        cpu.set_trace(traces[lane].get());
+        cpu.resume();
+        fast.seed(lane, lane + 1);
+    }
+    fast.reset_stats();
+    frame = 0;
+    next_input = 0;
+    keys = 0;
+    found = Divergence{};
+    return loaded;
+}
+
+void LockstepValidator::add_input(Headless::InputEvent event) {
+    auto it = std::upper_bound(inputs.begin(), inputs.end(), event,
+                               [](const Headless::InputEvent& a, const Headless::InputEvent& b) {
+                                   return a.frame < b.frame;
+                               });
+    inputs.insert(it, event);
+}
+
+// one key change at a time so both sides see the same press and release edges
+void LockstepValidator::apply_inputs() {
+    while (next_input < inputs.size() && inputs[next_input].frame <= frame) {
+        const Headless::InputEvent& event = inputs[next_input++];
+        if (event.pressed) {
+            keys |= 1 << event.key;
+        } else {
+            keys &= ~(1 << event.key);
+        }
+        for (size_t lane = 0; lane < reference.size(); lane++) {
+            reference[lane]->set_keys(keys);
+            fast.set_keys(lane, keys);
+        }
+    }
+}
+
+/*-----------------[Run]-----------------*/
+
+bool LockstepValidator::run(uint64_t max_frames) {
+    if (!found.diffs.empty()) return false;
+    for (uint64_t f = 0; f < max_frames; f++) {
+        apply_inputs();
+        for (auto& cpu : reference) cpu->run_frame();
+        fast.run_frame();
+        frame++;
+        for (size_t lane = 0; lane < reference.size(); lane++) {
+            if (!compare(lane)) return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+static void check(std::vector<std::string>& diffs, const char* field, T expected, T actual, int width = 2) {
+    if (expected == actual) return;
+    char line[96];
+    std::snprintf(line, sizeof(line), "%s: reference %0*llX, engine %0*llX", field, width,
+                  (unsigned long long)expected, width, (unsigned long long)actual);
+    diffs.push_back(line);
+}
+
+bool LockstepValidator::compare(size_t lane) {
+    CPU& cpu = *reference[lane];
+    std::vector<std::string> diffs;
+    char field[32];
+
+    check(diffs, "PC", cpu.get_pc(), fast.get_pc(lane), 4);
+    check(diffs, "I", cpu.get_index(), fast.get_index(lane), 4);
+    for (uint8_t r = 0; r < 16; r++) {
+        std::snprintf(field, sizeof(field), "V%X", r);
+        check(diffs, field, cpu.get_register(r), fast.get_register(lane, r));
+    }
+    check(diffs, "delay", cpu.get_delay(), fast.get_delay(lane));
+    check(diffs, "sound", cpu.get_sound(), fast.get_sound(lane));
+    check(diffs, "SP", cpu.get_sp(), fast.get_sp(lane));
+    for (int level = 0; level <= std::min(cpu.get_sp(), MAX_STACK - 1); level++) {
+        std::snprintf(field, sizeof(field), "stack[%d]", level);
+        check(diffs, field, cpu.get_stack(level), fast.get_stack(lane, level), 4);
+    }
+    check(diffs, "instructions", cpu.get_stats().instructions, fast.get_lane_stats(lane).instructions, 1);
+
+    cpu.get_memory().copy_out(0, reference_bytes.data(), reference_bytes.size());
+    fast.get_memory(lane).copy_out(0, engine_bytes.data(), engine_bytes.size());
+    if (std::memcmp(reference_bytes.data(), engine_bytes.data(), engine_bytes.size()) != 0) {
+        int listed = 0, differing = 0;
+        for (size_t addr = 0; addr < engine_bytes.size(); addr++) {
+            if (reference_bytes[addr] == engine_bytes[addr]) continue;
+            differing++;
+            if (listed++ < VALIDATE_MEMORY_DIFFS) {
+                std::snprintf(field, sizeof(field), "memory[%04zX]", addr);
+                check(diffs, field, reference_bytes[addr], engine_bytes[addr]);
+            }
+        }
+        if (differing > VALIDATE_MEMORY_DIFFS) {
+            diffs.push_back("memory: " + std::to_string(differing - VALIDATE_MEMORY_DIFFS) + " more bytes differ");
+        }
+    }
+
+    const std::array<uint8_t, SCREEN_SIZE>& expected = cpu.screen_view();
+    const std::array<uint8_t, SCREEN_SIZE>& actual = fast.screen_view(lane);
+    if (expected != actual) {
+        size_t pixels = 0, first = SCREEN_SIZE;
+        for (size_t p = 0; p < SCREEN_SIZE; p++) {
+            if (expected[p] == actual[p]) continue;
+            pixels++;
+            first = std::min(first, p);
+        }
+        char line[96];
+        std::snprintf(line, sizeof(line), "screen: %zu pixels differ, first at (%zu, %zu), hash %s vs %s", pixels,
+                      first % WIDTH, first / WIDTH, hash_to_hex(hash_screen(expected)).c_str(),
+                      hash_to_hex(hash_screen(actual)).c_str());
+        diffs.push_back(line);
+    }
+
+    if (diffs.empty()) return true;
+    found.frame = frame;
+    found.lane = lane;
+    found.diffs = diffs;
+    // the frame before matched, so only this frame's instructions can have caused it
+    for (const TraceEntry& entry : traces[lane]->snapshot()) {
+        if (entry.frame + 1 >= frame) found.trace.push_back(entry);
+    }
+    return false;
+}
+
+/*-----------------[Access Functions]-----------------*/
+
+uint64_t LockstepValidator::frames() {
+    return frame;
+}
+
+size_t LockstepValidator::size() {
+    return fast.size();
+}
+
+const LockstepValidator::Divergence& LockstepValidator::divergence() {
+    return found;
+}
+
+LockstepEngine& LockstepValidator::engine() {
+    return fast;
+}
+
+std::string divergence_to_text(const LockstepValidator::Divergence& divergence) {
+    std::string text = "lane " + std::to_string(divergence.lane) + " diverged after frame " +
+                       std::to_string(divergence.frame) + "\n";
+    for (const std::string& diff : divergence.diffs) text += "  " + diff + "\n";
+    text += "reference instructions in that frame:\n";
+    for (const TraceEntry& entry : divergence.trace) text += "  " + trace_entry_to_text(entry) + "\n";
+    return text;
+}
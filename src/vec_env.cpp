@@ -0,0 +1,140 @@
+#include <env/vec_env.h>
+
+#include <algorithm>
+#include <cstring>
+
+VecEnv::VecEnv(std::vector<uint8_t> rom, CPU::Config config, size_t num_envs, FrameFormat format, unsigned threads,
+               uint32_t seed)
+    : rom(std::move(rom)), config(config), format(format), seed(seed), episodes(num_envs, 0), pool(threads) {
+    image = CPU::build_image(VecEnv::rom.data(), VecEnv::rom.size(), config.start_address);
+    for (size_t i = 0; i < num_envs; i++) {
+        envs.push_back(std::make_unique<CPU>());
+        envs.back()->set_config(config);
+        // every page an episode writes comes from here and goes back on reset, so stepping never
+        // allocates; pages nothing writes stay shared with the image
+        envs.back()->reserve_pages(PAGE_COUNT);
+    }
+}
+
+/*-----------------[Setup]-----------------*/
+
+void VecEnv::add_reward_hook(RewardHook hook) {
+    hooks.push_back(hook);
+    hook_values.assign(envs.size() * hooks.size(), 0);
+}
+
+void VecEnv::add_done_condition(Headless::Condition condition) {
+    done_conditions.push_back(condition);
+}
+
+size_t VecEnv::size() {
+    return envs.size();
+}
+
+size_t VecEnv::frame_bytes() {
+    switch (format) {
+        case PACKED:
+            return SCREEN_SIZE / 8;
+        case LORES_BYTES:
+            return SCREEN_SIZE / 4;
+        case HIRES_BYTES:
+            return SCREEN_SIZE;
+    }
+    return SCREEN_SIZE;
+}
+
+/*-----------------[Reset/Step]-----------------*/
+
+void VecEnv::reset(uint8_t* frames_out, const uint8_t* mask) {
+    size_t stride = frame_bytes();
+    auto task = [this, frames_out, mask, stride](size_t i) {
+        if (mask && !mask[i]) return;
+        reset_one(i, frames_out + i * stride);
+    };
+    pool.parallel_for(envs.size(), task);
+}
+
+void VecEnv::step(const uint16_t* actions, const uint32_t* frame_skips, uint8_t* frames_out, float* rewards,
+                  uint8_t* dones) {
+    size_t stride = frame_bytes();
+    auto task = [this, actions, frame_skips, frames_out, rewards, dones, stride](size_t i) {
+        step_one(i, actions[i], frame_skips ? frame_skips[i] : 1, frames_out + i * stride,
+                 rewards ? rewards + i : nullptr, dones ? dones + i : nullptr);
+    };
+    pool.parallel_for(envs.size(), task);
+}
+
+void VecEnv::reset_one(size_t env, uint8_t* frame_out) {
+    CPU& cpu = *envs[env];
+    cpu.set_keys(0);
+    cpu.load_image(image);
+    cpu.seed(seed + env * 0x9E3779B9u + episodes[env]++);
+    cpu.resume();
+
+    for (size_t h = 0; h < hooks.size(); h++) {
+        hook_values[env * hooks.size() + h] = read_hook(cpu, hooks[h]);
+    }
+    write_frame(cpu, frame_out);
+}
+
+void VecEnv::step_one(size_t env, uint16_t action, uint32_t frame_skip, uint8_t* frame_out, float* reward,
+                      uint8_t* done) {
+    CPU& cpu = *envs[env];
+    cpu.set_keys(action);
+
+    bool finished = false;
+    for (uint32_t f = 0; f < std::max(frame_skip, 1u) && !finished; f++) {
+        cpu.run_frame();
+        for (const Headless::Condition& c : done_conditions) {
+            if (check_condition(cpu, c)) finished = true;
+        }
+    }
+
+    // hooks are read every step even when the caller skips rewards, so a DELTA never spans several steps
+    float total = 0;
+    for (size_t h = 0; h < hooks.size(); h++) {
+        uint16_t value = read_hook(cpu, hooks[h]);
+        uint16_t& prev = hook_values[env * hooks.size() + h];
+        float raw = hooks[h].kind == RewardHook::DELTA ? (float)value - (float)prev : (float)value;
+        total += hooks[h].scale * raw;
+        prev = value;
+    }
+    if (reward) *reward = total;
+    if (done) *done = finished;
+    write_frame(cpu, frame_out);
+}
+
+uint16_t VecEnv::read_hook(CPU& cpu, const RewardHook& hook) {
+    if (hook.width == 2) {
+        return (cpu.read_memory(hook.addr) << 8) | cpu.read_memory(hook.addr + 1);
+    }
+    return cpu.read_memory(hook.addr);
+}
+
+void VecEnv::write_frame(CPU& cpu, uint8_t* out) {
+    const std::array<uint8_t, SCREEN_SIZE>& screen = cpu.screen_view();
+    switch (format) {
+        case PACKED:
+            for (int i = 0; i < SCREEN_SIZE / 8; i++) {
+                uint8_t byte = 0;
+                for (int b = 0; b < 8; b++) {
+                    byte = (byte << 1) | (screen[i * 8 + b] != 0);
+                }
+                out[i] = byte;
+            }
+            break;
+
+        case LORES_BYTES:
+            // lores pixels are drawn as 2x2 blocks so every other row and column covers the screen
+            for (int r = 0; r < HEIGHT / 2; r++) {
+                for (int c = 0; c < WIDTH / 2; c++) {
+                    out[r * (WIDTH / 2) + c] = screen[(2 * r * WIDTH) + 2 * c];
+                }
+            }
+            break;
+
+        case HIRES_BYTES:
+            std::memcpy(out, screen.data(), SCREEN_SIZE);
+            break;
+    }
+}